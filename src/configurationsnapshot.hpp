@@ -0,0 +1,284 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_CONFIGURATIONSNAPSHOT_HPP
+#define FSM11_CONFIGURATIONSNAPSHOT_HPP
+
+#include "statemachine_fwd.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/thread.hpp>
+#else
+#include <atomic>
+#include <thread>
+#endif // FSM11_USE_WEOS
+
+#include <climits>
+#include <cstddef>
+#include <vector>
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+class ConfigurationPublisher;
+} // namespace fsm11_detail
+
+//! \brief A consistent view of a state machine configuration.
+//!
+//! A ConfigurationSnapshot is a copy of the set of active states, which the
+//! state machine has published after a configuration change. Each state is
+//! identified by its id(), which is the index of the state in a pre-order
+//! traversal of the state machine. The ids are assigned when the state
+//! machine is started. The state machine itself has the id 0.
+//!
+//! In contrast to calling isActive() on several states, all queries of a
+//! snapshot refer to the same configuration.
+class ConfigurationSnapshot
+{
+public:
+    ConfigurationSnapshot() noexcept
+        : m_numStates(0),
+          m_numConfigurationChanges(0)
+    {
+    }
+
+    //! \brief Returns the number of configuration changes.
+    //!
+    //! Returns the number of configuration changes, which the state
+    //! machine had performed when the snapshot was published. This serves
+    //! as the sequence number of the snapshot.
+    unsigned numConfigurationChanges() const noexcept
+    {
+        return m_numConfigurationChanges;
+    }
+
+    //! Returns the number of states in the snapshot.
+    std::size_t numStates() const noexcept
+    {
+        return m_numStates;
+    }
+
+    //! Returns \p true, if the state with the given \p id is active.
+    bool isActive(std::size_t id) const noexcept
+    {
+        return id < m_numStates
+               && (m_words[id / bits_per_word] >> (id % bits_per_word)) & 1;
+    }
+
+    //! Returns \p true, if the \p state is active.
+    template <typename TStateMachine>
+    bool isActive(const State<TStateMachine>& state) const noexcept
+    {
+        return isActive(state.id());
+    }
+
+    //! Returns \p true, if the state machine has been running.
+    bool running() const noexcept
+    {
+        return isActive(std::size_t(0));
+    }
+
+private:
+    static constexpr std::size_t bits_per_word = sizeof(unsigned) * CHAR_BIT;
+
+    std::vector<unsigned> m_words;
+    std::size_t m_numStates;
+    unsigned m_numConfigurationChanges;
+
+    friend class fsm11_detail::ConfigurationPublisher;
+};
+
+namespace fsm11_detail
+{
+
+//! \brief Publishes the configuration of a state machine.
+//!
+//! The configuration is stored as a bitset of the active states, which is
+//! protected by a sequence lock. A single writer, which is the dispatcher
+//! holding the state machine's lock, never waits. Readers copy the bitset
+//! and retry, while the writer is publishing a new configuration. So
+//! reading a snapshot is lock-free but not wait-free. Querying a single
+//! state needs no retry at all.
+class ConfigurationPublisher
+{
+public:
+    ConfigurationPublisher() noexcept
+        : m_sequence(0),
+          m_buffer(nullptr),
+          m_numStates(0),
+          m_numConfigurationChanges(0)
+    {
+    }
+
+    ConfigurationPublisher(const ConfigurationPublisher&) = delete;
+    ConfigurationPublisher& operator=(const ConfigurationPublisher&) = delete;
+
+    ~ConfigurationPublisher()
+    {
+        Buffer* buffer = m_buffer.load(FSM11STD::memory_order_relaxed);
+        while (buffer)
+        {
+            Buffer* previous = buffer->previous;
+            delete buffer;
+            buffer = previous;
+        }
+    }
+
+    //! \brief Publishes a configuration.
+    //!
+    //! Publishes the bitset \p words of \p numStates states together with
+    //! the \p numConfigurationChanges. Must only be called by one thread
+    //! at a time.
+    void publish(const unsigned* words, std::size_t numStates,
+                 unsigned numConfigurationChanges)
+    {
+        std::size_t numWords = (numStates + bits_per_word - 1) / bits_per_word;
+        Buffer* buffer = m_buffer.load(FSM11STD::memory_order_relaxed);
+        Buffer* grown = nullptr;
+        if (!buffer || buffer->numWords < numWords)
+        {
+            // The old buffer is kept alive, because a reader might still
+            // access it. The buffers only grow, so this happens rarely.
+            // The new buffer starts with a copy of the published words,
+            // such that isActive() never sees a zeroed configuration.
+            grown = new Buffer(numWords, buffer);
+        }
+
+        unsigned sequence = m_sequence.load(FSM11STD::memory_order_relaxed);
+        m_sequence.store(sequence + 1, FSM11STD::memory_order_relaxed);
+        FSM11STD::atomic_thread_fence(FSM11STD::memory_order_release);
+
+        if (grown)
+        {
+            buffer = grown;
+            m_buffer.store(buffer, FSM11STD::memory_order_release);
+        }
+
+        m_numStates.store(numStates, FSM11STD::memory_order_relaxed);
+        m_numConfigurationChanges.store(numConfigurationChanges,
+                                        FSM11STD::memory_order_relaxed);
+        // The words are stored with release semantics, such that a thread,
+        // which sees a state as active, also sees the effects of its entry.
+        for (std::size_t idx = 0; idx < numWords; ++idx)
+            buffer->words[idx].store(words[idx], FSM11STD::memory_order_release);
+
+        m_sequence.store(sequence + 2, FSM11STD::memory_order_release);
+    }
+
+    //! Returns \p true, if the state with the given \p id is active.
+    bool isActive(std::size_t id) const noexcept
+    {
+        Buffer* buffer = m_buffer.load(FSM11STD::memory_order_acquire);
+        if (!buffer || id >= buffer->numWords * bits_per_word)
+            return false;
+        unsigned word = buffer->words[id / bits_per_word].load(
+                            FSM11STD::memory_order_acquire);
+        return (word >> (id % bits_per_word)) & 1;
+    }
+
+    //! Copies the latest configuration to the \p snapshot.
+    void read(ConfigurationSnapshot& snapshot) const
+    {
+        while (true)
+        {
+            unsigned sequence = m_sequence.load(FSM11STD::memory_order_acquire);
+            if (sequence & 1)
+            {
+                FSM11STD::this_thread::yield();
+                continue;
+            }
+
+            Buffer* buffer = m_buffer.load(FSM11STD::memory_order_acquire);
+            std::size_t numStates
+                    = m_numStates.load(FSM11STD::memory_order_relaxed);
+            snapshot.m_numConfigurationChanges
+                    = m_numConfigurationChanges.load(
+                          FSM11STD::memory_order_relaxed);
+            std::size_t numWords
+                    = (numStates + bits_per_word - 1) / bits_per_word;
+            if (!buffer || buffer->numWords < numWords)
+                numWords = buffer ? buffer->numWords : 0;
+            snapshot.m_words.resize(numWords);
+            for (std::size_t idx = 0; idx < numWords; ++idx)
+            {
+                snapshot.m_words[idx] = buffer->words[idx].load(
+                                            FSM11STD::memory_order_relaxed);
+            }
+            snapshot.m_numStates = numWords * bits_per_word < numStates
+                                   ? numWords * bits_per_word : numStates;
+
+            FSM11STD::atomic_thread_fence(FSM11STD::memory_order_acquire);
+            if (m_sequence.load(FSM11STD::memory_order_relaxed) == sequence)
+                return;
+        }
+    }
+
+private:
+    static constexpr std::size_t bits_per_word = sizeof(unsigned) * CHAR_BIT;
+
+    struct Buffer
+    {
+        Buffer(std::size_t size, Buffer* prev)
+            : numWords(size),
+              words(new FSM11STD::atomic_uint[size > 0 ? size : 1]),
+              previous(prev)
+        {
+            // A buffer is only replaced by a larger one.
+            std::size_t numCopied = prev ? prev->numWords : 0;
+            for (std::size_t idx = 0; idx < numCopied; ++idx)
+            {
+                words[idx].store(prev->words[idx].load(
+                                     FSM11STD::memory_order_relaxed),
+                                 FSM11STD::memory_order_relaxed);
+            }
+            for (std::size_t idx = numCopied; idx < numWords; ++idx)
+                words[idx].store(0, FSM11STD::memory_order_relaxed);
+        }
+
+        ~Buffer()
+        {
+            delete[] words;
+        }
+
+        std::size_t numWords;
+        FSM11STD::atomic_uint* words;
+        Buffer* previous;
+    };
+
+    FSM11STD::atomic_uint m_sequence;
+    FSM11STD::atomic<Buffer*> m_buffer;
+    FSM11STD::atomic<std::size_t> m_numStates;
+    FSM11STD::atomic_uint m_numConfigurationChanges;
+};
+
+} // namespace fsm11_detail
+} // namespace fsm11
+
+#endif // FSM11_CONFIGURATIONSNAPSHOT_HPP
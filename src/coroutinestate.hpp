@@ -0,0 +1,336 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_COROUTINESTATE_HPP
+#define FSM11_COROUTINESTATE_HPP
+
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "The CoroutineState needs C++20 coroutines."
+#endif
+
+#include "statemachine_fwd.hpp"
+#include "state.hpp"
+
+#include <coroutine>
+
+#ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/exception.hpp>
+#include <weos/memory.hpp>
+#include <weos/mutex.hpp>
+#include <weos/utility.hpp>
+#else
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+#endif // FSM11_USE_WEOS
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+
+//! The state of one invocation of a coroutine, which is shared with the
+//! resumptions scheduled on executors.
+struct CoroutineControl
+{
+    //! Serializes the resumptions of the coroutine.
+    FSM11STD::recursive_mutex mutex;
+    FSM11STD::atomic_bool requested{false};
+    //! Set as long as the coroutine may be resumed.
+    bool alive{true};
+    //! The coroutine which awaits the exit request.
+    std::coroutine_handle<> exitWaiter;
+};
+
+} // namespace fsm11_detail
+
+//! \brief The return type of a coroutine invoke action.
+//!
+//! An InvokeCoroutine owns the frame of a coroutine, which is used as
+//! invoke action of a CoroutineState. The coroutine is suspended
+//! initially and is started when the state is entered.
+class InvokeCoroutine
+{
+public:
+    struct promise_type
+    {
+        InvokeCoroutine get_return_object() noexcept
+        {
+            return InvokeCoroutine(handle_type::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        void return_void() const noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+            exception = FSM11STD::current_exception();
+        }
+
+        FSM11STD::exception_ptr exception;
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    InvokeCoroutine() noexcept = default;
+
+    InvokeCoroutine(InvokeCoroutine&& other) noexcept
+        : m_handle(FSM11STD::exchange(other.m_handle, nullptr))
+    {
+    }
+
+    InvokeCoroutine& operator=(InvokeCoroutine&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            m_handle = FSM11STD::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~InvokeCoroutine()
+    {
+        reset();
+    }
+
+    //! Returns \p true, if the coroutine has finished.
+    bool done() const noexcept
+    {
+        return !m_handle || m_handle.done();
+    }
+
+    //! Resumes the coroutine.
+    void resume()
+    {
+        m_handle.resume();
+    }
+
+    //! Returns the exception which escaped from the coroutine.
+    FSM11STD::exception_ptr exception() const noexcept
+    {
+        return m_handle ? m_handle.promise().exception : nullptr;
+    }
+
+    //! Destroys the coroutine frame, which runs the destructors of all
+    //! objects in the frame.
+    void reset() noexcept
+    {
+        if (m_handle)
+            m_handle.destroy();
+        m_handle = nullptr;
+    }
+
+private:
+    explicit InvokeCoroutine(handle_type handle) noexcept
+        : m_handle(handle)
+    {
+    }
+
+    handle_type m_handle;
+};
+
+//! \brief A cancellation token for coroutine invoke actions.
+//!
+//! The CoroutineExitRequest is passed to the invoke action of a
+//! CoroutineState. It can be polled like an ExitRequest. In addition,
+//! it can be awaited with <tt>co_await exitRequest</tt>. The coroutine
+//! is resumed when its state is left.
+class CoroutineExitRequest
+{
+public:
+    CoroutineExitRequest() = default;
+
+    CoroutineExitRequest(const CoroutineExitRequest&) = delete;
+    CoroutineExitRequest& operator=(const CoroutineExitRequest&) = delete;
+
+    //! Checks if an exit has been requested.
+    //!
+    //! Returns \p true if an exit has been requested.
+    explicit operator bool() const noexcept
+    {
+        return m_control && m_control->requested;
+    }
+
+    //! \cond
+    bool await_ready() const noexcept
+    {
+        return bool(*this);
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        m_control->exitWaiter = handle;
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+    //! \endcond
+
+    //! \brief Resumes the coroutine on an executor.
+    //!
+    //! Returns an awaitable which suspends the coroutine and posts its
+    //! resumption to the \p executor. The executor has to provide a
+    //! member function <tt>post(fn)</tt>, which calls \p fn at some
+    //! later point. The executor must not resume the coroutine
+    //! concurrently with the state machine's dispatcher, for example,
+    //! by running in the thread of the event loop. If the state is left
+    //! before the executor calls \p fn, the coroutine is not resumed.
+    template <typename TExecutor>
+    auto resumeOn(TExecutor& executor) const noexcept;
+
+private:
+    FSM11STD::shared_ptr<fsm11_detail::CoroutineControl> m_control;
+
+    template <typename TStateMachine>
+    friend class CoroutineState;
+};
+
+template <typename TExecutor>
+auto CoroutineExitRequest::resumeOn(TExecutor& executor) const noexcept
+{
+    struct Awaiter
+    {
+        TExecutor& executor;
+        FSM11STD::shared_ptr<fsm11_detail::CoroutineControl> control;
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            executor.post([control = control, handle] {
+                FSM11STD::lock_guard<FSM11STD::recursive_mutex> lock(
+                            control->mutex);
+                if (control->alive)
+                    handle.resume();
+            });
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+    };
+
+    return Awaiter{executor, m_control};
+}
+
+//! \brief A state with a coroutine as invoke action.
+//!
+//! The CoroutineState is an alternative to the ThreadedState, which does
+//! not need a thread. Its invoke action is a coroutine, which is started
+//! by the thread entering the state, i.e. the thread dispatching events.
+//! The coroutine runs until it suspends for the first time. It can await
+//! its exit request with <tt>co_await exitRequest</tt>, in which case it
+//! is resumed when the state is left. It can also await the resumption on
+//! an executor with <tt>co_await exitRequest.resumeOn(executor)</tt>.
+//!
+//! When the state is left, the exit request is set and a coroutine, which
+//! awaits it, is resumed. If the coroutine has not finished afterwards,
+//! its frame is destroyed. An exception escaping from the coroutine is
+//! rethrown when the state is left, just like for a ThreadedState.
+//!
+//! This class is only available when compiling with C++20.
+template <typename TStateMachine>
+class CoroutineState : public State<TStateMachine>
+{
+    using base_type = State<TStateMachine>;
+
+public:
+    using type = CoroutineState<TStateMachine>;
+
+    //! \brief Creates a state with a coroutine invoke action.
+    explicit CoroutineState(const char* name, base_type* parent = nullptr)
+        : base_type(name, parent)
+    {
+    }
+
+    //! \brief The actual invoke action.
+    //!
+    //! This coroutine is started when the state is entered. Derived
+    //! classes have to provide an implementation.
+    virtual InvokeCoroutine invoke(CoroutineExitRequest& exitRequest) = 0;
+
+    //! Starts the coroutine.
+    virtual void enterInvoke() override final
+    {
+        using namespace FSM11STD;
+
+        m_exitRequest.m_control
+                = make_shared<fsm11_detail::CoroutineControl>();
+        m_coroutine = invoke(m_exitRequest);
+
+        lock_guard<recursive_mutex> lock(m_exitRequest.m_control->mutex);
+        m_coroutine.resume();
+    }
+
+    //! Requests the coroutine to exit and destroys it.
+    virtual void exitInvoke() override final
+    {
+        using namespace FSM11STD;
+
+        auto control = m_exitRequest.m_control;
+        {
+            lock_guard<recursive_mutex> lock(control->mutex);
+            control->requested = true;
+            if (auto waiter = exchange(control->exitWaiter, nullptr))
+                waiter.resume();
+            control->alive = false;
+        }
+
+        exception_ptr exception = m_coroutine.exception();
+        m_coroutine.reset();
+        if (exception)
+            rethrow_exception(exception);
+    }
+
+private:
+    CoroutineExitRequest m_exitRequest;
+    InvokeCoroutine m_coroutine;
+};
+
+} // namespace fsm11
+
+#endif // FSM11_COROUTINESTATE_HPP
@@ -0,0 +1,131 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_DETAIL_BOUNDEDRING_HPP
+#define FSM11_DETAIL_BOUNDEDRING_HPP
+
+#include "../statemachine_fwd.hpp"
+#include "../ringbuffer.hpp"
+#include "../options.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/type_traits.hpp>
+#include <weos/utility.hpp>
+#else
+#include <type_traits>
+#include <utility>
+#endif // FSM11_USE_WEOS
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+
+//! \brief A ring buffer of fixed capacity.
+//!
+//! The BoundedRing is the event list of a state machine, whose event list
+//! has a fixed capacity (see EventListCapacity). It is a RingBuffer, which
+//! reserves the storage for \p TCapacity elements when it is constructed,
+//! so adding and removing elements never allocates. Adding an element to a
+//! full ring is not allowed.
+template <typename T, std::size_t TCapacity>
+class BoundedRing : private RingBuffer<T, 1>
+{
+    static_assert(TCapacity > 0, "The capacity must be non-zero.");
+
+    using base_type = RingBuffer<T, 1>;
+
+public:
+    using typename base_type::value_type;
+    using typename base_type::reference;
+    using typename base_type::const_reference;
+    using typename base_type::size_type;
+
+    BoundedRing()
+    {
+        this->reserve(TCapacity);
+    }
+
+    using base_type::empty;
+    using base_type::size;
+    using base_type::front;
+    using base_type::pop_front;
+    using base_type::clear;
+
+    //! Returns \p true, if the ring is full.
+    bool full() const noexcept
+    {
+        return size() == TCapacity;
+    }
+
+    //! Returns the capacity.
+    static constexpr size_type capacity() noexcept
+    {
+        return TCapacity;
+    }
+
+    //! Appends the \p value. The ring must not be full.
+    void push_back(const T& value)
+    {
+        FSM11_ASSERT(!full());
+        base_type::push_back(value);
+    }
+
+    //! Appends the \p value. The ring must not be full.
+    void push_back(T&& value)
+    {
+        FSM11_ASSERT(!full());
+        base_type::push_back(FSM11STD::move(value));
+    }
+};
+
+//! Selects the event list of a state machine with the options \p TOptions.
+//! A bounded event list is always a BoundedRing, so the event list type
+//! must not be configured in addition.
+template <typename TOptions,
+          bool TBounded = (TOptions::event_list_capacity > 0)>
+struct get_event_list
+{
+    using type = typename TOptions::event_list_type;
+};
+
+template <typename TOptions>
+struct get_event_list<TOptions, true>
+{
+    static_assert(FSM11STD::is_same<typename TOptions::event_list_type,
+                                    default_options::event_list_type>::value,
+                  "A bounded event list cannot have a custom event list type.");
+
+    using type = BoundedRing<typename TOptions::event_type,
+                             TOptions::event_list_capacity>;
+};
+
+} // namespace fsm11_detail
+} // namespace fsm11
+
+#endif // FSM11_DETAIL_BOUNDEDRING_HPP
@@ -44,12 +44,40 @@
 
 namespace fsm11
 {
+
+//! The reason, why an event has been discarded.
+enum class DiscardReason
+{
+    //! The event has not enabled any transition.
+    NoTransition,
+    //! The deadline of the event has passed before it could be dispatched.
+    Expired
+};
+
 namespace fsm11_detail
 {
 // ----=====================================================================----
 //     Event callbacks
 // ----=====================================================================----
 
+//! Checks if an object of type \p TCallback can be called with an event of
+//! type \p TEvent and a DiscardReason.
+template <typename TCallback, typename TEvent>
+struct accepts_discard_reason
+{
+    template <typename T>
+    static auto test(int)
+        -> decltype(FSM11STD::declval<T&>()(FSM11STD::declval<TEvent>(),
+                                            DiscardReason::NoTransition),
+                    FSM11STD::true_type());
+
+    template <typename T>
+    static FSM11STD::false_type test(...);
+
+    static constexpr bool value
+        = decltype(test<typename FSM11STD::decay<TCallback>::type>(0))::value;
+};
+
 template <typename TDerived>
 class WithoutEventCallbacks
 {
@@ -78,7 +106,7 @@ protected:
     }
 
     inline
-    void invokeEventDiscardedCallback(event_type)
+    void invokeEventDiscardedCallback(event_type, DiscardReason)
     {
     }
 };
@@ -96,10 +124,18 @@ public:
         m_eventDispatchCallback = FSM11STD::forward<TType>(callback);
     }
 
+    //! \brief Sets the callback for discarded events.
+    //!
+    //! The \p callback is invoked with the event, which has been discarded.
+    //! If it accepts a DiscardReason as second argument, it is told
+    //! why the event has been discarded, too.
     template <typename TType>
     void setEventDiscardedCallback(TType&& callback)
     {
-        m_eventDiscardedCallback = FSM11STD::forward<TType>(callback);
+        setEventDiscardedCallback(
+                FSM11STD::forward<TType>(callback),
+                FSM11STD::integral_constant<
+                    bool, accepts_discard_reason<TType, event_type>::value>());
     }
 
 protected:
@@ -111,15 +147,39 @@ protected:
     }
 
     inline
-    void invokeEventDiscardedCallback(event_type event)
+    void invokeEventDiscardedCallback(event_type event, DiscardReason reason)
     {
         if (m_eventDiscardedCallback)
-            m_eventDiscardedCallback(event);
+            m_eventDiscardedCallback(event, reason);
     }
 
 private:
     FSM11STD::function<void(event_type)> m_eventDispatchCallback;
-    FSM11STD::function<void(event_type)> m_eventDiscardedCallback;
+    FSM11STD::function<void(event_type, DiscardReason)> m_eventDiscardedCallback;
+
+    template <typename TType>
+    void setEventDiscardedCallback(TType&& callback, FSM11STD::true_type)
+    {
+        m_eventDiscardedCallback = FSM11STD::forward<TType>(callback);
+    }
+
+    template <typename TType>
+    void setEventDiscardedCallback(TType&& callback, FSM11STD::false_type)
+    {
+        FSM11STD::function<void(event_type)> withoutReason(
+                FSM11STD::forward<TType>(callback));
+        if (withoutReason)
+        {
+            m_eventDiscardedCallback
+                = [withoutReason](event_type event, DiscardReason) {
+                      withoutReason(event);
+                  };
+        }
+        else
+        {
+            m_eventDiscardedCallback = nullptr;
+        }
+    }
 };
 
 template <bool TEnabled, typename TOptions>
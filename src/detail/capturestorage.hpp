@@ -33,25 +33,34 @@
 #include "options.hpp"
 
 #ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/functional.hpp>
+#include <weos/thread.hpp>
+#include <weos/type_traits.hpp>
 #include <weos/utility.hpp>
 #include <weos/tuple.hpp>
 #else
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <type_traits>
 #include <utility>
 #include <tuple>
 #endif // FSM11_USE_WEOS
 
 #include <cstddef>
+#include <cstring>
 
 namespace fsm11
 {
 namespace fsm11_detail
 {
 
-template <typename TDerived, typename TList>
+template <typename TDerived, typename TList, bool TLockFree>
 class CaptureStorage;
 
 template <typename TDerived, typename... TTypes>
-class CaptureStorage<TDerived, type_list<TTypes...>>
+class CaptureStorage<TDerived, type_list<TTypes...>, false>
 {
     typedef FSM11STD::tuple<TTypes...> tuple_type;
 
@@ -88,6 +97,27 @@ public:
         m_updateStorageCallback = FSM11STD::forward<TType>(callback);
     }
 
+    template <typename T = void>
+    void markCaptureStorageDirty()
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "Lock-free capture storage is not enabled");
+    }
+
+    template <typename T = void>
+    void loadAll() const
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "Lock-free capture storage is not enabled");
+    }
+
+    template <typename T = void>
+    void eventSnapshot() const
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "Lock-free capture storage is not enabled");
+    }
+
 protected:
     inline
     void invokeCaptureStorageCallback()
@@ -111,8 +141,241 @@ private:
     }
 };
 
+//! \brief A value, which can be copied while it is written.
+//!
+//! The value is kept in an array of atomic words. Loading and storing it
+//! never races, but a load may see a mix of two stores. The
+//! CaptureStorage detects this with its sequence number and retries.
+template <typename TType>
+class SeqLockCell
+{
+    static_assert(FSM11STD::is_trivially_copyable<TType>::value,
+                  "A lock-free capture storage needs trivially copyable types");
+
+    using word_type = unsigned long;
+    static constexpr std::size_t num_words
+            = (sizeof(TType) + sizeof(word_type) - 1) / sizeof(word_type);
+
+public:
+    SeqLockCell()
+    {
+        store(TType());
+    }
+
+    SeqLockCell(const SeqLockCell&) = delete;
+    SeqLockCell& operator=(const SeqLockCell&) = delete;
+
+    void store(const TType& value) noexcept
+    {
+        word_type buffer[num_words] = {};
+        std::memcpy(buffer, &value, sizeof(TType));
+        for (std::size_t idx = 0; idx < num_words; ++idx)
+            m_words[idx].store(buffer[idx], FSM11STD::memory_order_relaxed);
+    }
+
+    TType load() const noexcept
+    {
+        word_type buffer[num_words];
+        for (std::size_t idx = 0; idx < num_words; ++idx)
+            buffer[idx] = m_words[idx].load(FSM11STD::memory_order_relaxed);
+        TType value;
+        std::memcpy(&value, buffer, sizeof(TType));
+        return value;
+    }
+
+private:
+    FSM11STD::atomic<word_type> m_words[num_words];
+};
+
+//! \brief A capture storage, which is accessed without the lock.
+//!
+//! The elements are protected by a sequence lock. Writers are serialized
+//! by the sequence number and readers retry, if a writer has modified the
+//! storage while they copied it. Thus, load() returns a consistent value
+//! without taking the state machine's lock.
+//!
+//! The capture callback is only invoked, if the storage has been marked
+//! dirty since the last capture. Before an event is dispatched, the
+//! storage is copied to the event snapshot, such that all guards and
+//! actions, which are executed for the event, see the same values. The
+//! copy is skipped, if nothing has been stored since the last snapshot.
+template <typename TDerived, typename... TTypes>
+class CaptureStorage<TDerived, type_list<TTypes...>, true>
+{
+    typedef FSM11STD::tuple<TTypes...> tuple_type;
+    typedef FSM11STD::tuple<SeqLockCell<TTypes>...> cell_tuple_type;
+
+    // A helper to check the index agains the tuple size.
+    template <std::size_t TIndex>
+    struct get_type
+    {
+        static_assert(TIndex < FSM11STD::tuple_size<tuple_type>::value,
+                      "Index out of bounds");
+
+        using type = typename FSM11STD::tuple_element<TIndex, tuple_type>::type;
+    };
+
+    template <std::size_t TIndex>
+    using index = FSM11STD::integral_constant<std::size_t, TIndex>;
+
+public:
+    CaptureStorage()
+        : m_sequence(0),
+          m_dirty(true),
+          m_snapshotSequence(1)
+    {
+    }
+
+    //! Returns the \p TIndex-th element of the storage.
+    template <std::size_t TIndex>
+    typename get_type<TIndex>::type load() const
+    {
+        while (true)
+        {
+            unsigned sequence = beginRead();
+            auto value = FSM11STD::get<TIndex>(m_cells).load();
+            if (endRead(sequence))
+                return value;
+        }
+    }
+
+    //! Returns a copy of all elements, which have been stored at the same
+    //! time.
+    tuple_type loadAll() const
+    {
+        tuple_type data;
+        readAll(data);
+        return data;
+    }
+
+    template <std::size_t TIndex, typename TType>
+    void store(TType&& value)
+    {
+        typename get_type<TIndex>::type converted(
+                FSM11STD::forward<TType>(value));
+
+        unsigned sequence = m_sequence.load(FSM11STD::memory_order_relaxed);
+        while (true)
+        {
+            if (sequence & 1)
+            {
+                FSM11STD::this_thread::yield();
+                sequence = m_sequence.load(FSM11STD::memory_order_relaxed);
+            }
+            else if (m_sequence.compare_exchange_weak(
+                         sequence, sequence + 1,
+                         FSM11STD::memory_order_acquire,
+                         FSM11STD::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        FSM11STD::atomic_thread_fence(FSM11STD::memory_order_release);
+
+        FSM11STD::get<TIndex>(m_cells).store(converted);
+        m_sequence.store(sequence + 2, FSM11STD::memory_order_release);
+    }
+
+    //! \brief Marks the storage as dirty.
+    //!
+    //! Requests the capture callback to be invoked before the next event
+    //! is dispatched. This function may be called from any thread.
+    void markCaptureStorageDirty() noexcept
+    {
+        m_dirty.store(true, FSM11STD::memory_order_release);
+    }
+
+    //! \brief Returns the snapshot of the current event.
+    //!
+    //! Returns the copy of the storage, which has been taken before the
+    //! current event has been dispatched. This function must only be called
+    //! from guards and actions.
+    const tuple_type& eventSnapshot() const noexcept
+    {
+        return m_eventSnapshot;
+    }
+
+    template <typename TType>
+    void setCaptureStorageCallback(TType&& callback)
+    {
+        m_updateStorageCallback = FSM11STD::forward<TType>(callback);
+        markCaptureStorageDirty();
+    }
+
+protected:
+    inline
+    void invokeCaptureStorageCallback()
+    {
+        if (m_updateStorageCallback
+            && m_dirty.exchange(false, FSM11STD::memory_order_acquire))
+        {
+            m_updateStorageCallback();
+        }
+        // The sequence number only changes with a store, so an unchanged
+        // number means that the snapshot is still up to date.
+        if (m_sequence.load(FSM11STD::memory_order_relaxed)
+            != m_snapshotSequence)
+        {
+            m_snapshotSequence = readAll(m_eventSnapshot);
+        }
+    }
+
+private:
+    FSM11STD::atomic_uint m_sequence;
+    cell_tuple_type m_cells;
+    FSM11STD::atomic_bool m_dirty;
+    tuple_type m_eventSnapshot;
+    //! The sequence number of the event snapshot. It is initialized to an
+    //! odd number, which never belongs to a snapshot.
+    unsigned m_snapshotSequence;
+    FSM11STD::function<void()> m_updateStorageCallback;
+
+    unsigned beginRead() const noexcept
+    {
+        unsigned sequence = m_sequence.load(FSM11STD::memory_order_acquire);
+        while (sequence & 1)
+        {
+            FSM11STD::this_thread::yield();
+            sequence = m_sequence.load(FSM11STD::memory_order_acquire);
+        }
+        return sequence;
+    }
+
+    //! Returns \p true, if no writer has modified the storage since
+    //! beginRead() returned the \p sequence.
+    bool endRead(unsigned sequence) const noexcept
+    {
+        FSM11STD::atomic_thread_fence(FSM11STD::memory_order_acquire);
+        return m_sequence.load(FSM11STD::memory_order_relaxed) == sequence;
+    }
+
+    //! Copies all elements to the \p data and returns the sequence number
+    //! of the copy.
+    unsigned readAll(tuple_type& data) const noexcept
+    {
+        while (true)
+        {
+            unsigned sequence = beginRead();
+            copyCells(data, index<0>());
+            if (endRead(sequence))
+                return sequence;
+        }
+    }
+
+    template <std::size_t TIndex>
+    void copyCells(tuple_type& data, index<TIndex>) const noexcept
+    {
+        FSM11STD::get<TIndex>(data) = FSM11STD::get<TIndex>(m_cells).load();
+        copyCells(data, index<TIndex + 1>());
+    }
+
+    void copyCells(tuple_type&, index<sizeof...(TTypes)>) const noexcept
+    {
+    }
+};
+
 template <typename TDerived>
-class CaptureStorage<TDerived, type_list<>>
+class CaptureStorage<TDerived, type_list<>, false>
 {
 public:
     template <std::size_t TIndex>
@@ -144,8 +407,13 @@ protected:
 template <typename TOptions>
 struct get_storage
 {
+    // An empty storage has nothing to protect.
     typedef CaptureStorage<StateMachineImpl<TOptions>,
-                           typename TOptions::capture_storage> type;
+                           typename TOptions::capture_storage,
+                           TOptions::lock_free_capture_storage_enable
+                           && !FSM11STD::is_same<
+                                  typename TOptions::capture_storage,
+                                  type_list<>>::value> type;
 };
 
 } // namespace fsm11_detail
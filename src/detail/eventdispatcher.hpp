@@ -30,25 +30,43 @@
 #define FSM11_DETAIL_EVENTDISPATCHER_HPP
 
 #include "../statemachine_fwd.hpp"
+#include "../configurationsnapshot.hpp"
+#include "../error.hpp"
+#include "../eventfuture.hpp"
+#include "../executor.hpp"
 #include "../historystate.hpp"
+#include "../ringbuffer.hpp"
+#include "../threadattributes.hpp"
+#include "callbacks.hpp"
 #include "scopeguard.hpp"
+#include "threadedstatebase.hpp"
 
 #ifdef FSM11_USE_WEOS
 #include <weos/atomic.hpp>
+#include <weos/chrono.hpp>
 #include <weos/condition_variable.hpp>
+#include <weos/functional.hpp>
 #include <weos/future.hpp>
 #include <weos/mutex.hpp>
+#include <weos/type_traits.hpp>
 #include <weos/utility.hpp>
 #include <weos/thread.hpp>
 #else
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <future>
 #include <mutex>
+#include <type_traits>
 #include <utility>
 #include <thread>
 #endif // FSM11_USE_WEOS
 
+#include <algorithm>
+#include <climits>
+#include <vector>
+
 namespace fsm11
 {
 namespace fsm11_detail
@@ -73,11 +91,69 @@ public:
         return m_numConfigurationChanges;
     }
 
+    //! \brief Returns a snapshot of the configuration.
+    //!
+    //! Returns the configuration, which the state machine has published
+    //! after its latest configuration change. The function does not lock
+    //! the state machine and does not wait for a dispatch to finish. It
+    //! only retries while a new configuration is being published.
+    ConfigurationSnapshot configurationSnapshot() const
+    {
+        ConfigurationSnapshot snapshot;
+        m_configurationPublisher.read(snapshot);
+        return snapshot;
+    }
+
+    //! Copies the latest configuration to the \p snapshot. This overload
+    //! re-uses the memory of the \p snapshot.
+    void configurationSnapshot(ConfigurationSnapshot& snapshot) const
+    {
+        m_configurationPublisher.read(snapshot);
+    }
+
+    //! \brief Waits until a state is active.
+    //!
+    //! Blocks until the \p state is active or the \p timeout has expired.
+    //! Returns \p true, if the state is active.
+    template <typename TRep, typename TPeriod>
+    bool waitUntilActive(
+            const State<TDerived>& state,
+            const FSM11STD::chrono::duration<TRep, TPeriod>& timeout) const
+    {
+        return waitFor(timeout, [this, &state] {
+            // Reading the counter orders the check after the publication,
+            // which has been announced to the waiters.
+            m_numConfigurationChanges.load();
+            return state.isActive();
+        });
+    }
+
+    //! \brief Waits for a configuration change.
+    //!
+    //! Blocks until the number of configuration changes differs from
+    //! \p sinceCount or the \p timeout has expired. Returns \p true, if the
+    //! configuration has changed. Usually, \p sinceCount is the result of a
+    //! previous call to numConfigurationChanges().
+    template <typename TRep, typename TPeriod>
+    bool waitForConfigurationChange(
+            unsigned sinceCount,
+            const FSM11STD::chrono::duration<TRep, TPeriod>& timeout) const
+    {
+        return waitFor(timeout, [this, sinceCount] {
+            return m_numConfigurationChanges.load() != sinceCount;
+        });
+    }
+
 protected:
     using options = typename get_options<TDerived>::type;
     using event_type = typename options::event_type;
     using state_type = State<TDerived>;
     using transition_type = Transition<TDerived>;
+    using invocation_tracker_type
+        = typename FSM11STD::conditional<
+              options::asynchronous_invoke_exit_enable,
+              InvocationTracker,
+              NullInvocationTracker>::type;
 
 
     //! The set of enabled transitions.
@@ -85,6 +161,20 @@ protected:
 
     FSM11STD::atomic_uint m_numConfigurationChanges;
 
+    //! Keeps track of the invocations, which are left asynchronously.
+    invocation_tracker_type m_invocationTracker;
+
+    //! Publishes the active states to the readers.
+    ConfigurationPublisher m_configurationPublisher;
+    //! The bitset of active states, which is published next.
+    std::vector<unsigned> m_activeStateSet;
+
+    //! The waiters park on this condition variable. It is only notified,
+    //! if the number of waiters is non-zero.
+    mutable FSM11STD::mutex m_waitMutex;
+    mutable FSM11STD::condition_variable m_waitCondition;
+    mutable FSM11STD::atomic_uint m_numWaiters{0};
+
 
     TDerived& derived()
     {
@@ -153,6 +243,49 @@ protected:
     //! Leaves the current configuration, which effectively stops the
     //! state machine.
     void leaveConfiguration();
+
+    //! Publishes the set of active states together with the
+    //! \p numConfigurationChanges.
+    void publishConfiguration(unsigned numConfigurationChanges);
+
+    //! \brief Waits for a condition.
+    //!
+    //! Blocks until the \p predicate is satisfied or the \p timeout has
+    //! expired. The predicate is re-evaluated whenever notifyWaiters() is
+    //! called. Returns the result of the predicate.
+    template <typename TRep, typename TPeriod, typename TPredicate>
+    bool waitFor(const FSM11STD::chrono::duration<TRep, TPeriod>& timeout,
+                 TPredicate predicate) const
+    {
+        // The waiter is registered before the predicate is evaluated. A
+        // dispatcher, which changes the state after the registration, is
+        // going to notify the waiter.
+        m_numWaiters.fetch_add(1);
+        FSM11_SCOPE_EXIT { m_numWaiters.fetch_sub(1); };
+        FSM11STD::unique_lock<FSM11STD::mutex> lock(m_waitMutex);
+        return m_waitCondition.wait_for(lock, timeout, predicate);
+    }
+
+    //! Wakes up the waiting threads. This is cheap if nobody waits. Must
+    //! not be called while holding the event loop mutex.
+    void notifyWaiters()
+    {
+        if (m_numWaiters.load() != 0)
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_waitMutex);
+            m_waitCondition.notify_all();
+        }
+    }
+
+    //! \brief Marks the timeout of a timed transition as expired.
+    //!
+    //! Returns \p true, if the timer of the given \p generation is still
+    //! armed. Otherwise, the source state has been left in the meantime and
+    //! the timer is ignored.
+    bool markTimeoutExpired(transition_type* transition,
+                            unsigned generation) noexcept;
+
+    friend class State<TDerived>;
 };
 
 template <typename TDerived>
@@ -213,6 +346,13 @@ void EventDispatcherBase<TDerived>::selectTransitions(bool onlyEventless,
             if (onlyEventless && !transitionIter->eventless())
                 continue;
 
+            // A timed transition is enabled after its timeout has expired.
+            if (options::timer_enable && transitionIter->timeout()
+                && !transitionIter->timeout()->expired)
+            {
+                continue;
+            }
+
             // If a transition has an event, the event must match.
             if (!transitionIter->eventless()
                 && transitionIter->event() != event)
@@ -368,6 +508,7 @@ void EventDispatcherBase<TDerived>::enterStatesInEnterSet(event_type event)
                 derived().invokeStateExceptionCallbackOrThrow();
             }
             iter->m_flags |= (state_type::Active | state_type::StartInvoke);
+            derived().armTimeouts(*iter);
         }
     }
 }
@@ -404,6 +545,7 @@ void EventDispatcherBase<TDerived>::leaveStatesInExitSet(event_type event)
         if (iter->m_flags & state_type::InExitSet)
         {
             derived().invokeStateExitCallback(&*iter);
+            derived().disarmTimeouts(*iter);
 
             iter->m_flags &= ~state_type::StartInvoke;
 
@@ -513,6 +655,11 @@ bool EventDispatcherBase<TDerived>::microstep(event_type event)
          transition != nullptr;
          transition = transition->m_nextInEnabledSet)
     {
+        // A timed transition, which does not leave its source state, must
+        // not be taken again until it has been re-armed.
+        if (options::timer_enable && transition->timeout())
+            transition->timeout()->expired = false;
+
         if (transition->action())
             transition->action()(event);
     }
@@ -537,10 +684,10 @@ void EventDispatcherBase<TDerived>::runToCompletion(bool changedConfiguration)
         clearEnabledTransitionsSet();
     }
 
-    // Synchronize the visible state active flag with the internal
-    // state active flag.
-    for (auto iter = derived().begin(); iter != derived().end(); ++iter)
-        iter->m_visibleActive = (iter->m_flags & state_type::Active) != 0;
+    // Publish the internal state active flags. The set of active states
+    // changes only together with the configuration.
+    if (changedConfiguration)
+        publishConfiguration(m_numConfigurationChanges + 1);
 
     // Call the invoke() methods of all currently active states.
     for (auto iter = derived().begin(); iter != derived().end(); ++iter)
@@ -558,6 +705,7 @@ void EventDispatcherBase<TDerived>::runToCompletion(bool changedConfiguration)
     if (changedConfiguration)
     {
         ++m_numConfigurationChanges;
+        notifyWaiters();
         derived().invokeConfigurationChangeCallback();
     }
 }
@@ -604,6 +752,13 @@ void EventDispatcherBase<TDerived>::enterInitialStates()
 {
     // TODO: Would be nice, if the state machine had an initial
     // transition similar to initial transitions of states.
+
+    // The hierarchy is fixed while the state machine is running. Thus,
+    // the ids of the states are assigned now.
+    unsigned id = 0;
+    for (auto iter = derived().begin(); iter != derived().end(); ++iter)
+        iter->m_id.store(id++, FSM11STD::memory_order_relaxed);
+
     clearTransientStateFlags();
     derived().m_flags |= state_type::InEnterSet;
     markDescendantsForEntry();
@@ -620,16 +775,55 @@ void EventDispatcherBase<TDerived>::leaveConfiguration()
     }
     leaveStatesInExitSet(event_type());
 
-    for (auto iter = derived().begin(); iter != derived().end(); ++iter)
-        iter->m_visibleActive = false;
+    // Wait for the invoke actions, which have been left asynchronously.
+    try
+    {
+        m_invocationTracker.waitForAll();
+    }
+    catch (...)
+    {
+        derived().invokeStateExceptionCallbackOrThrow();
+    }
 
+    publishConfiguration(m_numConfigurationChanges + 1);
     ++m_numConfigurationChanges;
+    notifyWaiters();
     derived().invokeConfigurationChangeCallback();
 
     //! \todo Clear the event list? Or document that the event list is
     //! preserved when the FSM is stopped?
 }
 
+template <typename TDerived>
+void EventDispatcherBase<TDerived>::publishConfiguration(
+        unsigned numConfigurationChanges)
+{
+    const std::size_t bitsPerWord = sizeof(unsigned) * CHAR_BIT;
+
+    std::fill(m_activeStateSet.begin(), m_activeStateSet.end(), 0u);
+    std::size_t id = 0;
+    for (auto iter = derived().begin(); iter != derived().end(); ++iter, ++id)
+    {
+        if (id / bitsPerWord == m_activeStateSet.size())
+            m_activeStateSet.push_back(0);
+        if (iter->m_flags & state_type::Active)
+            m_activeStateSet[id / bitsPerWord] |= 1u << (id % bitsPerWord);
+    }
+
+    m_configurationPublisher.publish(m_activeStateSet.data(), id,
+                                     numConfigurationChanges);
+}
+
+template <typename TDerived>
+bool EventDispatcherBase<TDerived>::markTimeoutExpired(
+        transition_type* transition, unsigned generation) noexcept
+{
+    if (transition->timeout()->generation != generation)
+        return false;
+    transition->timeout()->expired = true;
+    return true;
+}
+
 // ----=====================================================================----
 //     SynchronousEventDispatcher
 // ----=====================================================================----
@@ -639,21 +833,38 @@ class SynchronousEventDispatcher : public EventDispatcherBase<TDerived>
 {
     using options = typename get_options<TDerived>::type;
 
+    static_assert(!options::event_combining_enable
+                  || options::multithreading_enable,
+                  "Event combining requires multithreading support.");
+
 public:
     using event_type = typename options::event_type;
 
     SynchronousEventDispatcher()
         : m_dispatching(false),
-          m_running(false)
+          m_running(false),
+          m_pendingEvents(nullptr),
+          m_dispatchRole(false)
     {
     }
 
-    void addEvent(event_type event)
+    SynchronousEventDispatcher(const SynchronousEventDispatcher&) = delete;
+    SynchronousEventDispatcher& operator=(const SynchronousEventDispatcher&) = delete;
+
+    ~SynchronousEventDispatcher()
     {
-        auto lock = derived().getLock();
+        PendingEvent* pending = m_pendingEvents.exchange(nullptr);
+        while (pending)
+        {
+            PendingEvent* next = pending->next;
+            delete pending;
+            pending = next;
+        }
+    }
 
-        derived().m_eventList.push_back(FSM11STD::move(event));
-        doDispatchEvents();
+    void addEvent(event_type event)
+    {
+        doAddEvent(FSM11STD::move(event), is_combining());
     }
 
     bool running() const
@@ -693,6 +904,50 @@ public:
         }
     }
 
+    using event_deadline = FSM11STD::chrono::steady_clock::time_point;
+
+    template <typename T = void>
+    void addEvent(event_type, event_deadline)
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "Deadlines need asynchronous event dispatching.");
+    }
+
+    template <typename T = void>
+    EventFuture addEventWithCompletion(event_type)
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "Completions need asynchronous event dispatching.");
+        return EventFuture();
+    }
+
+    template <typename T = void>
+    EventFuture addEventWithCompletion(event_type, event_deadline)
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "Completions need asynchronous event dispatching.");
+        return EventFuture();
+    }
+
+    //! \brief Waits until the state machine is idle.
+    //!
+    //! A synchronous state machine dispatches the events in the thread,
+    //! which adds them. The function blocks until no thread dispatches
+    //! an event or the \p timeout has expired. Returns \p true, if the
+    //! state machine is idle. If event combining is enabled, the events
+    //! of all threads have to be dispatched, too.
+    //!
+    //! The function does not lock the state machine. When it is called
+    //! from an action, it returns \p false after the \p timeout, because
+    //! the calling thread is dispatching an event itself.
+    template <typename TRep, typename TPeriod>
+    bool waitUntilIdle(const FSM11STD::chrono::duration<TRep, TPeriod>& timeout)
+    {
+        return this->waitFor(timeout, [this] {
+            return !m_dispatching.load() && combinerIdle(is_combining());
+        });
+    }
+
     template <typename T = void>
     void eventLoop()
     {
@@ -707,16 +962,54 @@ public:
                       "A synchronous statemachine has no event-loop.");
     }
 
+    template <typename T = void>
+    void shutdownEventLoop()
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "A synchronous statemachine has no event-loop.");
+    }
+
 protected:
     void halt()
     {
         stop();
     }
 
+    //! A synchronous state machine has no completion events, so there is
+    //! nothing to lock.
+    int lockCompletionEvents()
+    {
+        return 0;
+    }
+
 private:
-    bool m_dispatching;
+    using is_combining = FSM11STD::integral_constant<
+                             bool, options::event_combining_enable>;
+
+    //! An event, which has been added while another thread dispatched.
+    struct PendingEvent
+    {
+        explicit PendingEvent(event_type&& ev)
+            : event(FSM11STD::move(ev)),
+              next(nullptr)
+        {
+        }
+
+        event_type event;
+        PendingEvent* next;
+    };
+
+    //! Set while an event is dispatched. The flag is modified under the
+    //! lock but read by waitUntilIdle() without it.
+    FSM11STD::atomic_bool m_dispatching;
     bool m_running;
 
+    //! The events, which have been added by the producers but not yet moved
+    //! to the event list. The list is a lock-free stack in LIFO order.
+    FSM11STD::atomic<PendingEvent*> m_pendingEvents;
+    //! Set while a thread holds the dispatch role.
+    FSM11STD::atomic_bool m_dispatchRole;
+
     TDerived& derived()
     {
         return *static_cast<TDerived*>(this);
@@ -727,21 +1020,147 @@ private:
         return *static_cast<const TDerived*>(this);
     }
 
-    void doDispatchEvents()
+    void doAddEvent(event_type&& event, FSM11STD::false_type)
+    {
+        auto lock = derived().getLock();
+
+        derived().m_eventList.push_back(FSM11STD::move(event));
+        doDispatchEvents();
+    }
+
+    //! \brief Adds an event in combining mode.
+    //!
+    //! The \p event is pushed to the pending events. If another thread
+    //! holds the dispatch role, this thread returns immediately and the
+    //! other thread dispatches the event. Otherwise, this thread takes the
+    //! role and dispatches all pending events.
+    //!
+    //! If the dispatch throws, the state machine is stopped and the
+    //! exception is thrown by the role holder, which need not be the thread
+    //! that added the failing event. The events of the other producers are
+    //! kept in the event list like in a state machine without combining.
+    void doAddEvent(event_type&& event, FSM11STD::true_type)
+    {
+        PendingEvent* pending = new PendingEvent(FSM11STD::move(event));
+        pending->next = m_pendingEvents.load(FSM11STD::memory_order_relaxed);
+        while (!m_pendingEvents.compare_exchange_weak(pending->next, pending))
+        {
+        }
+
+        // A producer, which finds the role taken, leaves its event to the
+        // role holder. The holder checks for pending events after it has
+        // released the role. Both steps are sequentially consistent, so
+        // either the producer takes the role or the holder sees the event.
+        // This holds for a failed dispatch, too. The stopped state machine
+        // only moves the pending events to the event list.
+        FSM11STD::exception_ptr error;
+        while (!m_dispatchRole.exchange(true))
+        {
+            {
+                FSM11_SCOPE_EXIT { m_dispatchRole.store(false); };
+                auto lock = derived().getLock();
+                try
+                {
+                    doDispatchEvents();
+                }
+                catch (...)
+                {
+                    if (!error)
+                        error = FSM11STD::current_exception();
+                }
+            }
+
+            if (m_pendingEvents.load() == nullptr)
+            {
+                this->notifyWaiters();
+                break;
+            }
+        }
+
+        if (error)
+            FSM11STD::rethrow_exception(error);
+    }
+
+    bool combinerIdle(FSM11STD::false_type) const
+    {
+        return true;
+    }
+
+    //! Returns \p true, if no thread holds the dispatch role and there are
+    //! no pending events.
+    bool combinerIdle(FSM11STD::true_type) const
+    {
+        return !m_dispatchRole.load() && m_pendingEvents.load() == nullptr;
+    }
+
+    //! Moves the pending events to the event list. The caller must hold
+    //! the lock.
+    void takePendingEvents(FSM11STD::false_type)
+    {
+    }
+
+    void takePendingEvents(FSM11STD::true_type)
+    {
+        PendingEvent* pending = m_pendingEvents.exchange(nullptr);
+        if (!pending)
+            return;
+
+        // Reverse the stack such that the events are in FIFO order.
+        PendingEvent* fifo = nullptr;
+        while (pending)
+        {
+            PendingEvent* next = pending->next;
+            pending->next = fifo;
+            fifo = pending;
+            pending = next;
+        }
+
+        FSM11_SCOPE_EXIT {
+            while (fifo)
+            {
+                PendingEvent* next = fifo->next;
+                delete fifo;
+                fifo = next;
+            }
+        };
+        for (PendingEvent* iter = fifo; iter; iter = iter->next)
+            derived().m_eventList.push_back(FSM11STD::move(iter->event));
+    }
+
+    //! Dispatches the events in the event list. If \p timeoutExpired is
+    //! set, the eventless transitions are followed first.
+    void doDispatchEvents(bool timeoutExpired = false)
     {
+        takePendingEvents(is_combining());
+
         if (!m_running || m_dispatching)
             return;
 
         m_dispatching = true;
-        FSM11_SCOPE_EXIT { m_dispatching = false; };
+        FSM11_SCOPE_EXIT {
+            m_dispatching = false;
+            this->notifyWaiters();
+        };
         FSM11_SCOPE_FAILURE {
             this->clearEnabledTransitionsSet();
             this->leaveConfiguration();
             m_running = false;
         };
 
-        while (!derived().m_eventList.empty())
+        if (timeoutExpired)
+            this->runToCompletion(false);
+
+        for (;;)
         {
+            if (derived().m_eventList.empty())
+            {
+                // Events, which have been added during the dispatch, are
+                // handled before the dispatch role is released.
+                takePendingEvents(is_combining());
+                if (derived().m_eventList.empty())
+                    break;
+            }
+
             auto event = derived().m_eventList.front();
             derived().m_eventList.pop_front();
 
@@ -758,7 +1177,8 @@ private:
             }
             else
             {
-                derived().invokeEventDiscardedCallback(FSM11STD::move(event));
+                derived().invokeEventDiscardedCallback(
+                        FSM11STD::move(event), DiscardReason::NoTransition);
             }
 
             this->runToCompletion(changedConfiguration);
@@ -770,6 +1190,7 @@ template <typename TDerived>
 class AsynchronousEventDispatcher : public EventDispatcherBase<TDerived>
 {
     using options = typename get_options<TDerived>::type;
+    using transition_type = Transition<TDerived>;
 
 public:
     using event_type = typename options::event_type;
@@ -777,6 +1198,8 @@ public:
     AsynchronousEventDispatcher()
         : m_startRequest(false),
           m_stopRequest(false),
+          m_shutdownRequest(false),
+          m_timeoutExpired(false),
           m_eventLoopActive(false),
           m_running(false)
     {
@@ -785,14 +1208,148 @@ public:
     AsynchronousEventDispatcher(const AsynchronousEventDispatcher&) = delete;
     AsynchronousEventDispatcher& operator=(const AsynchronousEventDispatcher&) = delete;
 
+    ~AsynchronousEventDispatcher()
+    {
+        // The events, which are still in the event list, will never be
+        // dispatched.
+        while (EventCompletion* completion = m_completions)
+        {
+            m_completions = completion->m_next;
+            EventCompletionHandle(completion).complete(
+                        EventStatus::Dropped, this->numConfigurationChanges());
+        }
+        if (m_completionPool)
+            m_completionPool->release();
+    }
+
+    using event_deadline = FSM11STD::chrono::steady_clock::time_point;
+
     void addEvent(event_type event)
     {
+        bool post;
+        bool highWatermark;
+        {
+            FSM11STD::unique_lock<FSM11STD::mutex> lock(m_eventLoopMutex);
+            if (!makeRoom(lock, is_bounded()))
+                return;
+            post = pushEvent(FSM11STD::move(event), highWatermark);
+        }
+
+        eventAdded(post, highWatermark);
+    }
+
+    //! \brief Adds an event with a deadline.
+    //!
+    //! Adds the \p event, which expires at the given \p deadline. If the
+    //! event is taken from the event list after its deadline, it is not
+    //! dispatched. Instead, the event discarded callback is invoked with
+    //! DiscardReason::Expired. The event dispatch callback is not invoked
+    //! for an expired event. The event list has to be a FIFO queue.
+    void addEvent(event_type event, event_deadline deadline)
+    {
+        bool post;
+        bool highWatermark;
+        {
+            FSM11STD::unique_lock<FSM11STD::mutex> lock(m_eventLoopMutex);
+            if (!makeRoom(lock, is_bounded()))
+                return;
+            post = pushEvent(FSM11STD::move(event), highWatermark);
+            m_deadlines.push_back(EventDeadline{m_numEventsAdded - 1, deadline});
+        }
+
+        eventAdded(post, highWatermark);
+    }
+
+    //! \brief Tries to add an event.
+    //!
+    //! Adds the \p event to the event list, if the list is not full.
+    //! Returns \p true if the event has been added and \p false if the
+    //! list is full. The overflow policy is not applied.
+    bool tryAddEvent(event_type event)
+    {
+        bool post;
+        bool highWatermark;
         {
             FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
-            derived().m_eventList.push_back(FSM11STD::move(event));
+            if (eventListFull(is_bounded()))
+                return false;
+            post = pushEvent(FSM11STD::move(event), highWatermark);
         }
 
-        m_continueEventLoop.notify_one();
+        eventAdded(post, highWatermark);
+        return true;
+    }
+
+    //! \brief Tries to add an event.
+    //!
+    //! Adds the \p event to the event list. If the list is full, the
+    //! function waits up to the given \p timeout for an event to be taken
+    //! from the list. Returns \p true if the event has been added and
+    //! \p false if the list has been full until the timeout expired.
+    template <typename TRep, typename TPeriod>
+    bool tryAddEvent(event_type event,
+                     const FSM11STD::chrono::duration<TRep, TPeriod>& timeout)
+    {
+        bool post;
+        bool highWatermark;
+        {
+            FSM11STD::unique_lock<FSM11STD::mutex> lock(m_eventLoopMutex);
+            if (!m_eventListNotFull.wait_for(
+                    lock, timeout,
+                    [this] { return !eventListFull(is_bounded()); }))
+            {
+                return false;
+            }
+            post = pushEvent(FSM11STD::move(event), highWatermark);
+        }
+
+        eventAdded(post, highWatermark);
+        return true;
+    }
+
+    //! \brief Adds an event with a completion.
+    //!
+    //! Adds the \p event like addEvent() and returns a future, which becomes
+    //! ready after the macrostep of the event has been completed. The
+    //! future reports whether the event has been taken or discarded and
+    //! the number of configuration changes after the macrostep. If the
+    //! event is dropped due to an overflow of the event list or the state
+    //! machine is destroyed before the event is dispatched, the status is
+    //! EventStatus::Dropped. The completions are pooled, such that no
+    //! memory is allocated once the pool has grown to the number of
+    //! outstanding futures. The event list has to be a FIFO queue.
+    EventFuture addEventWithCompletion(event_type event)
+    {
+        return doAddEventWithCompletion(FSM11STD::move(event), nullptr);
+    }
+
+    //! Adds an event with a completion, which expires at the given
+    //! \p deadline. An expired event completes its future with the status
+    //! EventStatus::Expired.
+    EventFuture addEventWithCompletion(event_type event,
+                                       event_deadline deadline)
+    {
+        return doAddEventWithCompletion(FSM11STD::move(event), &deadline);
+    }
+
+    //! \brief Waits until the state machine is idle.
+    //!
+    //! Blocks until the state machine has handled all start and stop
+    //! requests and has dispatched all events or the \p timeout has
+    //! expired. Returns \p true, if the state machine is idle. The events,
+    //! which are added to a stopped state machine, are not dispatched
+    //! until it is started. Thus, they do not keep it busy. If a drain
+    //! task has failed, its exception is rethrown.
+    template <typename TRep, typename TPeriod>
+    bool waitUntilIdle(
+            const FSM11STD::chrono::duration<TRep, TPeriod>& timeout) const
+    {
+        bool isIdle = this->waitFor(timeout, [this] {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            return idle();
+        });
+        rethrowDrainException();
+        return isIdle;
     }
 
     bool running() const
@@ -803,18 +1360,26 @@ public:
 
     void start()
     {
+        rethrowDrainException();
         m_eventLoopMutex.lock();
         m_startRequest = true;
+        bool post = scheduleDrain();
         m_eventLoopMutex.unlock();
         m_continueEventLoop.notify_one();
+        if (post)
+            postDrain();
     }
 
     void stop()
     {
+        rethrowDrainException();
         m_eventLoopMutex.lock();
         m_stopRequest = true;
+        bool post = scheduleDrain();
         m_eventLoopMutex.unlock();
         m_continueEventLoop.notify_one();
+        if (post)
+            postDrain();
     }
 
     void eventLoop()
@@ -845,134 +1410,1009 @@ public:
         return FSM11STD::async(std::launch::async,
                                &AsynchronousEventDispatcher::doEventLoop, this);
     }
+
+    //! \brief Starts the event loop in a new thread.
+    //!
+    //! Starts the event loop in a thread, which is created with the
+    //! attributes \p attrs. In contrast to the overload without attributes,
+    //! the returned future does not wait for the event loop when it is
+    //! destroyed. The event loop must not be running already, because the
+    //! detached thread could not be joined.
+    FSM11STD::future<void> startAsyncEventLoop(const ThreadAttributes& attrs)
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> eventLoopLock(m_eventLoopMutex);
+        FSM11_ASSERT(!m_eventLoopActive);
+        FSM11STD::packaged_task<void()> task(
+                    [this] { doEventLoop(); });
+        FSM11STD::future<void> result = task.get_future();
+        makeThread(attrs, FSM11STD::move(task)).detach();
+        m_eventLoopActive = true;
+        return result;
+    }
 #endif
 
-protected:
-    void halt()
+    //! \brief Shuts the event loop down.
+    //!
+    //! Stops the state machine and requests the event loop to return. This
+    //! is needed to end an event loop, which is kept alive across stop
+    //! requests (see PersistentEventLoopEnable). The function does not
+    //! wait for the event loop. It has no effect on an event loop, which
+    //! has not been started, yet.
+    void shutdownEventLoop()
     {
-        stop();
-        FSM11STD::unique_lock<FSM11STD::mutex> eventLoopLock(m_eventLoopMutex);
-        m_continueEventLoop.wait(eventLoopLock,
-                                 [this]{ return !m_eventLoopActive; });
+        m_eventLoopMutex.lock();
+        m_stopRequest = true;
+        if (m_eventLoopActive)
+            m_shutdownRequest = true;
+        bool post = scheduleDrain();
+        m_eventLoopMutex.unlock();
+        m_continueEventLoop.notify_all();
+        if (post)
+            postDrain();
     }
 
-private:
-    //! A mutex to prevent concurrent modifications of the request flags.
-    mutable FSM11STD::mutex m_eventLoopMutex;
-    //! This CV signals that a new control event is available.
-    FSM11STD::condition_variable m_continueEventLoop;
-    //! Set if starting the state machine has been requested.
-    bool m_startRequest;
-    //! Set if stopping the state machine has been requested.
-    bool m_stopRequest;
-    //! Set if the event loop is running.
-    bool m_eventLoopActive;
+    //! \brief Dispatches the pending events.
+    //!
+    //! Handles the pending start and stop requests and dispatches up to
+    //! \p maxEvents events in the calling thread. The function does not
+    //! block when no event is pending. It returns the number of events,
+    //! which have been dispatched. An expired timeout counts as an event.
+    //! This function must not be combined with an event loop or an
+    //! executor.
+    std::size_t dispatchPending(std::size_t maxEvents = std::size_t(-1))
+    {
+        std::size_t numEvents = 0;
+        bool isEvent;
+        while (numEvents < maxEvents && dispatchNext(isEvent))
+            numEvents += isEvent;
+        return numEvents;
+    }
 
-    //! Set if the state machine is running. Guarded by the multithreading
-    //! lock but not by m_eventLoopMutex.
-    bool m_running;
+    using executor_type = typename options::executor_type;
 
-    TDerived& derived()
+    //! \brief Runs the state machine on an executor.
+    //!
+    //! Dispatches the events of this state machine in tasks, which are
+    //! posted to the \p executor, instead of an event loop. When an event
+    //! arrives at an idle state machine, exactly one drain task is posted.
+    //! The executor must outlive the state machine. This function has to
+    //! be called before the state machine is started and must not be
+    //! combined with eventLoop() or startAsyncEventLoop(). If a drain task
+    //! fails, the state machine is stopped and the exception is rethrown
+    //! by the next call to start(), stop() or waitUntilIdle().
+    void setExecutor(executor_type& executor)
     {
-        return *static_cast<TDerived*>(this);
+        FSM11STD::lock_guard<FSM11STD::mutex> eventLoopLock(m_eventLoopMutex);
+        m_executor = &executor;
     }
 
-    const TDerived& derived() const
+    //! \brief Returns the maximum number of events per batch.
+    //!
+    //! Returns the maximum number of events, which are dispatched by a
+    //! single task in an executor before the task yields to the tasks of
+    //! other state machines.
+    std::size_t maxEventsPerBatch() const noexcept
     {
-        return *static_cast<const TDerived*>(this);
+        return m_maxEventsPerBatch;
     }
 
-    void doEventLoop()
+    //! Sets the maximum number of events per batch to \p numEvents.
+    void setMaxEventsPerBatch(std::size_t numEvents) noexcept
     {
-        FSM11_SCOPE_EXIT {
-            m_eventLoopMutex.lock();
-            m_eventLoopActive = false;
-            m_eventLoopMutex.unlock();
-            m_continueEventLoop.notify_all();
+        m_maxEventsPerBatch = numEvents > 0 ? numEvents : 1;
+    }
+
+    using event_list_duration = FSM11STD::chrono::steady_clock::duration;
+
+    //! \brief Sets the timeout for adding events.
+    //!
+    //! Sets the maximum time for which addEvent() blocks on a full event
+    //! list to \p timeout. By default, addEvent() waits forever. This is
+    //! only available for a bounded event list with the Block policy.
+    template <typename TRep, typename TPeriod>
+    void setEventListTimeout(
+            const FSM11STD::chrono::duration<TRep, TPeriod>& timeout)
+    {
+        static_assert(options::event_list_capacity > 0
+                      && options::event_list_overflow_policy == Block,
+                      "The event list timeout needs a blocking event list.");
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+        m_eventListTimeout
+            = FSM11STD::chrono::duration_cast<event_list_duration>(timeout);
+        m_hasEventListTimeout = true;
+    }
+
+    //! \brief Sets the watermarks of the event list.
+    //!
+    //! The high watermark callback is invoked when the number of events in
+    //! the list reaches \p high. Afterwards, the low watermark callback is
+    //! invoked as soon as the number of events has dropped to \p low. Both
+    //! callbacks are invoked without holding a lock by the thread, which
+    //! has added or taken the event. This is only available for a bounded
+    //! event list.
+    template <typename T = void>
+    void setEventListWatermarks(std::size_t high, std::size_t low)
+    {
+        static_assert(options::event_list_capacity > 0
+                      || !FSM11STD::is_same<T, T>::value,
+                      "Watermarks need a bounded event list.");
+        FSM11_ASSERT(low < high);
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+        m_highWatermark = high;
+        m_lowWatermark = low;
+    }
+
+    //! Sets the high watermark \p callback. The callback must not be
+    //! changed while events are added.
+    template <typename TType>
+    void setHighWatermarkCallback(TType&& callback)
+    {
+        m_highWatermarkCallback = FSM11STD::forward<TType>(callback);
+    }
+
+    //! Sets the low watermark \p callback. The callback must not be
+    //! changed while events are added.
+    template <typename TType>
+    void setLowWatermarkCallback(TType&& callback)
+    {
+        m_lowWatermarkCallback = FSM11STD::forward<TType>(callback);
+    }
+
+    //! Returns the number of events, which have been dropped because the
+    //! event list has been full.
+    std::size_t numDroppedEvents() const
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+        return m_numDroppedEvents;
+    }
+
+    //! Returns the number of events, which have been discarded because
+    //! their deadline has passed.
+    std::size_t numExpiredEvents() const
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+        return m_numExpiredEvents;
+    }
+
+protected:
+    void halt()
+    {
+        {
+            // A state machine on an executor, which is stopped and has no
+            // drain task, does not have to post another one. The running
+            // flag is only modified by a drain task.
+            FSM11STD::lock_guard<FSM11STD::mutex> eventLoopLock(m_eventLoopMutex);
+            if (m_executor && !m_eventLoopActive && !m_drainScheduled
+                && !m_running)
+            {
+                return;
+            }
+        }
+
+        shutdownEventLoop();
+        FSM11STD::unique_lock<FSM11STD::mutex> eventLoopLock(m_eventLoopMutex);
+        m_continueEventLoop.wait(eventLoopLock,
+                                 [this]{ return !m_eventLoopActive
+                                                && !m_drainScheduled; });
+    }
+
+    //! \brief Dispatches an expired timeout.
+    //!
+    //! Called by the timer of a timed \p transition. If the timer is still
+    //! armed, the event loop is woken up to follow the eventless
+    //! transitions.
+    void dispatchTimeout(transition_type* transition, unsigned generation)
+    {
+        {
+            auto lock = derived().getLock();
+            if (!this->markTimeoutExpired(transition, generation))
+                return;
+        }
+
+        bool post;
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            m_timeoutExpired = true;
+            post = scheduleDrain();
+        }
+        m_continueEventLoop.notify_one();
+        if (post)
+            postDrain();
+    }
+
+    //! \brief Adds the event of a timer.
+    //!
+    //! Appends the \p event like addEvent() but never blocks, because the
+    //! thread of the timer service is shared by many state machines. The
+    //! overflow policy is bypassed. If a bounded event list is full, the
+    //! event is dropped and counted in numDroppedEvents().
+    void addTimerEvent(event_type event)
+    {
+        bool post;
+        bool highWatermark;
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            if (eventListFull(is_bounded()))
+            {
+                ++m_numDroppedEvents;
+                return;
+            }
+            post = pushEvent(FSM11STD::move(event), highWatermark);
+        }
+
+        eventAdded(post, highWatermark);
+    }
+
+    //! \brief Locks the completion events.
+    //!
+    //! Returns a lock on the event loop mutex. A threaded state requests
+    //! the exit of its invoke action under this lock, which serializes the
+    //! request with addCompletionEvent().
+    FSM11STD::unique_lock<FSM11STD::mutex> lockCompletionEvents()
+    {
+        return FSM11STD::unique_lock<FSM11STD::mutex>(m_eventLoopMutex);
+    }
+
+    //! \brief Adds the completion event of an invoke action.
+    //!
+    //! Appends the \p event to the event list, unless the \p exitRequest
+    //! has been made. The check and the append happen under the event loop
+    //! mutex, so a completion event is never added after the state has
+    //! been left. The overflow policy is bypassed and the function never
+    //! blocks, because the dispatcher might wait for the invoke action.
+    //! A completion event is never dropped, because a state, which waits
+    //! for it, would wait forever. If a bounded event list is full, the
+    //! event is kept aside and moved to the list as soon as there is room.
+    //! There is at most one such event per threaded state.
+    void addCompletionEvent(const event_type& event,
+                            const ExitRequest& exitRequest)
+    {
+        bool post;
+        bool highWatermark;
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            if (exitRequest)
+                return;
+            if (eventListFull(is_bounded()))
+            {
+                // The list is non-empty, so the dispatcher is going to
+                // take an event and make room.
+                m_overflowingCompletionEvents.push_back(event);
+                return;
+            }
+            event_type copy(event);
+            post = pushEvent(FSM11STD::move(copy), highWatermark);
+        }
+
+        eventAdded(post, highWatermark);
+    }
+
+private:
+    //! A mutex to prevent concurrent modifications of the request flags.
+    mutable FSM11STD::mutex m_eventLoopMutex;
+    //! This CV signals that a new control event is available.
+    FSM11STD::condition_variable m_continueEventLoop;
+    //! Set if starting the state machine has been requested.
+    bool m_startRequest;
+    //! Set if stopping the state machine has been requested.
+    bool m_stopRequest;
+    //! Set if the event loop has been requested to return.
+    bool m_shutdownRequest;
+    //! Set if the timeout of a timed transition has expired.
+    bool m_timeoutExpired;
+    //! Set if the event loop is running.
+    bool m_eventLoopActive;
+
+    //! The executor, which dispatches the events, or a null-pointer.
+    executor_type* m_executor{nullptr};
+    //! Set if a drain task has been posted to the executor and has not
+    //! finished, yet.
+    bool m_drainScheduled{false};
+    //! The exception of a failed drain task, which has not been reported,
+    //! yet.
+    mutable FSM11STD::exception_ptr m_drainException;
+    FSM11STD::atomic<std::size_t> m_maxEventsPerBatch{16};
+
+    //! Signals that an event has been taken from a bounded event list.
+    FSM11STD::condition_variable m_eventListNotFull;
+    event_list_duration m_eventListTimeout{};
+    bool m_hasEventListTimeout{false};
+    std::size_t m_highWatermark{std::size_t(-1)};
+    std::size_t m_lowWatermark{0};
+    //! Set if the high watermark has been reached and the low watermark
+    //! has not been reached since.
+    bool m_aboveHighWatermark{false};
+    std::size_t m_numDroppedEvents{0};
+    std::size_t m_numExpiredEvents{0};
+    FSM11STD::function<void()> m_highWatermarkCallback;
+    FSM11STD::function<void()> m_lowWatermarkCallback;
+
+    //! The number of events, which have been added to and taken from the
+    //! event list. They are used to match events with their completions.
+    std::size_t m_numEventsAdded{0};
+    std::size_t m_numEventsTaken{0};
+    //! The completion events, which did not fit into the bounded event
+    //! list. The list is full as long as this buffer is non-empty.
+    RingBuffer<event_type> m_overflowingCompletionEvents;
+    //! The pending completions ordered by their sequence number.
+    EventCompletion* m_completions{nullptr};
+    EventCompletion* m_lastCompletion{nullptr};
+    //! The pool of completions. It is created on first use.
+    EventCompletionPool* m_completionPool{nullptr};
+
+    struct EventDeadline
+    {
+        std::size_t sequence;
+        event_deadline deadline;
+    };
+
+    //! The deadlines of the events in the event list ordered by their
+    //! sequence number.
+    RingBuffer<EventDeadline> m_deadlines;
+
+    //! Set if the state machine is running. Guarded by the multithreading
+    //! lock but not by m_eventLoopMutex.
+    bool m_running;
+
+    //! Set if a start request has been handled and the state machine has
+    //! not been stopped since. In contrast to m_running, this flag is
+    //! guarded by m_eventLoopMutex.
+    bool m_started{false};
+    //! Set while a request or an event is handled. It is set while holding
+    //! m_eventLoopMutex and cleared by dispatchFinished().
+    FSM11STD::atomic_bool m_dispatching{false};
+
+    TDerived& derived()
+    {
+        return *static_cast<TDerived*>(this);
+    }
+
+    const TDerived& derived() const
+    {
+        return *static_cast<const TDerived*>(this);
+    }
+
+    //! Enters the initial configuration.
+    void enterInitialConfiguration()
+    {
+        auto lock = derived().getLock();
+        FSM11_SCOPE_FAILURE {
+            m_running = false;
+            this->clearEnabledTransitionsSet();
+            this->leaveConfiguration();
         };
 
-        do
+        // The running flag is set before the configuration change callback
+        // is invoked, such that the callback observes a running machine.
+        m_running = true;
+        derived().invokeCaptureStorageCallback();
+        this->resetHistoryStates();
+        this->enterInitialStates();
+        this->runToCompletion(true);
+    }
+
+    //! Leaves the current configuration after a stop request.
+    void leaveCurrentConfiguration()
+    {
+        auto lock = derived().getLock();
+        m_running = false;
+        FSM11_SCOPE_FAILURE { this->leaveConfiguration(); };
+        derived().invokeCaptureStorageCallback();
+        this->leaveConfiguration();
+    }
+
+    //! \brief Takes the next event.
+    //!
+    //! Moves the next event from the event list to \p event and clears the
+    //! expired timeout flag. Returns \p false if only a timeout has
+    //! expired. The flag \p lowWatermark is set, if the low watermark
+    //! callback has to be invoked. If the event has been added with a
+    //! completion, \p completion is set to it. The flag \p expired is set,
+    //! if the deadline of the event has passed. The caller must hold the
+    //! event loop mutex.
+    bool takeEvent(event_type& event, bool& lowWatermark,
+                   EventCompletion*& completion, bool& expired)
+    {
+        lowWatermark = false;
+        completion = nullptr;
+        expired = false;
+        if (derived().m_eventList.empty())
+        {
+            m_timeoutExpired = false;
+            return false;
+        }
+
+        event = derived().m_eventList.front();
+        derived().m_eventList.pop_front(); // TODO: What if this throws?
+        completion = eventRemoved(&expired);
+        moveOverflowingCompletionEvent();
+        eventTaken(lowWatermark, is_bounded());
+
+        // An expired timeout is handled together with the next event,
+        // because the eventless transitions are followed after every event.
+        // An expired event is not dispatched, so the timeout is kept.
+        if (expired)
+            ++m_numExpiredEvents;
+        else
+            m_timeoutExpired = false;
+        return true;
+    }
+
+    //! Adds the \p event with a completion and an optional \p deadline.
+    EventFuture doAddEventWithCompletion(event_type&& event,
+                                         const event_deadline* deadline)
+    {
+        EventFuture future;
+        bool post;
+        bool highWatermark;
+        {
+            FSM11STD::unique_lock<FSM11STD::mutex> lock(m_eventLoopMutex);
+            EventCompletion* completion = acquireCompletion();
+            future = EventFuture(completion);
+            if (!makeRoom(lock, is_bounded()))
+            {
+                completion->complete(EventStatus::Dropped,
+                                     this->numConfigurationChanges());
+                return future;
+            }
+            post = pushEvent(FSM11STD::move(event), highWatermark);
+            if (deadline)
+            {
+                m_deadlines.push_back(
+                            EventDeadline{m_numEventsAdded - 1, *deadline});
+            }
+
+            // Append the completion to the list of pending completions. It
+            // is matched with the event by the sequence number.
+            completion->addRef();
+            completion->m_sequence = m_numEventsAdded - 1;
+            if (m_lastCompletion)
+                m_lastCompletion->m_next = completion;
+            else
+                m_completions = completion;
+            m_lastCompletion = completion;
+        }
+
+        eventAdded(post, highWatermark);
+        return future;
+    }
+
+    //! Creates the completion pool on first use and acquires a completion
+    //! from it. The caller must hold the event loop mutex.
+    EventCompletion* acquireCompletion()
+    {
+        if (!m_completionPool)
+            m_completionPool = new EventCompletionPool;
+        return m_completionPool->acquire();
+    }
+
+    //! \brief Removes the bookkeeping of the next event.
+    //!
+    //! Must be called whenever an event is removed from the event list.
+    //! Returns the completion of the removed event or a null-pointer, if
+    //! the event has been added without a completion. If \p expired is
+    //! not a null-pointer, it is set when the deadline of the event has
+    //! passed. The caller must hold the event loop mutex.
+    EventCompletion* eventRemoved(bool* expired)
+    {
+        if (!m_deadlines.empty()
+            && m_deadlines.front().sequence == m_numEventsTaken)
+        {
+            if (expired)
+            {
+                *expired = FSM11STD::chrono::steady_clock::now()
+                           > m_deadlines.front().deadline;
+            }
+            m_deadlines.pop_front();
+        }
+
+        EventCompletion* completion = m_completions;
+        if (completion && completion->m_sequence == m_numEventsTaken)
+        {
+            m_completions = completion->m_next;
+            if (!m_completions)
+                m_lastCompletion = nullptr;
+            completion->m_next = nullptr;
+        }
+        else
+        {
+            completion = nullptr;
+        }
+        ++m_numEventsTaken;
+        return completion;
+    }
+
+    using is_bounded = FSM11STD::integral_constant<
+                           bool, (options::event_list_capacity > 0)>;
+
+    bool eventListFull(FSM11STD::false_type) const noexcept
+    {
+        return false;
+    }
+
+    bool eventListFull(FSM11STD::true_type) const noexcept
+    {
+        return derived().m_eventList.full();
+    }
+
+    //! \brief Makes room for a new event.
+    //!
+    //! Applies the overflow policy, if the event list is full. Returns
+    //! \p false, if the new event has to be dropped.
+    bool makeRoom(FSM11STD::unique_lock<FSM11STD::mutex>&, FSM11STD::false_type)
+    {
+        return true;
+    }
+
+    bool makeRoom(FSM11STD::unique_lock<FSM11STD::mutex>& lock,
+                  FSM11STD::true_type)
+    {
+        if (!derived().m_eventList.full())
+            return true;
+
+        switch (options::event_list_overflow_policy)
+        {
+        case Block:
+            if (!m_hasEventListTimeout)
+            {
+                m_eventListNotFull.wait(
+                        lock, [this] { return !derived().m_eventList.full(); });
+            }
+            else if (!m_eventListNotFull.wait_for(
+                         lock, m_eventListTimeout,
+                         [this] { return !derived().m_eventList.full(); }))
+            {
+                throw FSM11_EXCEPTION(Error(ErrorCode::EventListOverflow));
+            }
+            return true;
+
+        case Reject:
+            throw FSM11_EXCEPTION(Error(ErrorCode::EventListOverflow));
+
+        case DropOldest:
+            // The completion events, which wait for room, are newer than
+            // the events in the list, so they are moved in first.
+            do
+            {
+                derived().m_eventList.pop_front();
+                ++m_numDroppedEvents;
+                if (EventCompletion* completion = eventRemoved(nullptr))
+                {
+                    EventCompletionHandle(completion).complete(
+                                EventStatus::Dropped,
+                                this->numConfigurationChanges());
+                }
+                moveOverflowingCompletionEvent();
+            } while (derived().m_eventList.full());
+            return true;
+
+        case DropNewest:
+        default:
+            ++m_numDroppedEvents;
+            return false;
+        }
+    }
+
+    //! \brief Moves a completion event to the event list.
+    //!
+    //! Moves the oldest completion event, which did not fit into the event
+    //! list, to the back of the list. Must be called whenever an event has
+    //! been removed from the list. The list is full afterwards again, so
+    //! the watermarks are not affected. The caller must hold the event loop
+    //! mutex.
+    void moveOverflowingCompletionEvent()
+    {
+        if (m_overflowingCompletionEvents.empty())
+            return;
+        derived().m_eventList.push_back(
+                    FSM11STD::move(m_overflowingCompletionEvents.front()));
+        m_overflowingCompletionEvents.pop_front();
+        ++m_numEventsAdded;
+    }
+
+    //! \brief Appends an event.
+    //!
+    //! Appends the \p event to the event list. Returns \p true, if a drain
+    //! task has to be posted. The flag \p highWatermark is set, if the high
+    //! watermark callback has to be invoked. The caller must hold the event
+    //! loop mutex.
+    bool pushEvent(event_type&& event, bool& highWatermark)
+    {
+        derived().m_eventList.push_back(FSM11STD::move(event));
+        ++m_numEventsAdded;
+        highWatermark = eventPushed(is_bounded());
+        return scheduleDrain();
+    }
+
+    bool eventPushed(FSM11STD::false_type) noexcept
+    {
+        return false;
+    }
+
+    bool eventPushed(FSM11STD::true_type) noexcept
+    {
+        if (m_aboveHighWatermark
+            || derived().m_eventList.size() < m_highWatermark)
+        {
+            return false;
+        }
+        m_aboveHighWatermark = true;
+        return true;
+    }
+
+    void eventTaken(bool&, FSM11STD::false_type) noexcept
+    {
+    }
+
+    void eventTaken(bool& lowWatermark, FSM11STD::true_type)
+    {
+        m_eventListNotFull.notify_one();
+        if (m_aboveHighWatermark
+            && derived().m_eventList.size() <= m_lowWatermark)
+        {
+            m_aboveHighWatermark = false;
+            lowWatermark = true;
+        }
+    }
+
+    //! Wakes up the event loop after an event has been added. Must be
+    //! called without holding the event loop mutex.
+    void eventAdded(bool post, bool highWatermark)
+    {
+        m_continueEventLoop.notify_one();
+        if (post)
+            postDrain();
+        if (highWatermark && m_highWatermarkCallback)
+            m_highWatermarkCallback();
+    }
+
+    //! Returns \p true, if there is neither a pending request nor a
+    //! pending event. The caller must hold the event loop mutex.
+    bool idle() const
+    {
+        if (m_dispatching || m_stopRequest)
+            return false;
+        if (!m_started)
+            return !m_startRequest;
+        return derived().m_eventList.empty() && !m_timeoutExpired;
+    }
+
+    //! Marks the end of a dispatch and wakes up the threads, which wait
+    //! for the state machine to become idle. Must be called without
+    //! holding the event loop mutex.
+    void dispatchFinished()
+    {
+        m_dispatching = false;
+        this->notifyWaiters();
+    }
+
+    //! Invokes the low watermark callback, if \p lowWatermark is set.
+    //! Must be called without holding the event loop mutex.
+    void invokeLowWatermarkCallback(bool lowWatermark)
+    {
+        if (lowWatermark && m_lowWatermarkCallback)
+            m_lowWatermarkCallback();
+    }
+
+    //! Dispatches the \p event. If \p hasEvent is not set, only the
+    //! eventless transitions are followed. If \p expired is set, the event
+    //! is discarded without selecting transitions. Returns the status of
+    //! the event.
+    EventStatus dispatchEvent(bool hasEvent, bool expired, event_type event)
+    {
+        auto lock = derived().getLock();
+        FSM11_SCOPE_FAILURE {
+            m_running = false;
+            this->clearEnabledTransitionsSet();
+            this->leaveConfiguration();
+        };
+
+        if (!hasEvent)
+        {
+            this->runToCompletion(false);
+            return EventStatus::Discarded;
+        }
+
+        if (expired)
+        {
+            derived().invokeEventDiscardedCallback(FSM11STD::move(event),
+                                                   DiscardReason::Expired);
+            return EventStatus::Expired;
+        }
+
+        derived().invokeEventDispatchCallback(event);
+        derived().invokeCaptureStorageCallback();
+
+        this->clearTransientStateFlags();
+        this->selectTransitions(false, event);
+        bool taken = this->m_enabledTransitions != nullptr;
+        bool changedConfiguration = false;
+        if (taken)
+        {
+            changedConfiguration = this->microstep(FSM11STD::move(event));
+            this->clearEnabledTransitionsSet();
+        }
+        else
+        {
+            derived().invokeEventDiscardedCallback(
+                        FSM11STD::move(event), DiscardReason::NoTransition);
+        }
+
+        this->runToCompletion(changedConfiguration);
+        return taken ? EventStatus::Taken : EventStatus::Discarded;
+    }
+
+    //! Dispatches the \p event and completes the completion referenced by
+    //! the \p handle. The completion reports an error, if the dispatch
+    //! throws.
+    void dispatchEvent(bool hasEvent, bool expired, event_type event,
+                       EventCompletionHandle& handle)
+    {
+        FSM11_SCOPE_FAILURE {
+            handle.setNumConfigurationChanges(this->numConfigurationChanges());
+        };
+        EventStatus status = dispatchEvent(hasEvent, expired,
+                                           FSM11STD::move(event));
+        handle.complete(status, this->numConfigurationChanges());
+    }
+
+    void doEventLoop()
+    {
+        FSM11_SCOPE_EXIT {
+            {
+                FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+                m_stopRequest = false;
+                m_shutdownRequest = false;
+                m_started = false;
+            }
+            dispatchFinished();
+
+            // Notify while holding the lock, because halt() destroys the
+            // state machine as soon as it sees the flag cleared.
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            m_eventLoopActive = false;
+            m_continueEventLoop.notify_all();
+        };
+
+        while (true)
         {
             // Wait until a start or stop request has been sent.
             FSM11STD::unique_lock<FSM11STD::mutex> eventLoopLock(m_eventLoopMutex);
             m_continueEventLoop.wait(eventLoopLock,
-                                     [this]{ return m_startRequest || m_stopRequest; });
+                                     [this]{ return m_startRequest
+                                                    || m_stopRequest
+                                                    || m_shutdownRequest; });
             m_startRequest = false;
+            if (m_shutdownRequest)
+                return;
             if (m_stopRequest)
             {
                 m_stopRequest = false;
-                return;
+                if (!options::persistent_event_loop_enable)
+                    return;
+                eventLoopLock.unlock();
+                this->notifyWaiters();
+                continue;
             }
+            m_started = true;
+            m_dispatching.store(true, FSM11STD::memory_order_relaxed);
             eventLoopLock.unlock();
 
-            {
-                auto lock = derived().getLock();
-                FSM11_SCOPE_FAILURE {
-                    this->clearEnabledTransitionsSet();
-                    this->leaveConfiguration();
-                };
-
-                derived().invokeCaptureStorageCallback();
-                this->resetHistoryStates();
-                this->enterInitialStates();
-                this->runToCompletion(true);
-                m_running = true;
-            }
+            enterInitialConfiguration();
+            dispatchFinished();
 
             while (true)
             {
-                typename options::event_type event;
+                typename options::event_type event = event_type();
 
                 // Wait until either an event is added to the list or
                 // an FSM stop has been requested.
                 eventLoopLock.lock();
                 m_continueEventLoop.wait(
                             eventLoopLock,
-                            [this]{ return !derived().m_eventList.empty() || m_stopRequest; });
+                            [this]{ return !derived().m_eventList.empty()
+                                           || m_stopRequest
+                                           || m_shutdownRequest
+                                           || m_timeoutExpired; });
                 m_startRequest = false;
-                if (m_stopRequest)
+                m_dispatching.store(true, FSM11STD::memory_order_relaxed);
+                if (m_stopRequest || m_shutdownRequest)
                 {
                     m_stopRequest = false;
-                    auto lock = derived().getLock();
-                    m_running = false;
-                    FSM11_SCOPE_FAILURE { this->leaveConfiguration(); };
-                    derived().invokeCaptureStorageCallback();
-                    this->leaveConfiguration();
+                    m_started = false;
+                    eventLoopLock.unlock();
+                    leaveCurrentConfiguration();
+                    dispatchFinished();
                     break;
                 }
 
                 // Get the next event from the event list.
-                event = derived().m_eventList.front();
-                derived().m_eventList.pop_front(); // TODO: What if this throws?
+                bool lowWatermark;
+                EventCompletion* completion;
+                bool expired;
+                bool hasEvent = takeEvent(event, lowWatermark, completion,
+                                          expired);
                 eventLoopLock.unlock();
 
-                auto lock = derived().getLock();
-                FSM11_SCOPE_FAILURE {
-                    m_running = false;
-                    this->clearEnabledTransitionsSet();
-                    this->leaveConfiguration();
-                };
-
-                derived().invokeEventDispatchCallback(event);
-                derived().invokeCaptureStorageCallback();
-
-                this->clearTransientStateFlags();
-                this->selectTransitions(false, event);
-                bool changedConfiguration = false;
-                if (this->m_enabledTransitions)
-                {
-                    changedConfiguration
-                            = this->microstep(FSM11STD::move(event));
-                    this->clearEnabledTransitionsSet();
-                }
-                else
-                {
-                    derived().invokeEventDiscardedCallback(FSM11STD::move(event));
-                }
+                EventCompletionHandle handle(completion);
+                invokeLowWatermarkCallback(lowWatermark);
+                dispatchEvent(hasEvent, expired, FSM11STD::move(event), handle);
+                dispatchFinished();
+            }
+
+            // A persistent event loop parks until the next start request.
+            if (!options::persistent_event_loop_enable)
+                return;
+        }
+    }
+
+    //! \brief Schedules a drain task.
+    //!
+    //! Returns \p true, if a drain task has to be posted to the executor.
+    //! At most one drain task is scheduled at any time. The caller must
+    //! hold the event loop mutex.
+    bool scheduleDrain() noexcept
+    {
+        if (!m_executor || m_drainScheduled)
+            return false;
+        m_drainScheduled = true;
+        return true;
+    }
+
+    //! \brief The task, which drains the state machine in an executor.
+    //!
+    //! An executor, which drops the task without running it, may call
+    //! cancel(). This clears the scheduled flag, so that halt() does not
+    //! wait for a drain, which never happens.
+    struct DrainTask
+    {
+        AsynchronousEventDispatcher* dispatcher;
+
+        void operator()() const
+        {
+            dispatcher->drain();
+        }
+
+        void cancel() const noexcept
+        {
+            dispatcher->drainCancelled();
+        }
+    };
+
+    //! Rethrows the exception of a failed drain task. The exception is
+    //! reported only once.
+    void rethrowDrainException() const
+    {
+        FSM11STD::exception_ptr exception;
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            exception.swap(m_drainException);
+        }
+        if (exception)
+            FSM11STD::rethrow_exception(exception);
+    }
+
+    //! Posts a drain task to the executor.
+    void postDrain()
+    {
+        m_executor->post(DrainTask{this});
+    }
+
+    //! Called when the executor has dropped a drain task.
+    void drainCancelled() noexcept
+    {
+        // Notify while holding the lock, because halt() destroys the state
+        // machine as soon as it sees the flag cleared.
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+        m_drainScheduled = false;
+        m_continueEventLoop.notify_all();
+    }
+
+    //! \brief Handles the next request.
+    //!
+    //! Handles the next start or stop request or dispatches the next event.
+    //! Returns \p false if there is nothing to do. Otherwise, \p isEvent is
+    //! set if an event or a timeout has been dispatched.
+    bool dispatchNext(bool& isEvent)
+    {
+        FSM11_SCOPE_EXIT { dispatchFinished(); };
+        FSM11_SCOPE_FAILURE {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            m_started = false;
+        };
+
+        FSM11STD::unique_lock<FSM11STD::mutex> eventLoopLock(m_eventLoopMutex);
+        isEvent = false;
+        if (m_stopRequest)
+        {
+            m_stopRequest = false;
+            m_startRequest = false;
+            m_started = false;
+            if (!m_running)
+                return true;
+            m_dispatching.store(true, FSM11STD::memory_order_relaxed);
+            eventLoopLock.unlock();
+            leaveCurrentConfiguration();
+            return true;
+        }
 
-                this->runToCompletion(changedConfiguration);
+        if (m_startRequest)
+        {
+            m_startRequest = false;
+            m_started = true;
+            if (m_running)
+                return true;
+            m_dispatching.store(true, FSM11STD::memory_order_relaxed);
+            eventLoopLock.unlock();
+            enterInitialConfiguration();
+            return true;
+        }
+
+        if (!m_running
+            || (derived().m_eventList.empty() && !m_timeoutExpired))
+        {
+            return false;
+        }
+
+        event_type event = event_type();
+        bool lowWatermark;
+        EventCompletion* completion;
+        bool expired;
+        m_dispatching.store(true, FSM11STD::memory_order_relaxed);
+        bool hasEvent = takeEvent(event, lowWatermark, completion, expired);
+        eventLoopLock.unlock();
+        EventCompletionHandle handle(completion);
+        invokeLowWatermarkCallback(lowWatermark);
+        isEvent = true;
+        dispatchEvent(hasEvent, expired, FSM11STD::move(event), handle);
+        return true;
+    }
+
+    //! \brief Drains the state machine in an executor.
+    //!
+    //! Handles the pending requests and dispatches up to
+    //! maxEventsPerBatch() events. If more events are pending, the drain
+    //! task is posted again, so that other state machines get a turn.
+    void drain() noexcept
+    {
+        try
+        {
+            dispatchPending(m_maxEventsPerBatch);
+        }
+        catch (...)
+        {
+            // The state machine has been stopped. The exception is kept
+            // until the next start(), stop() or waitUntilIdle().
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            if (!m_drainException)
+                m_drainException = FSM11STD::current_exception();
+        }
+
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            bool post = m_startRequest || m_stopRequest
+                        || (m_running && (!derived().m_eventList.empty()
+                                          || m_timeoutExpired));
+            if (!post)
+            {
+                // Notify while holding the lock, because halt() destroys
+                // the state machine as soon as it sees the flag cleared.
+                m_drainScheduled = false;
+                m_continueEventLoop.notify_all();
+                return;
             }
-        } while (false); // TODO: have an option to continue looping even after a stop request
+        }
+
+        try
+        {
+            postDrain();
+        }
+        catch (...)
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_eventLoopMutex);
+            m_drainScheduled = false;
+            m_continueEventLoop.notify_all();
+        }
     }
 };
 
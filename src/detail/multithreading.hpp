@@ -76,6 +76,7 @@ protected:
     }
 };
 
+template <typename TLock>
 class WithMultithreading
 {
 public:
@@ -95,12 +96,12 @@ public:
     }
 
 protected:
-    mutable FSM11STD::mutex m_mutex; // Non-recursive to avoid mistakes in the application!!!
+    mutable TLock m_mutex; // Non-recursive to avoid mistakes in the application!!!
 
     inline
-    FSM11STD::unique_lock<FSM11STD::mutex> getLock() const
+    FSM11STD::unique_lock<TLock> getLock() const
     {
-        return FSM11STD::unique_lock<FSM11STD::mutex>(m_mutex);
+        return FSM11STD::unique_lock<TLock>(m_mutex);
     }
 };
 
@@ -109,7 +110,7 @@ struct get_multithreading
 {
     using type = typename FSM11STD::conditional<
                      TOptions::multithreading_enable,
-                     WithMultithreading,
+                     WithMultithreading<typename TOptions::lock_type>,
                      WithoutMultithreading>::type;
 };
 
@@ -0,0 +1,312 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_DETAIL_THREADCACHE_HPP
+#define FSM11_DETAIL_THREADCACHE_HPP
+
+#include "../statemachine_fwd.hpp"
+#include "../threadattributes.hpp"
+#include "threadedstatebase.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/chrono.hpp>
+#include <weos/condition_variable.hpp>
+#include <weos/future.hpp>
+#include <weos/memory.hpp>
+#include <weos/mutex.hpp>
+#include <weos/thread.hpp>
+#else
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#endif // FSM11_USE_WEOS
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+
+//! \brief A process-wide cache of threads.
+//!
+//! The ThreadCache runs the invoke actions of ThreadedState%s, which do
+//! not use a thread pool. Every invoke action gets a thread of its own
+//! immediately, just as with FSM11STD::async(). However, a thread is not
+//! destroyed when the invoke action returns. It is parked in the cache
+//! and is woken up for the next invoke action. A parked thread exits
+//! after it has been idle for idleTimeout().
+//!
+//! The bookkeeping is shared with the threads, so a thread, which still
+//! runs an invoke action when the cache is destroyed, does not access a
+//! destroyed cache.
+class ThreadCache
+{
+public:
+    using duration = FSM11STD::chrono::steady_clock::duration;
+
+    ThreadCache()
+        : m_state(FSM11STD::make_shared<State>())
+    {
+    }
+
+    ThreadCache(const ThreadCache&) = delete;
+    ThreadCache& operator=(const ThreadCache&) = delete;
+
+    //! Wakes up the parked threads and waits until they have exited. The
+    //! threads, which are running an invoke action, are left alone. They
+    //! exit as soon as their invoke action returns.
+    ~ThreadCache()
+    {
+        FSM11STD::unique_lock<FSM11STD::mutex> lock(m_state->mutex);
+        m_state->stopped = true;
+        for (Worker* iter = m_state->idleWorkers; iter; iter = iter->next)
+            iter->cv.notify_one();
+        // The workers live on the stacks of their threads, so the list
+        // must not be accessed after the notification.
+        m_state->idleWorkers = nullptr;
+        m_state->exitCv.wait(lock, [this] {
+            return m_state->numIdleThreads == 0;
+        });
+    }
+
+    //! Returns the process-wide thread cache.
+    static ThreadCache& instance()
+    {
+        static ThreadCache cache;
+        return cache;
+    }
+
+    //! Returns the number of threads, which are running or parked.
+    std::size_t numThreads() const
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_state->mutex);
+        return m_state->numThreads;
+    }
+
+    //! Returns the number of parked threads.
+    std::size_t numIdleThreads() const
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_state->mutex);
+        return m_state->numIdleThreads;
+    }
+
+    //! Returns the time after which a parked thread exits.
+    duration idleTimeout() const
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_state->mutex);
+        return m_state->idleTimeout;
+    }
+
+    //! Sets the time after which a parked thread exits to \p timeout.
+    template <typename TRep, typename TPeriod>
+    void setIdleTimeout(
+            const FSM11STD::chrono::duration<TRep, TPeriod>& timeout)
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_state->mutex);
+        m_state->idleTimeout
+                = FSM11STD::chrono::duration_cast<duration>(timeout);
+    }
+
+    //! \brief Runs the invoke action of a state.
+    //!
+    //! Runs the invoke action of the \p state in a parked thread or in a
+    //! new one, if no thread is parked. Returns a future, which is
+    //! satisfied when the invoke action is completed.
+    inline
+    FSM11STD::future<void> enqueue(ThreadedStateBase& state);
+
+#ifndef FSM11_USE_WEOS
+    //! \brief Runs the invoke action of a state in a new thread.
+    //!
+    //! Runs the invoke action of the \p state in a new thread, which is
+    //! created with the attributes \p attrs. The thread is not taken from
+    //! the cache and is not parked afterwards, because the attributes are
+    //! specific to the state. Returns a future, which is satisfied when
+    //! the invoke action is completed.
+    static inline
+    FSM11STD::future<void> spawn(ThreadedStateBase& state,
+                                 const ThreadAttributes& attrs);
+#endif // FSM11_USE_WEOS
+
+private:
+    //! A parked thread.
+    struct Worker
+    {
+        FSM11STD::condition_variable cv;
+        InvokeTask* task{nullptr};
+        Worker* next{nullptr};
+    };
+
+    //! The bookkeeping, which is shared by the cache and its threads.
+    struct State
+    {
+        FSM11STD::mutex mutex;
+        //! Signals that a parked thread has exited after the cache has
+        //! been stopped.
+        FSM11STD::condition_variable exitCv;
+        //! A LIFO of parked threads. The thread, which has been parked
+        //! last, is woken up first, so the others can time out.
+        Worker* idleWorkers{nullptr};
+        std::size_t numThreads{0};
+        std::size_t numIdleThreads{0};
+        duration idleTimeout{FSM11STD::chrono::duration_cast<duration>(
+                                 FSM11STD::chrono::seconds(10))};
+        bool stopped{false};
+    };
+
+    FSM11STD::shared_ptr<State> m_state;
+
+    static inline
+    void work(FSM11STD::shared_ptr<State> state, InvokeTask* task);
+
+    //! Runs the \p task in a thread, which has been spawned for it.
+    static
+    void runTask(InvokeTask* task) noexcept
+    {
+        if (task->start())
+        {
+            task->execute();
+            task->complete();
+        }
+        task->release();
+    }
+};
+
+FSM11STD::future<void> ThreadCache::enqueue(ThreadedStateBase& state)
+{
+    using namespace FSM11STD;
+
+    InvokeTask* task = new InvokeTask(state);
+    future<void> result = task->getFuture();
+    state.releaseInvokeTask();
+    state.m_invokeTask = task;
+
+    unique_lock<mutex> lock(m_state->mutex);
+    if (m_state->idleWorkers)
+    {
+        Worker* worker = m_state->idleWorkers;
+        m_state->idleWorkers = worker->next;
+        --m_state->numIdleThreads;
+        worker->task = task;
+        // The worker lives on the stack of its thread, so it must be
+        // notified before the mutex is released.
+        worker->cv.notify_one();
+        return result;
+    }
+
+    ++m_state->numThreads;
+    try
+    {
+        thread(&ThreadCache::work, m_state, task).detach();
+    }
+    catch (...)
+    {
+        --m_state->numThreads;
+        task->cancel();
+        task->release();
+        throw;
+    }
+    return result;
+}
+
+#ifndef FSM11_USE_WEOS
+FSM11STD::future<void> ThreadCache::spawn(ThreadedStateBase& state,
+                                          const ThreadAttributes& attrs)
+{
+    using namespace FSM11STD;
+
+    InvokeTask* task = new InvokeTask(state);
+    future<void> result = task->getFuture();
+    state.releaseInvokeTask();
+    state.m_invokeTask = task;
+
+    try
+    {
+        makeThread(attrs, &ThreadCache::runTask, task).detach();
+    }
+    catch (...)
+    {
+        task->cancel();
+        task->release();
+        throw;
+    }
+    return result;
+}
+#endif // FSM11_USE_WEOS
+
+void ThreadCache::work(FSM11STD::shared_ptr<State> state, InvokeTask* task)
+{
+    using namespace FSM11STD;
+
+    Worker self;
+    unique_lock<mutex> lock(state->mutex);
+    while (task)
+    {
+        lock.unlock();
+        runTask(task);
+        task = nullptr;
+        lock.lock();
+
+        if (state->stopped)
+            break;
+
+        self.next = state->idleWorkers;
+        state->idleWorkers = &self;
+        ++state->numIdleThreads;
+        if (!self.cv.wait_for(lock, state->idleTimeout,
+                              [&] { return self.task || state->stopped; }))
+        {
+            // Timed out, so the worker is still parked.
+            Worker** iter = &state->idleWorkers;
+            while (*iter != &self)
+                iter = &(*iter)->next;
+            *iter = self.next;
+            --state->numIdleThreads;
+            break;
+        }
+
+        task = self.task;
+        self.task = nullptr;
+        if (!task)
+        {
+            // Woken up by the destructor of the cache, which has already
+            // removed the worker from the list.
+            if (--state->numIdleThreads == 0)
+                state->exitCv.notify_all();
+        }
+    }
+
+    --state->numThreads;
+}
+
+} // namespace fsm11_detail
+} // namespace fsm11
+
+#endif // FSM11_DETAIL_THREADCACHE_HPP
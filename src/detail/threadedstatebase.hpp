@@ -32,27 +32,474 @@
 #include "../statemachine_fwd.hpp"
 #include "../exitrequest.hpp"
 
+#ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/condition_variable.hpp>
+#include <weos/exception.hpp>
+#include <weos/future.hpp>
+#include <weos/mutex.hpp>
+#else
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <mutex>
+#endif // FSM11_USE_WEOS
+
 namespace fsm11
 {
 namespace fsm11_detail
 {
 
+class InvokeTask;
+class ThreadCache;
+class ThreadPoolClient;
+class ThreadPoolCore;
+
 class ThreadedStateBase
 {
 public:
-    virtual ~ThreadedStateBase() {}
+    virtual ~ThreadedStateBase()
+    {
+        releaseInvokeTask();
+    }
 
     virtual void invoke(ExitRequest& exitRequest) = 0;
 
 protected:
+    //! \brief Called when an invocation is finished.
+    //!
+    //! This function is called by the thread which has run the invoke
+    //! action, right before the result is handed to the waiting state
+    //! machine. The \p exception thrown by the invoke action may be taken
+    //! over by setting it to a null-pointer. The default implementation
+    //! does nothing.
+    virtual void invokeFinished(FSM11STD::exception_ptr& /*exception*/) noexcept
+    {
+    }
+
+    //! \brief Called when an invocation is cancelled.
+    //!
+    //! This function is called when the invocation has been cancelled
+    //! before a worker has started it, e.g. because the thread pool is
+    //! shut down. The invoke action and invokeFinished() are not called in
+    //! this case. The default implementation does nothing.
+    virtual void invokeCancelled() noexcept
+    {
+    }
+
     ExitRequest m_exitRequest;
+    //! The task which has been queued in a thread pool for the current
+    //! invocation or a null-pointer.
+    InvokeTask* m_invokeTask{nullptr};
 
-    template <std::size_t TSize>
-    friend class fsm11::ThreadPool;
+    //! \brief Releases the invoke task.
+    //!
+    //! Releases the task, which has been queued in a thread pool for the
+    //! current invocation. A task which has not been started, yet, is
+    //! cancelled, so that a worker never accesses a destroyed state.
+    inline
+    void releaseInvokeTask() noexcept;
 
+    friend class ThreadCache;
+    friend class ThreadPoolCore;
     friend class WithoutThreadPool;
+    friend class InvokeTask;
+    friend class ThreadPoolClient;
+};
+
+//! \brief A node in the queue of a thread pool worker.
+//!
+//! The queues of a thread pool hold two kinds of nodes: tasks, which have
+//! been enqueued without a client, and clients, which have tasks waiting
+//! for a worker.
+class ThreadPoolNode
+{
+public:
+    explicit ThreadPoolNode(bool isClient) noexcept
+        : m_isClient(isClient)
+    {
+    }
+
+    //! The next node in an intrusive list.
+    ThreadPoolNode* m_next{nullptr};
+    //! Set if the node is a ThreadPoolClient, otherwise it is an
+    //! InvokeTask.
+    const bool m_isClient;
+};
+
+//! \brief A task in a thread pool.
+//!
+//! An InvokeTask wraps the invoke action of a threaded state, which has
+//! been queued in a thread pool. The task is shared between the pool and
+//! the state. It is deleted when both have released it. A task, which has
+//! not been started by a worker, can be cancelled. This is needed when a
+//! state is left while its invocation is still waiting for a worker.
+class InvokeTask : public ThreadPoolNode
+{
+public:
+    explicit InvokeTask(ThreadedStateBase& state)
+        : ThreadPoolNode(false),
+          m_state(&state),
+          m_referenceCount(2),
+          m_status(Queued)
+    {
+    }
+
+    InvokeTask(const InvokeTask&) = delete;
+    InvokeTask& operator=(const InvokeTask&) = delete;
+
+    //! Returns the future which is satisfied when the task is completed.
+    FSM11STD::future<void> getFuture()
+    {
+        return m_promise.get_future();
+    }
+
+    //! Returns \p true, if the task has neither been started nor cancelled.
+    bool queued() const noexcept
+    {
+        return m_status == Queued;
+    }
+
+    //! \brief Starts the task.
+    //!
+    //! Marks the task as started. Returns \p false if the task has been
+    //! cancelled or started already.
+    bool start() noexcept
+    {
+        int expected = Queued;
+        return m_status.compare_exchange_strong(expected, Running);
+    }
+
+    //! \brief Executes the task.
+    //!
+    //! Calls the state's invoke action. The task must have been started
+    //! before. An exception thrown by the invoke action is stored until
+    //! complete() is called.
+    void execute() noexcept
+    {
+        try
+        {
+            m_state->invoke(m_state->m_exitRequest);
+        }
+        catch (...)
+        {
+            m_exception = FSM11STD::current_exception();
+        }
+    }
+
+    //! \brief Completes the task.
+    //!
+    //! Notifies the state and satisfies the future with the result of
+    //! execute().
+    void complete() noexcept
+    {
+        m_state->invokeFinished(m_exception);
+        if (m_exception)
+            m_promise.set_exception(m_exception);
+        else
+            m_promise.set_value();
+    }
+
+    //! \brief Cancels the task.
+    //!
+    //! Cancels the task, if no worker has started it, yet, and notifies
+    //! the state. Returns \p true if the task has been cancelled.
+    bool cancel() noexcept
+    {
+        int expected = Queued;
+        if (m_status.compare_exchange_strong(expected, Cancelled))
+        {
+            m_promise.set_value();
+            // The state may delete itself. The task is kept alive by the
+            // caller's reference.
+            m_state->invokeCancelled();
+            return true;
+        }
+        return false;
+    }
+
+    //! Releases a reference to the task.
+    void release() noexcept
+    {
+        if (m_referenceCount.fetch_sub(1) == 1)
+            delete this;
+    }
+
+    //! The client on whose behalf the task has been enqueued or a
+    //! null-pointer.
+    ThreadPoolClient* m_client{nullptr};
+    //! Set when the task has been submitted to the pool. Guarded by the
+    //! client's mutex.
+    bool m_submitted{false};
+
+private:
+    enum Status
+    {
+        Queued,
+        Running,
+        Cancelled
+    };
+
+    ThreadedStateBase* m_state;
+    FSM11STD::promise<void> m_promise;
+    FSM11STD::exception_ptr m_exception;
+    FSM11STD::atomic_int m_referenceCount;
+    FSM11STD::atomic_int m_status;
+};
+
+//! \brief A client of a thread pool.
+//!
+//! A thread pool, which is shared by many state machines, serves every
+//! machine through a ThreadPoolClient. The tasks of a machine are not
+//! pushed to the pool's queues directly. Instead, the client keeps them
+//! in a FIFO of ready tasks and takes part in the queues itself. A worker,
+//! which takes the client from a queue, runs the oldest ready task and
+//! appends the client to the back of the queue again, if it has more
+//! tasks. Thus, the machines take turns and a single machine cannot
+//! monopolize the workers of a shared pool.
+//!
+//! In addition, the client can limit the number of tasks, which the
+//! machine has in flight in the pool, i.e. which are ready or running.
+//! Tasks beyond this limit are kept pending until a task has finished.
+//! By default, the number of tasks in flight is unlimited.
+class ThreadPoolClient : public ThreadPoolNode
+{
+public:
+    ThreadPoolClient() noexcept
+        : ThreadPoolNode(true)
+    {
+    }
+
+    ThreadPoolClient(const ThreadPoolClient&) = delete;
+    ThreadPoolClient& operator=(const ThreadPoolClient&) = delete;
+
+    //! Destroys the client. The client must have been detached from the
+    //! pool before.
+    ~ThreadPoolClient()
+    {
+        while (InvokeTask* task = popFront(m_pendingHead, m_pendingTail))
+        {
+            task->cancel();
+            task->release();
+        }
+    }
+
+    //! Returns the maximum number of tasks in flight.
+    std::size_t maxTasksInFlight() const noexcept
+    {
+        return m_maxTasksInFlight;
+    }
+
+    //! Sets the maximum number of tasks in flight to \p limit.
+    void setMaxTasksInFlight(std::size_t limit) noexcept
+    {
+        m_maxTasksInFlight = limit;
+    }
+
+    //! \brief Admits a task.
+    //!
+    //! Adds the \p task to the ready tasks and returns \p true, if the
+    //! limit of tasks in flight has not been reached. \p schedule is set if
+    //! the client has to be pushed to one of the pool's queues. Otherwise,
+    //! the client keeps the task pending until another task has finished.
+    bool admit(InvokeTask* task, bool& schedule)
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        schedule = false;
+        if (m_numTasksInFlight < m_maxTasksInFlight)
+        {
+            ++m_numTasksInFlight;
+            task->m_submitted = true;
+            pushBack(m_readyHead, m_readyTail, task);
+            schedule = this->schedule();
+            return true;
+        }
+
+        pushBack(m_pendingHead, m_pendingTail, task);
+        return false;
+    }
+
+    //! Returns \p true, if the \p task has been submitted to the pool.
+    bool submitted(const InvokeTask* task)
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        return task->m_submitted;
+    }
+
+    //! \brief Takes the oldest ready task.
+    //!
+    //! This function is called by a worker, which has taken the client from
+    //! a queue. \p requeue is set if the client has more ready tasks and has
+    //! to be appended to the queue again.
+    InvokeTask* take(bool& requeue)
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        InvokeTask* task = popFront(m_readyHead, m_readyTail);
+        m_scheduled = m_readyHead != nullptr;
+        requeue = m_scheduled;
+        return task;
+    }
+
+    //! \brief Finishes a task.
+    //!
+    //! This function has to be called when a submitted task has been
+    //! completed or cancelled. If the oldest pending task can be submitted
+    //! now, it is made ready and \p true is returned. \p schedule is set if
+    //! the client has to be pushed to one of the pool's queues.
+    bool finish(bool& schedule)
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        --m_numTasksInFlight;
+        schedule = false;
+        while (m_numTasksInFlight < m_maxTasksInFlight)
+        {
+            InvokeTask* task = popFront(m_pendingHead, m_pendingTail);
+            if (!task)
+                return false;
+
+            // Drop the tasks which have been cancelled while pending.
+            if (!task->queued())
+            {
+                task->release();
+                continue;
+            }
+
+            ++m_numTasksInFlight;
+            task->m_submitted = true;
+            pushBack(m_readyHead, m_readyTail, task);
+            schedule = this->schedule();
+            return true;
+        }
+        return false;
+    }
+
+    //! \brief Detaches the ready tasks.
+    //!
+    //! Returns the list of ready tasks, which have not been taken by a
+    //! worker, and marks the client as not being queued. This function is
+    //! used when the client has been removed from the pool's queues.
+    InvokeTask* detachReadyTasks()
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        InvokeTask* tasks = m_readyHead;
+        m_readyHead = m_readyTail = nullptr;
+        m_scheduled = false;
+        return tasks;
+    }
+
+private:
+    FSM11STD::mutex m_mutex;
+    std::size_t m_numTasksInFlight{0};
+    FSM11STD::atomic<std::size_t> m_maxTasksInFlight{std::size_t(-1)};
+    //! A FIFO of submitted tasks, which wait for a worker.
+    InvokeTask* m_readyHead{nullptr};
+    InvokeTask* m_readyTail{nullptr};
+    //! A FIFO of pending tasks.
+    InvokeTask* m_pendingHead{nullptr};
+    InvokeTask* m_pendingTail{nullptr};
+    //! Set while the client is in one of the pool's queues or is being
+    //! requeued by a worker.
+    bool m_scheduled{false};
+
+    //! Marks the client as queued, if it has ready tasks and is not queued,
+    //! yet. Returns \p true, if the client has to be pushed to a queue.
+    bool schedule() noexcept
+    {
+        if (!m_readyHead || m_scheduled)
+            return false;
+        m_scheduled = true;
+        return true;
+    }
+
+    static void pushBack(InvokeTask*& head, InvokeTask*& tail,
+                         InvokeTask* task) noexcept
+    {
+        task->m_next = nullptr;
+        if (tail)
+            tail->m_next = task;
+        else
+            head = task;
+        tail = task;
+    }
+
+    static InvokeTask* popFront(InvokeTask*& head, InvokeTask*& tail) noexcept
+    {
+        InvokeTask* task = head;
+        if (task)
+        {
+            head = static_cast<InvokeTask*>(task->m_next);
+            if (!head)
+                tail = nullptr;
+            task->m_next = nullptr;
+        }
+        return task;
+    }
 };
 
+//! \brief Tracks the invocations of a state machine.
+//!
+//! If the invoke actions are left asynchronously, the state machine does
+//! not wait for an invoke action when its state is left. The tracker counts
+//! the invocations which are still running, so that the state machine can
+//! wait for all of them when it is stopped. An exception thrown by such
+//! an invocation is kept until then.
+class InvocationTracker
+{
+public:
+    InvocationTracker() = default;
+
+    InvocationTracker(const InvocationTracker&) = delete;
+    InvocationTracker& operator=(const InvocationTracker&) = delete;
+
+    //! \brief Waits for all invocations.
+    //!
+    //! Blocks until all invocations have finished. If an invoke action has
+    //! thrown an exception, the first such exception is rethrown.
+    void waitForAll()
+    {
+        FSM11STD::unique_lock<FSM11STD::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_numInvocations == 0; });
+        if (m_exception)
+        {
+            FSM11STD::exception_ptr exception = m_exception;
+            m_exception = nullptr;
+            lock.unlock();
+            FSM11STD::rethrow_exception(exception);
+        }
+    }
+
+private:
+    //! Guards the tracker and the invocation flags of the threaded states.
+    FSM11STD::mutex m_mutex;
+    FSM11STD::condition_variable m_cv;
+    std::size_t m_numInvocations{0};
+    FSM11STD::exception_ptr m_exception;
+
+    template <typename TStateMachine>
+    friend class fsm11::ThreadedState;
+};
+
+//! The invocation tracker of a state machine whose invoke actions are
+//! left synchronously.
+class NullInvocationTracker
+{
+public:
+    void waitForAll() noexcept
+    {
+    }
+};
+
+void ThreadedStateBase::releaseInvokeTask() noexcept
+{
+    if (m_invokeTask)
+    {
+        m_invokeTask->cancel();
+        m_invokeTask->release();
+        m_invokeTask = nullptr;
+    }
+}
+
 } // namespace fsm11_detail
 } // namespace fsm11
 
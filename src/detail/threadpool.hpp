@@ -34,6 +34,14 @@
 #include "threadedstatebase.hpp"
 #include "../threadpool.hpp"
 
+#ifdef FSM11_USE_WEOS
+#include <weos/memory.hpp>
+#include <weos/utility.hpp>
+#else
+#include <memory>
+#include <utility>
+#endif // FSM11_USE_WEOS
+
 namespace fsm11
 {
 namespace fsm11_detail
@@ -53,10 +61,90 @@ template <typename TOptions>
 class WithThreadPool
 {
 public:
-    using thread_pool_type = ThreadPool<TOptions::thread_pool_size>;
+    //! The type of the thread pool. A pool size of zero selects a pool
+    //! whose size is determined at runtime.
+    using thread_pool_type = typename FSM11STD::conditional<
+                                 TOptions::thread_pool_size == 0,
+                                 DynamicThreadPool,
+                                 ThreadPool<TOptions::thread_pool_size>>::type;
+
+    //! \brief Returns the maximum number of invoke actions in flight.
+    //!
+    //! Returns the maximum number of invoke actions of this state machine,
+    //! which are queued in the thread pool or running at the same time.
+    std::size_t maxInvocationsInFlight() const noexcept
+    {
+        return m_threadPoolClient.maxTasksInFlight();
+    }
+
+    //! \brief Sets the maximum number of invoke actions in flight.
+    //!
+    //! Limits the number of invoke actions of this state machine, which are
+    //! queued in the thread pool or running at the same time, to \p limit.
+    //! Further invoke actions wait until one of them has finished. If the
+    //! state of a waiting invoke action is left, the action is cancelled.
+    //! By default, the number of invoke actions in flight is unlimited.
+    //! Even then, a single state machine cannot monopolize a thread pool,
+    //! which is shared with other state machines, because the pool serves
+    //! the machines round-robin. The limit additionally bounds the number
+    //! of workers, which the machine can occupy at the same time.
+    void setMaxInvocationsInFlight(std::size_t limit) noexcept
+    {
+        m_threadPoolClient.setMaxTasksInFlight(limit);
+    }
 
 protected:
     using internal_thread_pool_type = thread_pool_type;
+
+    //! Creates a state machine with its own thread pool.
+    WithThreadPool()
+        : m_sharedThreadPool(FSM11STD::make_shared<thread_pool_type>()),
+          m_threadPool(m_sharedThreadPool.get())
+    {
+    }
+
+    //! Creates a state machine which takes over the thread \p pool.
+    explicit WithThreadPool(thread_pool_type&& pool)
+        : m_sharedThreadPool(FSM11STD::make_shared<thread_pool_type>(
+                                 FSM11STD::move(pool))),
+          m_threadPool(m_sharedThreadPool.get())
+    {
+    }
+
+    //! Creates a state machine which uses the thread \p pool. The pool
+    //! must outlive the state machine.
+    explicit WithThreadPool(thread_pool_type& pool)
+        : m_threadPool(&pool)
+    {
+    }
+
+    //! Creates a state machine which shares the thread \p pool.
+    explicit WithThreadPool(FSM11STD::shared_ptr<thread_pool_type> pool)
+        : m_sharedThreadPool(FSM11STD::move(pool)),
+          m_threadPool(m_sharedThreadPool.get())
+    {
+    }
+
+    ~WithThreadPool()
+    {
+        m_threadPool->detach(m_threadPoolClient);
+    }
+
+    thread_pool_type& threadPool() noexcept
+    {
+        return *m_threadPool;
+    }
+
+    ThreadPoolClient& threadPoolClient() noexcept
+    {
+        return m_threadPoolClient;
+    }
+
+private:
+    //! Keeps a shared or owned pool alive.
+    FSM11STD::shared_ptr<thread_pool_type> m_sharedThreadPool;
+    thread_pool_type* m_threadPool;
+    ThreadPoolClient m_threadPoolClient;
 };
 
 template <typename TOptions>
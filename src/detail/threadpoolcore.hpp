@@ -0,0 +1,640 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_DETAIL_THREADPOOLCORE_HPP
+#define FSM11_DETAIL_THREADPOOLCORE_HPP
+
+#include "../statemachine_fwd.hpp"
+#include "../error.hpp"
+#include "../threadattributes.hpp"
+#include "scopeguard.hpp"
+#include "threadedstatebase.hpp"
+#include "workqueue.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/chrono.hpp>
+#include <weos/condition_variable.hpp>
+#include <weos/future.hpp>
+#include <weos/memory.hpp>
+#include <weos/mutex.hpp>
+#include <weos/thread.hpp>
+#else
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#endif // FSM11_USE_WEOS
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+
+//! \brief The shared state of a thread pool.
+//!
+//! The ThreadPoolCore holds the queues and the bookkeeping of a thread
+//! pool. It lives on the heap and its address never changes, so a pool can
+//! be moved by handing over the pointer to the core. The workers are not
+//! involved in a move at all.
+//!
+//! Every worker owns a WorkQueue of tasks. A new task is appended to one of
+//! the queues and an idle worker is woken up only if one is sleeping. A
+//! worker takes the oldest task from its own queue and, if this queue is
+//! empty, steals the oldest task of another worker. The number of workers
+//! is only limited by the memory.
+//!
+//! The tasks of a ThreadPoolClient are kept in the client, which is queued
+//! in place of its tasks. A worker, which takes a client from a queue,
+//! runs the client's oldest task and appends the client to the back of the
+//! queue again, if it has more tasks. Thus, the clients are served
+//! round-robin.
+//!
+//! The number of workers varies between a minimum and a maximum. If the
+//! maximum is larger than the minimum, a supervisor thread spawns a new
+//! worker whenever no queued task has been started for longer than the
+//! grow threshold. A worker, which has been idle for longer than the idle
+//! timeout, retires as long as more than the minimum number of workers
+//! are running.
+class ThreadPoolCore
+{
+public:
+    using task_type = InvokeTask;
+    using clock_type = FSM11STD::chrono::steady_clock;
+    using duration = clock_type::duration;
+
+    //! Creates a core for at least \p minWorkers and at most \p maxWorkers
+    //! workers.
+    ThreadPoolCore(std::size_t minWorkers, std::size_t maxWorkers)
+        : m_minWorkers(minWorkers),
+          m_maxWorkers(maxWorkers),
+          m_queues(new WorkQueue<ThreadPoolNode>[maxWorkers]),
+          m_threads(new Thread[maxWorkers]),
+          m_activeWorkers(new bool[maxWorkers])
+    {
+        for (std::size_t idx = 0; idx < maxWorkers; ++idx)
+            m_activeWorkers[idx] = false;
+    }
+
+    ThreadPoolCore(const ThreadPoolCore&) = delete;
+    ThreadPoolCore& operator=(const ThreadPoolCore&) = delete;
+
+    //! Sets the attributes for the workers, which are spawned by the
+    //! supervisor, to \p attrs.
+    void setThreadAttributes(const ThreadAttributes& attrs)
+    {
+        m_threadAttributes = attrs;
+    }
+
+    //! Returns the minimum number of workers.
+    std::size_t minWorkers() const noexcept
+    {
+        return m_minWorkers;
+    }
+
+    //! Returns the maximum number of workers.
+    std::size_t maxWorkers() const noexcept
+    {
+        return m_maxWorkers;
+    }
+
+    //! Returns the current number of workers.
+    std::size_t numWorkers() const noexcept
+    {
+        return m_numWorkers;
+    }
+
+    //! Returns the number of tasks, which wait for a worker.
+    std::size_t numQueuedTasks() const noexcept
+    {
+        std::size_t running = m_numRunningTasks;
+        std::size_t total = m_numTasks;
+        return total > running ? total - running : 0;
+    }
+
+    //! Returns the number of tasks, which are running.
+    std::size_t numRunningTasks() const noexcept
+    {
+        return m_numRunningTasks;
+    }
+
+    //! \brief Adds a worker.
+    //!
+    //! Starts the worker with index \p idx in the thread \p thread. This
+    //! function is used to start the initial workers of the pool.
+    void setThread(std::size_t idx, Thread&& thread) noexcept
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_workerMutex);
+        m_threads[idx] = FSM11STD::move(thread);
+        m_activeWorkers[idx] = true;
+        ++m_numWorkers;
+    }
+
+    //! \brief Starts the supervisor.
+    //!
+    //! Starts the thread which spawns new workers. This is only needed if
+    //! the maximum number of workers exceeds the minimum.
+    inline
+    void startSupervisor();
+
+    //! \brief Shuts the pool down.
+    //!
+    //! Stops all workers and waits until they have finished their current
+    //! task. Tasks, which are still queued, are cancelled.
+    inline
+    void shutdown();
+
+    //! Returns the maximum number of queued tasks.
+    std::size_t maxQueueSize() const noexcept
+    {
+        return m_maxQueueSize;
+    }
+
+    //! Sets the maximum number of queued tasks to \p size.
+    void setMaxQueueSize(std::size_t size) noexcept
+    {
+        m_maxQueueSize = size;
+    }
+
+    //! Returns the time after which a new worker is spawned.
+    duration growThreshold() const noexcept
+    {
+        return duration(m_growThreshold.load());
+    }
+
+    //! Sets the time after which a new worker is spawned to \p threshold.
+    void setGrowThreshold(duration threshold) noexcept
+    {
+        m_growThreshold = threshold.count();
+    }
+
+    //! Returns the time after which an idle worker retires.
+    duration idleTimeout() const noexcept
+    {
+        return duration(m_idleTimeout.load());
+    }
+
+    //! Sets the time after which an idle worker retires to \p timeout.
+    void setIdleTimeout(duration timeout) noexcept
+    {
+        m_idleTimeout = timeout.count();
+    }
+
+    //! Enqueues the invoke action of the \p state on behalf of the
+    //! \p client.
+    inline
+    FSM11STD::future<void> enqueue(ThreadedStateBase& state,
+                                   ThreadPoolClient* client);
+
+    //! Releases the invoke action of the \p state.
+    inline
+    void release(ThreadedStateBase& state);
+
+    //! \brief Detaches a client.
+    //!
+    //! Removes the \p client from the queues and cancels its tasks, which
+    //! wait for a worker. This function has to be called before the client
+    //! is destroyed.
+    inline
+    void detach(ThreadPoolClient& client) noexcept;
+
+    //! The main function of the worker with the index \p id.
+    inline
+    void work(std::size_t id);
+
+private:
+    using rep = duration::rep;
+
+    const std::size_t m_minWorkers;
+    const std::size_t m_maxWorkers;
+    //! One queue for every worker, which can possibly run.
+    FSM11STD::unique_ptr<WorkQueue<ThreadPoolNode>[]> m_queues;
+    FSM11STD::unique_ptr<Thread[]> m_threads;
+    //! Marks the workers which are running. Guarded by the worker mutex.
+    FSM11STD::unique_ptr<bool[]> m_activeWorkers;
+    Thread m_supervisor;
+    ThreadAttributes m_threadAttributes;
+
+    //! Guards the sleeping workers and the set of workers.
+    FSM11STD::mutex m_workerMutex;
+    FSM11STD::condition_variable m_workerCv;
+    //! Signals that a task has been started.
+    FSM11STD::condition_variable m_startCv;
+    FSM11STD::condition_variable m_supervisorCv;
+    FSM11STD::atomic_bool m_stopped{false};
+
+    //! The current number of workers.
+    FSM11STD::atomic<std::size_t> m_numWorkers{0};
+    //! The index of the queue which receives the next task.
+    FSM11STD::atomic<std::size_t> m_nextWorker{0};
+    //! The number of tasks, which are queued or running.
+    FSM11STD::atomic<std::size_t> m_numTasks{0};
+    //! The number of tasks, which are running.
+    FSM11STD::atomic<std::size_t> m_numRunningTasks{0};
+    //! The number of workers waiting for a task.
+    FSM11STD::atomic<std::size_t> m_sleepingWorkers{0};
+    //! The number of threads waiting in release().
+    FSM11STD::atomic<std::size_t> m_releasingThreads{0};
+    //! The maximum number of tasks beyond the number of workers.
+    FSM11STD::atomic<std::size_t> m_maxQueueSize{std::size_t(-1)};
+    //! The last time at which a queued task has been started or at which
+    //! a task has been added to the empty queue.
+    FSM11STD::atomic<rep> m_lastProgress{0};
+    FSM11STD::atomic<rep> m_growThreshold{
+        FSM11STD::chrono::duration_cast<duration>(
+            FSM11STD::chrono::milliseconds(10)).count()};
+    FSM11STD::atomic<rep> m_idleTimeout{
+        FSM11STD::chrono::duration_cast<duration>(
+            FSM11STD::chrono::seconds(10)).count()};
+
+
+    static rep now() noexcept
+    {
+        return clock_type::now().time_since_epoch().count();
+    }
+
+    //! Returns \p true, if the workers can be blocked forever by the
+    //! tasks, which they are running. Only the workers, which are alive,
+    //! count, because the supervisor might not be able to spawn more.
+    bool saturated() const noexcept
+    {
+        return m_numRunningTasks >= m_numWorkers;
+    }
+
+    //! Spawns a new worker. The worker mutex must be locked.
+    inline
+    void spawn();
+
+    //! The main function of the supervisor.
+    inline
+    void supervise();
+
+    //! \brief Acquires a task.
+    //!
+    //! Takes the oldest task from the queue of the worker \p id. If this
+    //! queue is empty, the oldest task of another worker is stolen. Returns
+    //! a null-pointer if no task is available.
+    inline
+    task_type* acquire(std::size_t id) noexcept;
+
+    //! Returns \p true, if at least one queue is non-empty.
+    inline
+    bool hasTasks() const noexcept;
+
+    //! Wakes up a sleeping worker, if there is one.
+    inline
+    void wakeOne();
+
+    //! Cancels and releases all queued tasks.
+    inline
+    void cancelTasks() noexcept;
+
+    //! Cancels and releases the tasks of the \p client, which wait for a
+    //! worker. The client must have been removed from the queues.
+    inline
+    void cancelTasks(ThreadPoolClient& client) noexcept;
+
+    //! Called when a task of the \p client has been completed or
+    //! cancelled. Submits the client's next pending task. If the client
+    //! has to be queued, it is pushed to the queue with index \p idx.
+    inline
+    void finish(ThreadPoolClient* client, std::size_t idx);
+};
+
+void ThreadPoolCore::startSupervisor()
+{
+    m_supervisor = makeThread(m_threadAttributes,
+                              &ThreadPoolCore::supervise, this);
+}
+
+void ThreadPoolCore::shutdown()
+{
+    m_workerMutex.lock();
+    m_stopped = true;
+    m_workerMutex.unlock();
+    m_workerCv.notify_all();
+    m_supervisorCv.notify_one();
+
+    if (m_supervisor.joinable())
+        m_supervisor.join();
+    // No worker is spawned or retires after the supervisor has stopped.
+    for (std::size_t idx = 0; idx < m_maxWorkers; ++idx)
+        if (m_threads[idx].joinable())
+            m_threads[idx].join();
+    cancelTasks();
+}
+
+FSM11STD::future<void> ThreadPoolCore::enqueue(ThreadedStateBase& state,
+                                               ThreadPoolClient* client)
+{
+    using namespace FSM11STD;
+
+    // Reserve a slot for the task. If all workers are busy, the task
+    // has to fit into the queue.
+    std::size_t numTasks = ++m_numTasks;
+    if (numTasks > m_maxWorkers && numTasks - m_maxWorkers > m_maxQueueSize)
+    {
+        --m_numTasks;
+        throw FSM11_EXCEPTION(Error(ErrorCode::ThreadPoolUnderflow));
+    }
+
+    FSM11_SCOPE_FAILURE { --m_numTasks; };
+    task_type* task = new task_type(state);
+    task->m_client = client;
+    future<void> result = task->getFuture();
+    state.releaseInvokeTask();
+    state.m_invokeTask = task;
+
+    // A task of a client is queued in the client, which takes part in
+    // the queues unless it does so already.
+    ThreadPoolNode* node = task;
+    if (client)
+    {
+        bool schedule;
+        if (!client->admit(task, schedule))
+        {
+            // The task is pending in the client and does not use a slot.
+            --m_numTasks;
+            return result;
+        }
+        node = schedule ? client : nullptr;
+    }
+
+    if (numTasks <= m_numRunningTasks + 1)
+        m_lastProgress = now();
+    if (node)
+        m_queues[m_nextWorker++ % m_maxWorkers].push(node);
+    wakeOne();
+    return result;
+}
+
+void ThreadPoolCore::release(ThreadedStateBase& state)
+{
+    using namespace FSM11STD;
+
+    task_type* task = state.m_invokeTask;
+    if (!task)
+        return;
+
+    ThreadPoolClient* client = task->m_client;
+    if (task->queued() && (!client || client->submitted(task)))
+    {
+        unique_lock<mutex> lock(m_workerMutex);
+        ++m_releasingThreads;
+        m_startCv.wait(lock, [&] { return !task->queued() || saturated(); });
+        --m_releasingThreads;
+    }
+
+    // A cancelled task, which has been submitted, has to be finished,
+    // because no worker will run it.
+    if (task->cancel() && client && client->submitted(task))
+        finish(client, m_nextWorker++ % m_maxWorkers);
+    state.releaseInvokeTask();
+}
+
+void ThreadPoolCore::detach(ThreadPoolClient& client) noexcept
+{
+    for (std::size_t idx = 0; idx < m_maxWorkers; ++idx)
+        m_queues[idx].remove(&client);
+    cancelTasks(client);
+}
+
+void ThreadPoolCore::work(std::size_t id)
+{
+    using namespace FSM11STD;
+
+    while (!m_stopped)
+    {
+        if (task_type* task = acquire(id))
+        {
+            if (task->start())
+            {
+                ++m_numRunningTasks;
+                m_lastProgress = now();
+                if (m_releasingThreads != 0)
+                {
+                    lock_guard<mutex> lock(m_workerMutex);
+                    m_startCv.notify_all();
+                }
+
+                task->execute();
+                --m_numRunningTasks;
+                // The client must not be accessed after the completion
+                // because the state machine might be destroyed.
+                if (task->m_client)
+                    finish(task->m_client, id);
+                task->complete();
+            }
+            task->release();
+            --m_numTasks;
+            continue;
+        }
+
+        unique_lock<mutex> lock(m_workerMutex);
+        // The sleeping workers must be counted before checking the
+        // queues. Otherwise, enqueue() might miss the notification.
+        ++m_sleepingWorkers;
+        auto predicate = [&] { return m_stopped || hasTasks(); };
+        if (m_minWorkers == m_maxWorkers)
+        {
+            m_workerCv.wait(lock, predicate);
+        }
+        else if (!m_workerCv.wait_for(lock, idleTimeout(), predicate)
+                 && m_numWorkers > m_minWorkers)
+        {
+            // The worker has been idle for too long. Tasks, which arrive
+            // in its queue later on, are stolen by the other workers.
+            --m_sleepingWorkers;
+            --m_numWorkers;
+            m_activeWorkers[id] = false;
+            if (m_releasingThreads != 0)
+                m_startCv.notify_all();
+            return;
+        }
+        --m_sleepingWorkers;
+    }
+}
+
+void ThreadPoolCore::spawn()
+{
+    for (std::size_t idx = 0; idx < m_maxWorkers; ++idx)
+    {
+        if (m_activeWorkers[idx])
+            continue;
+
+        // A retired worker does not need the mutex anymore, so it can
+        // be joined while the mutex is locked.
+        if (m_threads[idx].joinable())
+            m_threads[idx].join();
+        m_threads[idx] = makeThread(m_threadAttributes,
+                                    &ThreadPoolCore::work, this, idx);
+        m_activeWorkers[idx] = true;
+        ++m_numWorkers;
+        return;
+    }
+}
+
+void ThreadPoolCore::supervise()
+{
+    using namespace FSM11STD;
+
+    unique_lock<mutex> lock(m_workerMutex);
+    while (!m_stopped)
+    {
+        m_supervisorCv.wait_for(lock, growThreshold());
+        if (m_stopped)
+            break;
+
+        // Spawn a worker if tasks are waiting, no worker is idle and no
+        // queued task has been started for longer than the threshold.
+        if (numQueuedTasks() != 0
+            && m_sleepingWorkers == 0
+            && m_numWorkers < m_maxWorkers
+            && (m_numWorkers == 0
+                || now() - m_lastProgress >= m_growThreshold))
+        {
+            try
+            {
+                spawn();
+                m_lastProgress = now();
+            }
+            catch (...)
+            {
+                // Try again later.
+            }
+        }
+    }
+}
+
+auto ThreadPoolCore::acquire(std::size_t id) noexcept -> task_type*
+{
+    for (std::size_t count = 0; count < m_maxWorkers; ++count)
+    {
+        task_type* task = nullptr;
+        m_queues[(id + count) % m_maxWorkers].pop([&](ThreadPoolNode* node) {
+            if (!node->m_isClient)
+            {
+                task = static_cast<task_type*>(node);
+                return false;
+            }
+
+            // The client goes to the back of the queue as long as it has
+            // tasks, which wait for a worker. Requeuing it while the queue
+            // is locked ensures that detach() does not miss it.
+            bool requeue;
+            task = static_cast<ThreadPoolClient*>(node)->take(requeue);
+            return requeue;
+        });
+        if (task)
+            return task;
+    }
+    return nullptr;
+}
+
+bool ThreadPoolCore::hasTasks() const noexcept
+{
+    for (std::size_t idx = 0; idx < m_maxWorkers; ++idx)
+        if (!m_queues[idx].empty())
+            return true;
+    return false;
+}
+
+void ThreadPoolCore::wakeOne()
+{
+    // Only take the lock if there is a thread which has to be woken up.
+    if (m_sleepingWorkers != 0)
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_workerMutex);
+        m_workerCv.notify_one();
+    }
+    else if (m_numWorkers == 0 && m_supervisor.joinable())
+    {
+        // All workers have retired. Spawn one without waiting for the
+        // grow threshold.
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_workerMutex);
+        m_supervisorCv.notify_one();
+    }
+}
+
+void ThreadPoolCore::cancelTasks() noexcept
+{
+    for (std::size_t idx = 0; idx < m_maxWorkers; ++idx)
+    {
+        while (ThreadPoolNode* node = m_queues[idx].pop())
+        {
+            if (node->m_isClient)
+            {
+                cancelTasks(*static_cast<ThreadPoolClient*>(node));
+                continue;
+            }
+
+            task_type* task = static_cast<task_type*>(node);
+            task->cancel();
+            task->release();
+            --m_numTasks;
+        }
+    }
+}
+
+void ThreadPoolCore::cancelTasks(ThreadPoolClient& client) noexcept
+{
+    task_type* task = client.detachReadyTasks();
+    while (task)
+    {
+        task_type* next = static_cast<task_type*>(task->m_next);
+        task->cancel();
+        task->release();
+        --m_numTasks;
+        task = next;
+    }
+}
+
+void ThreadPoolCore::finish(ThreadPoolClient* client, std::size_t idx)
+{
+    // The slot is reserved before the next task becomes ready, because a
+    // worker might take it right away.
+    ++m_numTasks;
+    bool schedule;
+    if (!client->finish(schedule))
+    {
+        --m_numTasks;
+        return;
+    }
+
+    if (schedule)
+        m_queues[idx].push(client);
+    wakeOne();
+}
+
+} // namespace fsm11_detail
+} // namespace fsm11
+
+#endif // FSM11_DETAIL_THREADPOOLCORE_HPP
@@ -0,0 +1,286 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_DETAIL_TIMERS_HPP
+#define FSM11_DETAIL_TIMERS_HPP
+
+#include "../statemachine_fwd.hpp"
+#include "../timerservice.hpp"
+#include "../transition.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/chrono.hpp>
+#include <weos/memory.hpp>
+#include <weos/mutex.hpp>
+#include <weos/type_traits.hpp>
+#include <weos/utility.hpp>
+#else
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#endif // FSM11_USE_WEOS
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+
+class WithoutTimers
+{
+public:
+    template <typename T = void, typename... TArgs>
+    void addEventAfter(TArgs&&...)
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "Timers are not enabled");
+    }
+
+    template <typename T = void, typename... TArgs>
+    void addEventAt(TArgs&&...)
+    {
+        static_assert(!FSM11STD::is_same<T, T>::value,
+                      "Timers are not enabled");
+    }
+
+protected:
+    template <typename TState>
+    void armTimeouts(TState&) noexcept
+    {
+    }
+
+    template <typename TState>
+    void disarmTimeouts(TState&) noexcept
+    {
+    }
+
+    void detachTimers() noexcept
+    {
+    }
+};
+
+//! \brief The timeout of a timed transition.
+//!
+//! A timed transition is armed when its source state is entered. The
+//! generation is incremented whenever the timeout is armed or disarmed,
+//! which allows to ignore a timer whose state has been left in the
+//! meantime. The members are guarded by the state machine's lock.
+struct TransitionTimeout
+{
+    explicit TransitionTimeout(FSM11STD::chrono::nanoseconds delay) noexcept
+        : delay(delay)
+    {
+    }
+
+    //! The time which has to pass after entering the source state.
+    FSM11STD::chrono::nanoseconds delay;
+    //! The handle of the pending timer.
+    TimerHandle handle;
+    unsigned generation{0};
+    //! Set when the timer has expired. The transition can be selected
+    //! only in this case.
+    bool expired{false};
+};
+
+template <typename TOptions>
+class WithTimers
+{
+    static_assert(TOptions::multithreading_enable,
+                  "Timers require multithreading support.");
+    // The thread of a timer service is shared by many state machines. It
+    // must not run the actions of a state machine, which it would do in
+    // case of synchronous event dispatching.
+    static_assert(!TOptions::synchronous_dispatch,
+                  "Timers require asynchronous event dispatching.");
+
+    using derived_type = StateMachineImpl<TOptions>;
+    using event_type = typename TOptions::event_type;
+    using state_type = State<derived_type>;
+    using transition_type = Transition<derived_type>;
+
+public:
+    using timer_service_type = TimerService<typename TOptions::timer_clock>;
+    using clock = typename timer_service_type::clock;
+    using duration = typename timer_service_type::duration;
+    using time_point = typename timer_service_type::time_point;
+
+    //! \brief Returns the timer service.
+    //!
+    //! Returns the service, which runs the timers of this state machine.
+    timer_service_type& timerService()
+    {
+        if (!m_timerService)
+            m_timerService = &timer_service_type::instance();
+        return *m_timerService;
+    }
+
+    //! \brief Sets the timer service.
+    //!
+    //! Runs the timers of this state machine in the given \p service, which
+    //! may be shared with other state machines. By default, the process-wide
+    //! service for the clock is used. The service must outlive the state
+    //! machine. This function must not be called while the state machine
+    //! is running.
+    void setTimerService(timer_service_type& service) noexcept
+    {
+        m_timerService = &service;
+    }
+
+    //! \brief Adds an event at a point in time.
+    //!
+    //! Adds the \p event to the state machine at the given \p timePoint.
+    //! Returns a handle, which can be used to cancel the event before it
+    //! is added. If the state machine is destroyed before, the event is
+    //! dropped. The overflow policy of a bounded event list is not
+    //! applied, because the timer must not block. If the list is full,
+    //! the event is dropped and counted in numDroppedEvents().
+    TimerHandle addEventAt(const time_point& timePoint, event_type event)
+    {
+        FSM11STD::shared_ptr<Anchor> anchor = m_anchor;
+        derived_type* sm = &derived();
+        return timerService().scheduleAt(
+                    timePoint,
+                    [anchor, sm, event] {
+                        FSM11STD::lock_guard<FSM11STD::mutex> lock(
+                                    anchor->mutex);
+                        if (anchor->alive)
+                            sm->addTimerEvent(event);
+                    });
+    }
+
+    //! \brief Adds an event after a delay.
+    //!
+    //! Adds the \p event to the state machine after the given \p delay.
+    //! Returns a handle, which can be used to cancel the event before it
+    //! is added.
+    template <typename TRep, typename TPeriod>
+    TimerHandle addEventAfter(
+            const FSM11STD::chrono::duration<TRep, TPeriod>& delay,
+            event_type event)
+    {
+        return addEventAt(clock::now()
+                          + FSM11STD::chrono::duration_cast<duration>(delay),
+                          FSM11STD::move(event));
+    }
+
+protected:
+    WithTimers()
+        : m_timerService(nullptr),
+          m_anchor(FSM11STD::make_shared<Anchor>())
+    {
+    }
+
+    //! Arms the timeouts of the transitions whose source is the \p state.
+    void armTimeouts(state_type& state)
+    {
+        for (auto iter = state.beginTransitions();
+             iter != state.endTransitions(); ++iter)
+        {
+            TransitionTimeout* timeout = iter->timeout();
+            if (!timeout)
+                continue;
+
+            ++timeout->generation;
+            timeout->expired = false;
+
+            FSM11STD::shared_ptr<Anchor> anchor = m_anchor;
+            derived_type* sm = &derived();
+            transition_type* transition = &*iter;
+            unsigned generation = timeout->generation;
+            timeout->handle = timerService().scheduleAfter(
+                        timeout->delay,
+                        [anchor, sm, transition, generation] {
+                            FSM11STD::lock_guard<FSM11STD::mutex> lock(
+                                        anchor->mutex);
+                            if (anchor->alive)
+                                sm->dispatchTimeout(transition, generation);
+                        });
+        }
+    }
+
+    //! Disarms the timeouts of the transitions whose source is the \p state.
+    void disarmTimeouts(state_type& state) noexcept
+    {
+        for (auto iter = state.beginTransitions();
+             iter != state.endTransitions(); ++iter)
+        {
+            TransitionTimeout* timeout = iter->timeout();
+            if (!timeout)
+                continue;
+
+            timeout->handle.cancel();
+            timeout->handle = TimerHandle();
+            ++timeout->generation;
+            timeout->expired = false;
+        }
+    }
+
+    //! \brief Detaches the timers from the state machine.
+    //!
+    //! Timers which expire after this call do not access the state machine
+    //! any longer. A timer which is accessing it right now, is waited for.
+    void detachTimers() noexcept
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_anchor->mutex);
+        m_anchor->alive = false;
+    }
+
+private:
+    //! The anchor is shared between the state machine and its timers. It
+    //! tells a timer whether the state machine still exists.
+    struct Anchor
+    {
+        FSM11STD::mutex mutex;
+        bool alive{true};
+    };
+
+    //! The timer service or a null-pointer, if the process-wide service
+    //! has not been requested, yet.
+    timer_service_type* m_timerService;
+    FSM11STD::shared_ptr<Anchor> m_anchor;
+
+    derived_type& derived()
+    {
+        return *static_cast<derived_type*>(this);
+    }
+};
+
+template <typename TOptions>
+struct get_timers
+{
+    using type = typename FSM11STD::conditional<
+                     TOptions::timer_enable,
+                     WithTimers<TOptions>,
+                     WithoutTimers>::type;
+};
+
+} // namespace fsm11_detail
+} // namespace fsm11
+
+#endif // FSM11_DETAIL_TIMERS_HPP
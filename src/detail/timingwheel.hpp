@@ -0,0 +1,345 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_DETAIL_TIMINGWHEEL_HPP
+#define FSM11_DETAIL_TIMINGWHEEL_HPP
+
+#include "../statemachine_fwd.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/functional.hpp>
+#include <weos/memory.hpp>
+#else
+#include <functional>
+#include <memory>
+#endif // FSM11_USE_WEOS
+
+#include <cstdint>
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+
+class TimerServiceBase;
+
+//! \brief A timer in a timing wheel.
+struct TimerNode
+{
+    enum Status
+    {
+        Idle,
+        Pending,
+        Firing
+    };
+
+    //! The function which is called when the timer expires.
+    FSM11STD::function<void()> callback;
+    //! The tick at which the timer expires.
+    std::uint64_t tick{0};
+    //! The links in the wheel's slot or in the list of expired timers.
+    TimerNode* prev{nullptr};
+    TimerNode* next{nullptr};
+    unsigned char level{0};
+    unsigned char slot{0};
+    //! The status is guarded by the mutex of the timer service.
+    Status status{Idle};
+    //! The service in which the timer has been scheduled.
+    TimerServiceBase* service{nullptr};
+    //! Keeps the timer alive while it is pending or firing.
+    FSM11STD::shared_ptr<TimerNode> self;
+};
+
+//! \brief A hierarchical timing wheel.
+//!
+//! The wheel sorts timers into numLevels levels of numSlots slots. A slot
+//! in level 0 holds the timers which expire at a single tick. A slot in
+//! level L holds the timers of numSlots^L consecutive ticks. When the
+//! current tick enters the range of a slot, its timers are cascaded into
+//! the lower levels. Inserting and removing a timer are constant-time
+//! operations. The wheel is not thread-safe.
+class TimingWheel
+{
+public:
+    static constexpr unsigned slotBits = 6;
+    static constexpr unsigned numSlots = 1u << slotBits;
+    static constexpr unsigned numLevels = 4;
+
+    TimingWheel() noexcept
+    {
+        for (unsigned level = 0; level < numLevels; ++level)
+            for (unsigned slot = 0; slot < numSlots; ++slot)
+                m_slots[level][slot] = nullptr;
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    //! Returns \p true if the wheel contains no timer.
+    bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+
+    //! Returns the number of timers in the wheel.
+    std::size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    //! Returns the tick which will be processed next.
+    std::uint64_t currentTick() const noexcept
+    {
+        return m_currentTick;
+    }
+
+    //! \brief Inserts a timer.
+    //!
+    //! Inserts the \p node, which expires at <tt>node->tick</tt>. A timer
+    //! whose tick has passed already expires with the current tick.
+    inline
+    void insert(TimerNode* node) noexcept;
+
+    //! Removes the \p node from the wheel.
+    inline
+    void remove(TimerNode* node) noexcept;
+
+    //! \brief Returns the next tick which has to be processed.
+    //!
+    //! Returns the earliest tick at which a timer expires or at which
+    //! timers have to be cascaded. The wheel must not be empty.
+    inline
+    std::uint64_t nextTick() const noexcept;
+
+    //! \brief Advances the wheel.
+    //!
+    //! Processes all ticks up to and including \p tick. Returns the list of
+    //! expired timers, which is linked via their \p next pointers.
+    inline
+    TimerNode* advance(std::uint64_t tick) noexcept;
+
+    //! Removes all timers from the wheel. Returns the list of removed
+    //! timers, which is linked via their \p next pointers.
+    inline
+    TimerNode* clear() noexcept;
+
+private:
+    static constexpr std::uint64_t slotMask = numSlots - 1;
+
+    TimerNode* m_slots[numLevels][numSlots];
+    std::uint64_t m_currentTick{0};
+    std::size_t m_size{0};
+
+    //! Moves the timers of a higher-level slot into the lower levels.
+    inline
+    void cascade(unsigned level, unsigned slot) noexcept;
+
+    //! Processes the \p tick and appends the expired timers to the list
+    //! ending in \p tail.
+    inline
+    void processTick(std::uint64_t tick, TimerNode**& tail) noexcept;
+};
+
+void TimingWheel::insert(TimerNode* node) noexcept
+{
+    std::uint64_t tick = node->tick > m_currentTick ? node->tick
+                                                    : m_currentTick;
+    std::uint64_t delta = tick - m_currentTick;
+
+    unsigned level = 0;
+    while (level + 1 < numLevels
+           && delta >= (std::uint64_t(1) << (slotBits * (level + 1))))
+    {
+        ++level;
+    }
+
+    // Timers beyond the range of the wheel are put into the farthest slot
+    // and are re-inserted when this slot is cascaded.
+    std::uint64_t range = std::uint64_t(1) << (slotBits * numLevels);
+    if (delta >= range)
+        tick = m_currentTick + range - 1;
+
+    unsigned slot = (tick >> (slotBits * level)) & slotMask;
+    node->level = level;
+    node->slot = slot;
+    node->prev = nullptr;
+    node->next = m_slots[level][slot];
+    if (node->next)
+        node->next->prev = node;
+    m_slots[level][slot] = node;
+    ++m_size;
+}
+
+void TimingWheel::remove(TimerNode* node) noexcept
+{
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        m_slots[node->level][node->slot] = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+    --m_size;
+}
+
+std::uint64_t TimingWheel::nextTick() const noexcept
+{
+    std::uint64_t result = ~std::uint64_t(0);
+
+    for (unsigned count = 0; count < numSlots; ++count)
+    {
+        if (m_slots[0][(m_currentTick + count) & slotMask])
+        {
+            result = m_currentTick + count;
+            break;
+        }
+    }
+
+    // The slots of the higher levels are cascaded when the current tick
+    // enters their range. If the current tick starts the range of a slot,
+    // this slot has not been cascaded, yet.
+    for (unsigned level = 1; level < numLevels; ++level)
+    {
+        unsigned shift = slotBits * level;
+        std::uint64_t base = m_currentTick >> shift;
+        unsigned first = (m_currentTick & ((std::uint64_t(1) << shift) - 1))
+                         == 0 ? 0 : 1;
+        for (unsigned count = first; count <= numSlots; ++count)
+        {
+            if (m_slots[level][(base + count) & slotMask])
+            {
+                std::uint64_t tick = (base + count) << shift;
+                if (tick < result)
+                    result = tick;
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+TimerNode* TimingWheel::advance(std::uint64_t tick) noexcept
+{
+    TimerNode* expired = nullptr;
+    TimerNode** tail = &expired;
+
+    while (m_currentTick <= tick)
+    {
+        // Skip the ticks in which nothing happens.
+        std::uint64_t next = m_size != 0 ? nextTick() : ~std::uint64_t(0);
+        if (next > tick)
+        {
+            m_currentTick = tick + 1;
+            break;
+        }
+        if (next > m_currentTick)
+            m_currentTick = next;
+
+        processTick(m_currentTick, tail);
+        ++m_currentTick;
+    }
+
+    return expired;
+}
+
+TimerNode* TimingWheel::clear() noexcept
+{
+    TimerNode* removed = nullptr;
+    for (unsigned level = 0; level < numLevels; ++level)
+    {
+        for (unsigned slot = 0; slot < numSlots; ++slot)
+        {
+            TimerNode* node = m_slots[level][slot];
+            m_slots[level][slot] = nullptr;
+            while (node)
+            {
+                TimerNode* next = node->next;
+                node->prev = nullptr;
+                node->next = removed;
+                removed = node;
+                node = next;
+            }
+        }
+    }
+    m_size = 0;
+    return removed;
+}
+
+void TimingWheel::cascade(unsigned level, unsigned slot) noexcept
+{
+    TimerNode* node = m_slots[level][slot];
+    m_slots[level][slot] = nullptr;
+    while (node)
+    {
+        TimerNode* next = node->next;
+        --m_size;
+        insert(node);
+        node = next;
+    }
+}
+
+void TimingWheel::processTick(std::uint64_t tick, TimerNode**& tail) noexcept
+{
+    if ((tick & slotMask) == 0)
+    {
+        for (unsigned level = 1; level < numLevels; ++level)
+        {
+            unsigned slot = (tick >> (slotBits * level)) & slotMask;
+            cascade(level, slot);
+            if (slot != 0)
+                break;
+        }
+    }
+
+    TimerNode* node = m_slots[0][tick & slotMask];
+    m_slots[0][tick & slotMask] = nullptr;
+    while (node)
+    {
+        TimerNode* next = node->next;
+        --m_size;
+        if (node->tick <= tick)
+        {
+            node->prev = nullptr;
+            node->next = nullptr;
+            *tail = node;
+            tail = &node->next;
+        }
+        else
+        {
+            // A timer which has been beyond the range of the wheel.
+            insert(node);
+        }
+        node = next;
+    }
+}
+
+} // namespace fsm11_detail
+} // namespace fsm11
+
+#endif // FSM11_DETAIL_TIMINGWHEEL_HPP
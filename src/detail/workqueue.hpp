@@ -0,0 +1,163 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_DETAIL_WORKQUEUE_HPP
+#define FSM11_DETAIL_WORKQUEUE_HPP
+
+#ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/mutex.hpp>
+#else
+#include <atomic>
+#include <mutex>
+#endif // FSM11_USE_WEOS
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+
+//! \brief The queue of a worker.
+//!
+//! A WorkQueue is owned by a worker of a thread pool or an executor. It
+//! is an intrusive FIFO of nodes, which are linked through their member
+//! \p m_next. The owner and the thieves both take the oldest node, so the
+//! nodes of a queue are started in the order in which they have been
+//! pushed. Pushing and taking a node is O(1) and never allocates memory.
+//!
+//! Every queue has a mutex of its own, which is contended only if a thief
+//! and the owner access the same queue. Whether a queue is empty can be
+//! checked without taking the lock.
+template <typename TNode>
+class WorkQueue
+{
+public:
+    WorkQueue() = default;
+
+    WorkQueue(const WorkQueue&) = delete;
+    WorkQueue& operator=(const WorkQueue&) = delete;
+
+    //! Appends the \p node to the queue.
+    void push(TNode* node) noexcept
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        node->m_next = nullptr;
+        if (m_tail)
+            m_tail->m_next = node;
+        else
+            m_head = node;
+        m_tail = node;
+        ++m_size;
+    }
+
+    //! Takes the oldest node from the queue. Returns a null-pointer if the
+    //! queue is empty.
+    TNode* pop() noexcept
+    {
+        return pop([](TNode*) { return false; });
+    }
+
+    //! \brief Takes the oldest node and requeues it on demand.
+    //!
+    //! Takes the oldest node from the queue and calls \p requeue with it
+    //! while the queue is still locked. If the function returns \p true,
+    //! the node is appended to the queue again. Returns the node or a
+    //! null-pointer if the queue is empty.
+    template <typename TFunction>
+    TNode* pop(TFunction&& requeue) noexcept
+    {
+        if (m_size == 0)
+            return nullptr;
+
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        TNode* node = m_head;
+        if (!node)
+            return nullptr;
+
+        m_head = node->m_next;
+        if (!m_head)
+            m_tail = nullptr;
+        node->m_next = nullptr;
+        if (requeue(node))
+        {
+            if (m_tail)
+                m_tail->m_next = node;
+            else
+                m_head = node;
+            m_tail = node;
+        }
+        else
+        {
+            --m_size;
+        }
+        return node;
+    }
+
+    //! Removes the \p node from the queue, if it is contained. The queue
+    //! is searched linearly.
+    void remove(TNode* node) noexcept
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        TNode* prev = nullptr;
+        for (TNode* iter = m_head; iter; prev = iter, iter = iter->m_next)
+        {
+            if (iter != node)
+                continue;
+
+            if (prev)
+                prev->m_next = node->m_next;
+            else
+                m_head = node->m_next;
+            if (m_tail == node)
+                m_tail = prev;
+            node->m_next = nullptr;
+            --m_size;
+            return;
+        }
+    }
+
+    //! Returns \p true, if the queue is empty. The result may be outdated
+    //! as soon as it is returned.
+    bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+
+private:
+    FSM11STD::mutex m_mutex;
+    TNode* m_head{nullptr};
+    TNode* m_tail{nullptr};
+    //! The number of nodes. It is modified with the mutex locked but can
+    //! be read without.
+    FSM11STD::atomic<std::size_t> m_size{0};
+};
+
+} // namespace fsm11_detail
+} // namespace fsm11
+
+#endif // FSM11_DETAIL_WORKQUEUE_HPP
@@ -43,7 +43,8 @@ enum class ErrorCode
 {
     InvalidStateRelationship = 1,
     TransitionConflict = 2,
-    ThreadPoolUnderflow = 3
+    ThreadPoolUnderflow = 3,
+    EventListOverflow = 4
 };
 
 const FSM11STD::error_category& fsm11_category() noexcept;
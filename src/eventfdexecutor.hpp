@@ -0,0 +1,192 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_EVENTFDEXECUTOR_HPP
+#define FSM11_EVENTFDEXECUTOR_HPP
+
+#include "statemachine_fwd.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <utility>
+
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#else
+#include <fcntl.h>
+#endif // __linux__
+
+namespace fsm11
+{
+
+//! \brief An executor for reactors.
+//!
+//! The EventFdExecutor integrates state machines with an epoll-, poll- or
+//! io_uring-based event loop. It queues the posted tasks and exposes a
+//! file descriptor, which becomes readable when tasks are pending. The
+//! reactor watches the descriptor and calls runPending() when it is
+//! readable. The tasks are then run in the reactor's thread. On Linux,
+//! the descriptor is an eventfd, on other POSIX systems the read end of
+//! a pipe.
+//!
+//! An asynchronous state machine, which uses this executor, posts a
+//! single drain task when an event arrives while it is idle. Thus, one
+//! executor can serve a group of state machines and the descriptor is
+//! signalled only once for a burst of events.
+class EventFdExecutor
+{
+public:
+    using task_type = std::function<void()>;
+
+    //! \brief Creates an executor.
+    //!
+    //! Throws a std::system_error if the file descriptor cannot be
+    //! created.
+    EventFdExecutor()
+    {
+#if defined(__linux__)
+        m_readFd = m_writeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_readFd < 0)
+            throw std::system_error(errno, std::system_category());
+#else
+        int fds[2];
+        if (::pipe(fds) != 0)
+            throw std::system_error(errno, std::system_category());
+        for (int fd : fds)
+        {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        m_readFd = fds[0];
+        m_writeFd = fds[1];
+#endif // __linux__
+    }
+
+    EventFdExecutor(const EventFdExecutor&) = delete;
+    EventFdExecutor& operator=(const EventFdExecutor&) = delete;
+
+    //! Closes the file descriptor. Pending tasks are dropped.
+    ~EventFdExecutor()
+    {
+        ::close(m_readFd);
+        if (m_writeFd != m_readFd)
+            ::close(m_writeFd);
+    }
+
+    //! Returns the file descriptor, which is readable when tasks are
+    //! pending.
+    int fd() const noexcept
+    {
+        return m_readFd;
+    }
+
+    //! \brief Posts a task.
+    //!
+    //! Queues the \p task. The file descriptor is signalled if no other
+    //! task has been pending. The task must not throw.
+    void post(task_type task)
+    {
+        bool signal;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            signal = m_tasks.empty();
+            m_tasks.push_back(std::move(task));
+        }
+        if (signal)
+            this->signal();
+    }
+
+    //! \brief Runs the pending tasks.
+    //!
+    //! Resets the file descriptor and runs the tasks, which are pending, in
+    //! the calling thread. Tasks, which are posted in the meantime, are
+    //! left for the next call and signal the descriptor again. Returns the
+    //! number of tasks, which have been run.
+    std::size_t runPending()
+    {
+        // The descriptor has to be reset before the tasks are taken.
+        // Otherwise, the signal of a task which is posted in between would
+        // be lost.
+        clear();
+
+        std::deque<task_type> tasks;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            tasks.swap(m_tasks);
+        }
+
+        for (auto& task : tasks)
+            task();
+        return tasks.size();
+    }
+
+private:
+    int m_readFd;
+    int m_writeFd;
+    std::mutex m_mutex;
+    std::deque<task_type> m_tasks;
+
+    void signal() noexcept
+    {
+#if defined(__linux__)
+        std::uint64_t value = 1;
+#else
+        char value = 1;
+#endif // __linux__
+        // A full pipe or a saturated eventfd is readable already.
+        while (::write(m_writeFd, &value, sizeof(value)) < 0 && errno == EINTR)
+        {
+        }
+    }
+
+    void clear() noexcept
+    {
+#if defined(__linux__)
+        std::uint64_t value;
+        while (::read(m_readFd, &value, sizeof(value)) < 0 && errno == EINTR)
+        {
+        }
+#else
+        char buffer[64];
+        ssize_t result;
+        do
+        {
+            result = ::read(m_readFd, buffer, sizeof(buffer));
+        } while (result > 0 || (result < 0 && errno == EINTR));
+#endif // __linux__
+    }
+};
+
+} // namespace fsm11
+
+#endif // FSM11_EVENTFDEXECUTOR_HPP
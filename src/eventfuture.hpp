@@ -0,0 +1,391 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_EVENTFUTURE_HPP
+#define FSM11_EVENTFUTURE_HPP
+
+#include "statemachine_fwd.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/chrono.hpp>
+#include <weos/condition_variable.hpp>
+#include <weos/mutex.hpp>
+#else
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#endif // FSM11_USE_WEOS
+
+#include <cstddef>
+
+namespace fsm11
+{
+
+//! The outcome of an event, which has been added with a completion.
+enum class EventStatus
+{
+    //! The event has not been dispatched, yet.
+    Pending,
+    //! The event has triggered at least one transition.
+    Taken,
+    //! The event has been dispatched but no transition has been enabled.
+    Discarded,
+    //! The event has been removed from the event list without being
+    //! dispatched. This happens when the event list overflows or the
+    //! state machine is destroyed.
+    Dropped,
+    //! The deadline of the event has passed before it could be dispatched.
+    Expired,
+    //! The dispatch of the event has thrown an exception.
+    Error
+};
+
+namespace fsm11_detail
+{
+
+class EventCompletionPool;
+
+//! \brief The shared state of an EventFuture.
+//!
+//! A completion is referenced by the future and by the state machine, as
+//! long as the event has not been dispatched. When the last reference is
+//! dropped, the completion is returned to its pool.
+class EventCompletion
+{
+public:
+    EventCompletion(EventCompletionPool* pool) noexcept
+        : m_pool(pool)
+    {
+    }
+
+    EventCompletion(const EventCompletion&) = delete;
+    EventCompletion& operator=(const EventCompletion&) = delete;
+
+    //! Sets the \p status and the number of configuration changes and
+    //! wakes up the waiting threads.
+    void complete(EventStatus status, unsigned numConfigurationChanges)
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        m_numConfigurationChanges = numConfigurationChanges;
+        m_status = status;
+        m_completed.notify_all();
+    }
+
+    EventStatus status() const
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        return m_status;
+    }
+
+    void wait() const
+    {
+        FSM11STD::unique_lock<FSM11STD::mutex> lock(m_mutex);
+        m_completed.wait(lock,
+                         [this] { return m_status != EventStatus::Pending; });
+    }
+
+    template <typename TRep, typename TPeriod>
+    bool waitFor(const FSM11STD::chrono::duration<TRep, TPeriod>& timeout) const
+    {
+        FSM11STD::unique_lock<FSM11STD::mutex> lock(m_mutex);
+        return m_completed.wait_for(
+                   lock, timeout,
+                   [this] { return m_status != EventStatus::Pending; });
+    }
+
+    unsigned numConfigurationChanges() const
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        return m_numConfigurationChanges;
+    }
+
+    void addRef() noexcept
+    {
+        m_refCount.fetch_add(1, FSM11STD::memory_order_relaxed);
+    }
+
+    //! Drops a reference. The last reference returns the completion to
+    //! its pool.
+    inline void release() noexcept;
+
+    //! The sequence number of the event in the event list.
+    std::size_t m_sequence{0};
+    //! The next completion in the pool's free list or in the list of
+    //! pending completions.
+    EventCompletion* m_next{nullptr};
+
+private:
+    mutable FSM11STD::mutex m_mutex;
+    mutable FSM11STD::condition_variable m_completed;
+    EventStatus m_status{EventStatus::Pending};
+    unsigned m_numConfigurationChanges{0};
+    FSM11STD::atomic_int m_refCount{0};
+    EventCompletionPool* m_pool;
+
+    friend class EventCompletionPool;
+};
+
+//! \brief A pool of completions.
+//!
+//! Completions are recycled, such that adding an event with a completion
+//! does not allocate memory once the pool has grown to the number of
+//! outstanding futures. The pool is referenced by its owner and by every
+//! completion, which has been handed out. Thus, a future may outlive the
+//! state machine.
+class EventCompletionPool
+{
+public:
+    EventCompletionPool() = default;
+
+    EventCompletionPool(const EventCompletionPool&) = delete;
+    EventCompletionPool& operator=(const EventCompletionPool&) = delete;
+
+    //! Returns a pending completion with a single reference.
+    EventCompletion* acquire()
+    {
+        EventCompletion* completion;
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+            completion = m_freeList;
+            if (completion)
+                m_freeList = completion->m_next;
+        }
+        if (!completion)
+            completion = new EventCompletion(this);
+
+        completion->m_status = EventStatus::Pending;
+        completion->m_numConfigurationChanges = 0;
+        completion->m_next = nullptr;
+        completion->m_refCount.store(1, FSM11STD::memory_order_relaxed);
+        m_refCount.fetch_add(1, FSM11STD::memory_order_relaxed);
+        return completion;
+    }
+
+    //! Drops a reference. The last reference deletes the pool.
+    void release() noexcept
+    {
+        if (m_refCount.fetch_sub(1, FSM11STD::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+private:
+    FSM11STD::mutex m_mutex;
+    EventCompletion* m_freeList{nullptr};
+    //! The owner holds the initial reference.
+    FSM11STD::atomic_int m_refCount{1};
+
+    ~EventCompletionPool()
+    {
+        while (m_freeList)
+        {
+            EventCompletion* next = m_freeList->m_next;
+            delete m_freeList;
+            m_freeList = next;
+        }
+    }
+
+    void recycle(EventCompletion* completion) noexcept
+    {
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+            completion->m_next = m_freeList;
+            m_freeList = completion;
+        }
+        release();
+    }
+
+    friend class EventCompletion;
+};
+
+void EventCompletion::release() noexcept
+{
+    if (m_refCount.fetch_sub(1, FSM11STD::memory_order_acq_rel) == 1)
+        m_pool->recycle(this);
+}
+
+//! \brief The state machine's reference to a completion.
+//!
+//! Completes the referenced completion with EventStatus::Error, unless
+//! complete() has been called before the handle is destroyed.
+class EventCompletionHandle
+{
+public:
+    explicit EventCompletionHandle(EventCompletion* completion) noexcept
+        : m_completion(completion)
+    {
+    }
+
+    EventCompletionHandle(const EventCompletionHandle&) = delete;
+    EventCompletionHandle& operator=(const EventCompletionHandle&) = delete;
+
+    ~EventCompletionHandle()
+    {
+        if (m_completion)
+            complete(EventStatus::Error, m_numConfigurationChanges);
+    }
+
+    //! Sets the number of configuration changes, which is reported, if
+    //! the handle is destroyed without completing.
+    void setNumConfigurationChanges(unsigned numConfigurationChanges) noexcept
+    {
+        m_numConfigurationChanges = numConfigurationChanges;
+    }
+
+    void complete(EventStatus status, unsigned numConfigurationChanges)
+    {
+        if (!m_completion)
+            return;
+        m_completion->complete(status, numConfigurationChanges);
+        m_completion->release();
+        m_completion = nullptr;
+    }
+
+private:
+    EventCompletion* m_completion;
+    unsigned m_numConfigurationChanges{0};
+};
+
+} // namespace fsm11_detail
+
+//! \brief A future for the outcome of an event.
+//!
+//! An EventFuture is returned by addEventWithCompletion(). It becomes ready
+//! after the macrostep of the event has been completed or the event has
+//! been dropped or has expired. The future provides the EventStatus and
+//! the number of configuration changes of the state machine after the
+//! macrostep.
+//!
+//! In contrast to a std::future, an EventFuture does not allocate memory
+//! as its shared state is taken from a pool, which belongs to the state
+//! machine. The future may outlive the state machine.
+class EventFuture
+{
+public:
+    //! Creates an invalid future.
+    EventFuture() noexcept
+        : m_completion(nullptr)
+    {
+    }
+
+    //! \cond
+    explicit EventFuture(fsm11_detail::EventCompletion* completion) noexcept
+        : m_completion(completion)
+    {
+    }
+    //! \endcond
+
+    EventFuture(EventFuture&& other) noexcept
+        : m_completion(other.m_completion)
+    {
+        other.m_completion = nullptr;
+    }
+
+    EventFuture& operator=(EventFuture&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_completion)
+                m_completion->release();
+            m_completion = other.m_completion;
+            other.m_completion = nullptr;
+        }
+        return *this;
+    }
+
+    EventFuture(const EventFuture&) = delete;
+    EventFuture& operator=(const EventFuture&) = delete;
+
+    ~EventFuture()
+    {
+        if (m_completion)
+            m_completion->release();
+    }
+
+    //! Returns \p true, if the future refers to an event.
+    bool valid() const noexcept
+    {
+        return m_completion != nullptr;
+    }
+
+    //! Returns \p true, if the event has been dispatched, dropped or has
+    //! expired.
+    bool ready() const
+    {
+        return status() != EventStatus::Pending;
+    }
+
+    //! Returns the status of the event without blocking.
+    EventStatus status() const
+    {
+        FSM11_ASSERT(valid());
+        return m_completion->status();
+    }
+
+    //! Waits until the future is ready.
+    void wait() const
+    {
+        FSM11_ASSERT(valid());
+        m_completion->wait();
+    }
+
+    //! Waits until the future is ready or the \p timeout has expired.
+    //! Returns \p true, if the future is ready.
+    template <typename TRep, typename TPeriod>
+    bool waitFor(const FSM11STD::chrono::duration<TRep, TPeriod>& timeout) const
+    {
+        FSM11_ASSERT(valid());
+        return m_completion->waitFor(timeout);
+    }
+
+    //! Waits until the future is ready and returns the status of the event.
+    EventStatus get() const
+    {
+        wait();
+        return m_completion->status();
+    }
+
+    //! \brief Returns the number of configuration changes.
+    //!
+    //! Waits until the future is ready and returns the number of
+    //! configuration changes, which the state machine has performed
+    //! after the macrostep of the event.
+    unsigned numConfigurationChanges() const
+    {
+        wait();
+        return m_completion->numConfigurationChanges();
+    }
+
+private:
+    fsm11_detail::EventCompletion* m_completion;
+};
+
+} // namespace fsm11
+
+#endif // FSM11_EVENTFUTURE_HPP
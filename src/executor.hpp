@@ -0,0 +1,378 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_EXECUTOR_HPP
+#define FSM11_EXECUTOR_HPP
+
+#include "statemachine_fwd.hpp"
+#include "threadattributes.hpp"
+#include "threadpool.hpp"
+#include "detail/scopeguard.hpp"
+#include "detail/threadedstatebase.hpp"
+#include "detail/workqueue.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/condition_variable.hpp>
+#include <weos/functional.hpp>
+#include <weos/memory.hpp>
+#include <weos/mutex.hpp>
+#include <weos/thread.hpp>
+#include <weos/utility.hpp>
+#else
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#endif // FSM11_USE_WEOS
+
+#include <deque>
+#include <vector>
+
+namespace fsm11
+{
+
+//! \brief An executor for many state machines.
+//!
+//! The Executor runs the event dispatching of asynchronous state machines
+//! in a fixed set of worker threads. A state machine, which has been
+//! attached to an executor with setExecutor(), does not need an event loop
+//! thread of its own. When an event, a start or a stop request arrives at
+//! an idle machine, the machine posts a single drain task to the executor.
+//! The task dispatches a bounded batch of events and re-posts itself if
+//! more events are pending. Thus, a machine is never drained by two
+//! workers at the same time and a busy machine cannot starve the others.
+//!
+//! Every worker owns a queue of tasks. A task posted by a worker is pushed
+//! into the worker's own queue, a task posted by another thread is
+//! distributed round-robin. An idle worker steals the oldest tasks from the
+//! queues of the other workers. The queues are the same as the ones of the
+//! ThreadPool.
+class Executor
+{
+public:
+    using task_type = FSM11STD::function<void()>;
+
+    //! Creates an executor with \p numWorkers workers, which are created
+    //! with the thread attributes \p attrs.
+#ifdef FSM11_USE_WEOS
+    explicit Executor(std::size_t numWorkers,
+                      const ThreadAttributes& attrs = ThreadAttributes())
+#else
+    explicit Executor(std::size_t numWorkers
+                          = FSM11STD::max(1u, FSM11STD::thread::hardware_concurrency()),
+                      const ThreadAttributes& attrs = ThreadAttributes())
+#endif // FSM11_USE_WEOS
+        : m_workers(numWorkers > 0 ? numWorkers : 1)
+    {
+        try
+        {
+            for (std::size_t idx = 0; idx < m_workers.size(); ++idx)
+            {
+                m_workers[idx].thread = fsm11_detail::makeThread(
+                                            attrs, &Executor::work, this, idx);
+            }
+        }
+        catch (...)
+        {
+            shutdown();
+            throw;
+        }
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    //! \brief Destroys the executor.
+    //!
+    //! The tasks which have been posted are run before the workers exit.
+    //! All state machines, which use the executor, must have been destroyed
+    //! before.
+    ~Executor()
+    {
+        shutdown();
+    }
+
+    //! Returns the number of workers.
+    std::size_t size() const noexcept
+    {
+        return m_workers.size();
+    }
+
+    //! \brief Posts a task.
+    //!
+    //! Posts the \p task to one of the workers. The task must not throw.
+    void post(task_type task)
+    {
+        Node* node = new Node(FSM11STD::move(task));
+        m_workers[selectWorker()].tasks.push(node);
+
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+            ++m_numTasks;
+        }
+        m_cv.notify_one();
+    }
+
+private:
+    //! A task in the queue of a worker.
+    struct Node
+    {
+        explicit Node(task_type&& task)
+            : task(FSM11STD::move(task))
+        {
+        }
+
+        task_type task;
+        Node* m_next{nullptr};
+    };
+
+    struct Worker
+    {
+        fsm11_detail::WorkQueue<Node> tasks;
+        fsm11_detail::Thread thread;
+    };
+
+    std::vector<Worker> m_workers;
+    //! The distribution of tasks posted by other threads.
+    FSM11STD::atomic<std::size_t> m_nextWorker{0};
+
+    //! Guards the number of tasks and the stop flag.
+    FSM11STD::mutex m_mutex;
+    //! Signals that a task has been posted or that the executor stops.
+    FSM11STD::condition_variable m_cv;
+    std::size_t m_numTasks{0};
+    bool m_stopped{false};
+
+    //! Returns the index of the worker, which gets a new task.
+    std::size_t selectWorker() noexcept
+    {
+        FSM11STD::thread::id id = FSM11STD::this_thread::get_id();
+        for (std::size_t idx = 0; idx < m_workers.size(); ++idx)
+            if (m_workers[idx].thread.get_id() == id)
+                return idx;
+        return m_nextWorker++ % m_workers.size();
+    }
+
+    //! Takes the oldest task from the queue of the worker \p idx or
+    //! steals the oldest task of another worker. Returns a null-pointer if
+    //! all queues are empty.
+    Node* popTask(std::size_t idx) noexcept
+    {
+        for (std::size_t count = 0; count < m_workers.size(); ++count)
+        {
+            Worker& worker = m_workers[(idx + count) % m_workers.size()];
+            if (Node* node = worker.tasks.pop())
+                return node;
+        }
+        return nullptr;
+    }
+
+    void work(std::size_t idx)
+    {
+        while (true)
+        {
+            {
+                FSM11STD::unique_lock<FSM11STD::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_numTasks != 0 || m_stopped; });
+                if (m_numTasks == 0)
+                    return;
+                --m_numTasks;
+            }
+
+            // The counter has been decremented, so one of the queues holds
+            // a task for us. It might be taken by a thief in the meantime
+            // but then the thief's own task is left for us.
+            Node* node;
+            while ((node = popTask(idx)) == nullptr)
+                FSM11STD::this_thread::yield();
+            FSM11STD::unique_ptr<Node> guard(node);
+            node->task();
+        }
+    }
+
+    void shutdown() noexcept
+    {
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_cv.notify_all();
+
+        for (auto& worker : m_workers)
+            if (worker.thread.joinable())
+                worker.thread.join();
+    }
+};
+
+//! \brief An executor which runs the tasks in the posting thread.
+//!
+//! The InlineExecutor runs a task immediately in post(). A task, which is
+//! posted while another task is running, is deferred until the running
+//! task has returned. Thus, a state machine which re-posts its drain task
+//! does not grow the stack. The InlineExecutor is meant for a single
+//! thread, for example the thread of a reactor, which adds the events to
+//! the state machines. It must not be used by several threads at the
+//! same time.
+class InlineExecutor
+{
+public:
+    using task_type = FSM11STD::function<void()>;
+
+    InlineExecutor() = default;
+
+    InlineExecutor(const InlineExecutor&) = delete;
+    InlineExecutor& operator=(const InlineExecutor&) = delete;
+
+    //! Runs the \p task.
+    template <typename TTask>
+    void post(TTask&& task)
+    {
+        if (m_running)
+        {
+            m_deferred.emplace_back(FSM11STD::forward<TTask>(task));
+            return;
+        }
+
+        m_running = true;
+        FSM11_SCOPE_EXIT { m_running = false; };
+        task();
+        while (!m_deferred.empty())
+        {
+            task_type deferred = FSM11STD::move(m_deferred.front());
+            m_deferred.pop_front();
+            deferred();
+        }
+    }
+
+private:
+    bool m_running{false};
+    std::deque<task_type> m_deferred;
+};
+
+//! \brief An executor which runs the tasks in a thread pool.
+//!
+//! The ThreadPoolExecutor adapts a ThreadPool or a DynamicThreadPool to the
+//! executor interface. The tasks are queued in the pool like the invoke
+//! actions of threaded states. The pool must outlive all state machines,
+//! which use the executor.
+//!
+//! A task, which is still queued when the pool is shut down, is dropped
+//! without being run. If the task has a member function <tt>cancel()</tt>,
+//! this function is called instead. It must not throw.
+template <typename TThreadPool>
+class ThreadPoolExecutor
+{
+public:
+    using task_type = FSM11STD::function<void()>;
+
+    //! Creates an executor, which posts to the thread \p pool.
+    explicit ThreadPoolExecutor(TThreadPool& pool) noexcept
+        : m_pool(pool)
+    {
+    }
+
+    //! Queues the \p task in the thread pool.
+    template <typename TTask>
+    void post(TTask&& task)
+    {
+        task_type onCancel = makeCancelHandler(task, 0);
+        PostedTask* posted = new PostedTask(
+                                 task_type(FSM11STD::forward<TTask>(task)),
+                                 FSM11STD::move(onCancel));
+        try
+        {
+            m_pool.enqueue(*posted);
+        }
+        catch (...)
+        {
+            delete posted;
+            throw;
+        }
+    }
+
+private:
+    //! A task is queued in the pool in the guise of a threaded state,
+    //! which deletes itself when it is finished.
+    class PostedTask : public fsm11_detail::ThreadedStateBase
+    {
+    public:
+        PostedTask(task_type&& task, task_type&& onCancel)
+            : m_task(FSM11STD::move(task)),
+              m_onCancel(FSM11STD::move(onCancel))
+        {
+        }
+
+        virtual void invoke(ExitRequest&) override
+        {
+            m_task();
+        }
+
+    protected:
+        virtual void invokeFinished(FSM11STD::exception_ptr&) noexcept override
+        {
+            delete this;
+        }
+
+        virtual void invokeCancelled() noexcept override
+        {
+            if (m_onCancel)
+                m_onCancel();
+            delete this;
+        }
+
+    private:
+        task_type m_task;
+        task_type m_onCancel;
+    };
+
+    //! Returns a function, which calls the cancel() member of \p task.
+    template <typename TTask>
+    static auto makeCancelHandler(const TTask& task, int)
+        -> decltype(task.cancel(), task_type())
+    {
+        return [task] { task.cancel(); };
+    }
+
+    //! Returns an empty function for a \p task without cancel() member.
+    template <typename TTask>
+    static task_type makeCancelHandler(const TTask&, long)
+    {
+        return task_type();
+    }
+
+    TThreadPool& m_pool;
+};
+
+} // namespace fsm11
+
+#endif // FSM11_EXECUTOR_HPP
@@ -32,10 +32,12 @@
 #include "statemachine_fwd.hpp"
 
 #ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
 #include <weos/chrono.hpp>
 #include <weos/condition_variable.hpp>
 #include <weos/mutex.hpp>
 #else
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <mutex>
@@ -44,11 +46,18 @@
 namespace fsm11
 {
 
+//! \brief A request to leave an invoke action.
+//!
+//! The request is a plain atomic flag, which can be polled without taking
+//! a lock. Only threads which block in wait() or waitFor() register with
+//! the request's mutex, so the state machine needs the mutex only if
+//! somebody is actually waiting.
 class ExitRequest
 {
 public:
     ExitRequest()
-        : m_requested(false)
+        : m_requested(false),
+          m_numWaiters(0)
     {
     }
 
@@ -58,8 +67,13 @@ public:
     //! Waits for an exit request.
     void wait()
     {
+        if (m_requested.load(FSM11STD::memory_order_acquire))
+            return;
+
         FSM11STD::unique_lock<FSM11STD::mutex> lock(m_mutex);
-        m_cv.wait(lock, [&] { return m_requested; });
+        ++m_numWaiters;
+        m_cv.wait(lock, [&] { return m_requested.load(); });
+        --m_numWaiters;
     }
 
     //! Waits for an exit request with a timeout.
@@ -68,8 +82,15 @@ public:
     template <typename TRep, typename TPeriod>
     bool waitFor(const FSM11STD::chrono::duration<TRep, TPeriod>& timeout)
     {
+        if (m_requested.load(FSM11STD::memory_order_acquire))
+            return true;
+
         FSM11STD::unique_lock<FSM11STD::mutex> lock(m_mutex);
-        return m_cv.wait_for(lock, timeout, [&] { return m_requested; });
+        ++m_numWaiters;
+        bool requested = m_cv.wait_for(lock, timeout, [&] {
+            return m_requested.load(); });
+        --m_numWaiters;
+        return requested;
     }
 
     //! Checks if an exit has been requested.
@@ -77,16 +98,41 @@ public:
     //! Returns \p true if an exit has been requested.
     explicit operator bool() const
     {
-        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
-        return m_requested;
+        return m_requested.load(FSM11STD::memory_order_acquire);
     }
 
 private:
-    mutable FSM11STD::mutex m_mutex;
+    FSM11STD::atomic_bool m_requested;
+    //! The number of threads blocked in wait() or waitFor().
+    FSM11STD::atomic<unsigned> m_numWaiters;
+    FSM11STD::mutex m_mutex;
     FSM11STD::condition_variable m_cv;
-    bool m_requested;
 
 
+    //! Clears the request before the invoke action is started.
+    void reset()
+    {
+        m_requested.store(false, FSM11STD::memory_order_relaxed);
+    }
+
+    //! Requests the invoke action to exit and wakes up all waiters.
+    void request()
+    {
+        // The sequentially consistent store and load pair with the
+        // increment of m_numWaiters and the check of the flag in the
+        // waiting thread. Either the waiter sees the flag or we see the
+        // waiter.
+        m_requested.store(true);
+        if (m_numWaiters.load() != 0)
+        {
+            // Lock the mutex so that the notification cannot slip in
+            // between the waiter's check of the flag and its going to sleep.
+            m_mutex.lock();
+            m_mutex.unlock();
+            m_cv.notify_all();
+        }
+    }
+
     template <typename TStateMachine>
     friend class ThreadedState;
 
@@ -59,6 +59,8 @@ public:
             return "Transition conflict";
         case ErrorCode::ThreadPoolUnderflow:
             return "Thread pool underflow";
+        case ErrorCode::EventListOverflow:
+            return "Event list overflow";
         default:
             return "Unkown error";
         }
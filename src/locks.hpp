@@ -0,0 +1,244 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_LOCKS_HPP
+#define FSM11_LOCKS_HPP
+
+#include "statemachine_fwd.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/atomic.hpp>
+#include <weos/thread.hpp>
+#else
+#include <atomic>
+#include <thread>
+#endif // FSM11_USE_WEOS
+
+#if defined(__linux__) && !defined(FSM11_USE_WEOS)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // __linux__
+
+namespace fsm11
+{
+namespace fsm11_detail
+{
+
+//! Tells the CPU that the calling thread is spinning.
+inline
+void cpuRelax() noexcept
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && (defined(__arm__) || defined(__aarch64__))
+    __asm__ __volatile__("yield");
+#endif
+}
+
+} // namespace fsm11_detail
+
+//! \brief A test-and-test-and-set spin lock.
+//!
+//! The SpinLock is a Lockable for very short critical sections. A thread,
+//! which finds the lock taken, spins on a plain load until the lock looks
+//! free and only then tries to take it. Thus, the waiting threads do not
+//! bounce the cache line between each other. After spinning for a while,
+//! the thread yields the CPU.
+//!
+//! The SpinLock can be used as the lock of a state machine (see LockType).
+class SpinLock
+{
+public:
+    SpinLock() noexcept
+        : m_locked(false)
+    {
+    }
+
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+
+    void lock() noexcept
+    {
+        while (m_locked.exchange(true, FSM11STD::memory_order_acquire))
+        {
+            unsigned numSpins = 0;
+            while (m_locked.load(FSM11STD::memory_order_relaxed))
+            {
+                if (++numSpins < max_spins)
+                {
+                    fsm11_detail::cpuRelax();
+                }
+                else
+                {
+                    numSpins = 0;
+                    FSM11STD::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    bool try_lock() noexcept
+    {
+        return !m_locked.load(FSM11STD::memory_order_relaxed)
+               && !m_locked.exchange(true, FSM11STD::memory_order_acquire);
+    }
+
+    void unlock() noexcept
+    {
+        m_locked.store(false, FSM11STD::memory_order_release);
+    }
+
+private:
+    static constexpr unsigned max_spins = 1024;
+
+    FSM11STD::atomic_bool m_locked;
+};
+
+//! \brief A mutex, which spins before it blocks.
+//!
+//! The AdaptiveMutex spins for a short while, when it finds the lock
+//! taken. If the lock does not become free, the thread goes to sleep.
+//! Thus, short critical sections are handled without a context switch and
+//! long ones do not burn CPU time. On Linux, the sleeping threads wait on
+//! a futex. The unlocking thread only enters the kernel, if there are
+//! sleeping threads. On other systems, the threads yield the CPU instead
+//! of sleeping.
+//!
+//! The AdaptiveMutex can be used as the lock of a state machine (see
+//! LockType).
+class AdaptiveMutex
+{
+public:
+    //! Creates a mutex, which spins \p spinCount times before it blocks.
+    explicit AdaptiveMutex(unsigned spinCount = 100) noexcept
+        : m_state(Unlocked),
+          m_spinCount(spinCount)
+    {
+    }
+
+    AdaptiveMutex(const AdaptiveMutex&) = delete;
+    AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
+    void lock() noexcept
+    {
+        int state = Unlocked;
+        if (m_state.compare_exchange_strong(state, Locked,
+                                            FSM11STD::memory_order_acquire))
+        {
+            return;
+        }
+
+        for (unsigned count = 0; count < m_spinCount; ++count)
+        {
+            fsm11_detail::cpuRelax();
+            state = m_state.load(FSM11STD::memory_order_relaxed);
+            if (state == Unlocked
+                && m_state.compare_exchange_weak(
+                       state, Locked, FSM11STD::memory_order_acquire))
+            {
+                return;
+            }
+        }
+
+        // Announce that there is a sleeping thread. As we cannot know if
+        // there are other sleepers, the lock is taken in the contended
+        // state from now on.
+        if (state != Contended)
+            state = m_state.exchange(Contended, FSM11STD::memory_order_acquire);
+        while (state != Unlocked)
+        {
+            wait();
+            state = m_state.exchange(Contended, FSM11STD::memory_order_acquire);
+        }
+    }
+
+    bool try_lock() noexcept
+    {
+        int state = Unlocked;
+        return m_state.compare_exchange_strong(state, Locked,
+                                               FSM11STD::memory_order_acquire);
+    }
+
+    void unlock() noexcept
+    {
+        if (m_state.exchange(Unlocked, FSM11STD::memory_order_release)
+            == Contended)
+        {
+            wake();
+        }
+    }
+
+private:
+    enum
+    {
+        Unlocked = 0,
+        Locked = 1,
+        Contended = 2
+    };
+
+    FSM11STD::atomic_int m_state;
+    unsigned m_spinCount;
+
+#if defined(__linux__) && !defined(FSM11_USE_WEOS)
+    static_assert(sizeof(FSM11STD::atomic_int) == sizeof(int),
+                  "The futex needs a plain integer.");
+
+    int* futexAddress() noexcept
+    {
+        return reinterpret_cast<int*>(&m_state);
+    }
+
+    //! Sleeps while the mutex is contended.
+    void wait() noexcept
+    {
+        ::syscall(SYS_futex, futexAddress(), FUTEX_WAIT_PRIVATE, int(Contended),
+                  nullptr, nullptr, 0);
+    }
+
+    //! Wakes up one sleeping thread.
+    void wake() noexcept
+    {
+        ::syscall(SYS_futex, futexAddress(), FUTEX_WAKE_PRIVATE, 1,
+                  nullptr, nullptr, 0);
+    }
+#else
+    void wait() noexcept
+    {
+        FSM11STD::this_thread::yield();
+    }
+
+    void wake() noexcept
+    {
+    }
+#endif // __linux__
+};
+
+} // namespace fsm11
+
+#endif // FSM11_LOCKS_HPP
@@ -30,8 +30,17 @@
 #define FSM11_OPTIONS_HPP
 
 #include "statemachine_fwd.hpp"
+#include "ringbuffer.hpp"
 #include "detail/options.hpp"
 
+#ifdef FSM11_USE_WEOS
+#include <weos/chrono.hpp>
+#include <weos/mutex.hpp>
+#else
+#include <chrono>
+#include <mutex>
+#endif // FSM11_USE_WEOS
+
 #include <deque>
 #include <memory>
 
@@ -45,6 +54,14 @@ enum TransitionConflictPolicyEnum
     ThrowException
 };
 
+enum EventListOverflowPolicyEnum
+{
+    Block,
+    Reject,
+    DropOldest,
+    DropNewest
+};
+
 namespace fsm11_detail
 {
 
@@ -52,16 +69,26 @@ struct default_options
 {
     // Types
     using event_type = int;
-    using event_list_type = std::deque<int>;
+    using event_list_type = RingBuffer<int>;
+    static constexpr std::size_t event_list_capacity = 0;
+    static constexpr EventListOverflowPolicyEnum event_list_overflow_policy = Block;
     using capture_storage = type_list<>;
+    static constexpr bool lock_free_capture_storage_enable = false;
     using transition_allocator_type = std::allocator<Transition<void>>;
+    using executor_type = Executor;
 
     // Behavior
     static constexpr bool synchronous_dispatch = true;
     static constexpr bool multithreading_enable = false;
+    using lock_type = FSM11STD::mutex;
+    static constexpr bool event_combining_enable = false;
     static constexpr TransitionConflictPolicyEnum transition_conflict_policy = Ignore;
     static constexpr bool transition_selection_stops_after_first_match = true;
     static constexpr bool threadpool_enable = false;
+    static constexpr bool asynchronous_invoke_exit_enable = false;
+    static constexpr bool persistent_event_loop_enable = false;
+    static constexpr bool timer_enable = false;
+    using timer_clock = FSM11STD::chrono::steady_clock;
 
     // Callbacks
     static constexpr bool event_callbacks_enable = false;
@@ -91,6 +118,13 @@ struct EventType
     //! \endcond
 };
 
+//! \brief Sets the event list type.
+//!
+//! Sets the type of the list, in which the events are queued until they
+//! are dispatched. The list has to provide the member functions
+//! <tt>push_back()</tt>, <tt>front()</tt>, <tt>pop_front()</tt> and
+//! <tt>empty()</tt>. The recommended event list is a RingBuffer of the
+//! event type, which is also the default for \p int events.
 template <typename TType>
 struct EventListType
 {
@@ -103,6 +137,41 @@ struct EventListType
     //! \endcond
 };
 
+//! \brief Bounds the event list.
+//!
+//! Limits the event list of an asynchronous state machine to \p TCapacity
+//! events. The event list is a ring buffer, which is allocated when the
+//! state machine is created, such that adding an event never allocates
+//! memory. A bounded event list cannot be combined with EventListType. The \p TPolicy determines what happens when an event
+//! is added to a full list:
+//! - Block: addEvent() waits until an event has been taken from the list
+//!   or the timeout set with setEventListTimeout() has expired. In the
+//!   latter case, an Error with the code ErrorCode::EventListOverflow is
+//!   thrown.
+//! - Reject: addEvent() throws an Error with the code
+//!   ErrorCode::EventListOverflow.
+//! - DropOldest: the oldest event in the list is dropped.
+//! - DropNewest: the new event is dropped.
+//!
+//! Independent of the policy, tryAddEvent() returns \p false if the list
+//! is full.
+template <std::size_t TCapacity,
+          EventListOverflowPolicyEnum TPolicy = Block>
+struct EventListCapacity
+{
+    static_assert(TCapacity > 0, "The capacity must be non-zero.");
+
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        static constexpr std::size_t event_list_capacity = TCapacity;
+        static constexpr EventListOverflowPolicyEnum event_list_overflow_policy
+                             = TPolicy;
+    };
+    //! \endcond
+};
+
 template <typename... TTypes>
 struct CaptureStorage
 {
@@ -115,6 +184,30 @@ struct CaptureStorage
     //! \endcond
 };
 
+//! \brief Enables the lock-free capture storage.
+//!
+//! By default, load() and store() of the capture storage take the lock of
+//! the state machine and the capture callback is invoked before every
+//! event. If enabled, the storage is protected by a sequence lock instead.
+//! load() returns a copy of the element, which is consistent even if
+//! another thread stores it at the same time, and loadAll() returns a
+//! consistent copy of all elements. Neither takes the lock. The capture
+//! callback is only invoked, if markCaptureStorageDirty() has been called
+//! since the last capture. Guards and actions can access the copy of the
+//! storage, which has been taken before the current event, with
+//! eventSnapshot(). All types in the storage must be trivially copyable.
+template <bool TEnable>
+struct LockFreeCaptureStorageEnable
+{
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        static constexpr bool lock_free_capture_storage_enable = TEnable;
+    };
+    //! \endcond
+};
+
 template <typename TAllocator>
 struct TransitionAllocator
 {
@@ -127,6 +220,27 @@ struct TransitionAllocator
     //! \endcond
 };
 
+//! \brief Sets the executor type.
+//!
+//! Sets the type of the executor, on which an asynchronous state machine
+//! can dispatch its events (see setExecutor()). The executor must provide
+//! a member function <tt>post(fn)</tt>, which runs the function object
+//! \p fn of type <tt>void()</tt> at some later point. Every call to post()
+//! has to run \p fn exactly once. An executor, which drops \p fn without
+//! running it, has to call <tt>fn.cancel()</tt> instead. The default is
+//! the Executor.
+template <typename TExecutor>
+struct ExecutorType
+{
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        using executor_type = TExecutor;
+    };
+    //! \endcond
+};
+
 // ----=====================================================================----
 //     Behaviour
 // ----=====================================================================----
@@ -165,6 +279,56 @@ struct MultithreadingEnable
     //! \endcond
 };
 
+//! \brief Sets the lock type.
+//!
+//! Sets the type of the lock, which protects a multithreaded state machine.
+//! The lock is taken by lock(), try_lock() and unlock() as well as
+//! internally, for example, when an event is added or the capture storage
+//! is accessed. \p TLockable can be any type, which satisfies the Lockable
+//! requirements, i.e. provides <tt>lock()</tt>, <tt>try_lock()</tt> and
+//! <tt>unlock()</tt>. The lock must not be recursive. The default is a
+//! \p mutex. For short critical sections, the SpinLock or the
+//! AdaptiveMutex may be a better choice. The option has no effect unless
+//! multithreading is enabled.
+template <typename TLockable>
+struct LockType
+{
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        using lock_type = TLockable;
+    };
+    //! \endcond
+};
+
+//! \brief Enables event combining.
+//!
+//! By default, addEvent() of a synchronous, multithreaded state machine
+//! waits until the thread, which is currently dispatching, has finished.
+//! If event combining is enabled, a thread, which adds an event while
+//! another thread dispatches, only puts the event into a lock-free queue
+//! and returns immediately. The dispatching thread drains the queue before
+//! it returns. Thus, addEvent() may return before the event has been
+//! dispatched. The events of all threads are still dispatched one at a
+//! time and in the order, in which they have been added. If a dispatch
+//! throws, the exception is thrown from the addEvent() call of the thread,
+//! which dispatches at that time, and the state machine is stopped. The
+//! events of the other threads remain in the event list. Event combining
+//! requires multithreading support. It has no effect on an asynchronous
+//! state machine.
+template <bool TEnable>
+struct EventCombiningEnable
+{
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        static constexpr bool event_combining_enable = TEnable;
+    };
+    //! \endcond
+};
+
 template <TransitionConflictPolicyEnum TPolicy>
 struct TransitionConflictPolicy
 {
@@ -205,6 +369,19 @@ struct ThreadPoolEnable<false>
     //! \endcond
 };
 
+template <>
+struct ThreadPoolEnable<true>
+{
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        static constexpr bool threadpool_enable = true;
+        static constexpr std::size_t thread_pool_size = 0;
+    };
+    //! \endcond
+};
+
 template <std::size_t TNumPools>
 struct ThreadPoolEnable<true, TNumPools>
 {
@@ -220,6 +397,67 @@ struct ThreadPoolEnable<true, TNumPools>
     //! \endcond
 };
 
+//! \brief Leaves invoke actions asynchronously.
+//!
+//! If enabled, the state machine does not wait for the invoke action of a
+//! ThreadedState when the state is left. It only requests the action to
+//! exit and proceeds. If the state is re-entered before the previous
+//! invoke action has finished, the new invocation is deferred until then.
+//! When the state machine is stopped, it waits for all invoke actions.
+//! Exceptions thrown by invoke actions are reported at this point, too.
+template <bool TEnable>
+struct AsynchronousInvokeExitEnable
+{
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        static constexpr bool asynchronous_invoke_exit_enable = TEnable;
+    };
+    //! \endcond
+};
+
+//! \brief Keeps the event loop alive after a stop.
+//!
+//! By default, the event loop of an asynchronous state machine returns
+//! as soon as the state machine is stopped. If enabled, the event loop
+//! leaves the configuration upon a stop request and waits for the next
+//! start request. Thus, a state machine can be restarted without creating
+//! a new thread. The event loop returns when shutdownEventLoop() is
+//! called or the state machine is destroyed.
+template <bool TEnable>
+struct PersistentEventLoopEnable
+{
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        static constexpr bool persistent_event_loop_enable = TEnable;
+    };
+    //! \endcond
+};
+
+//! \brief Enables timers.
+//!
+//! If enabled, the state machine can add delayed events with addEventAfter()
+//! and can contain timed transitions, which are specified with after().
+//! The timers are run by a TimerService for the clock \p TClock. Timers
+//! require multithreading support and asynchronous event dispatching. An
+//! expired timer only hands the event or the timeout to the state machine,
+//! which dispatches it in its own thread.
+template <bool TEnable, typename TClock = FSM11STD::chrono::steady_clock>
+struct TimerEnable
+{
+    //! \cond
+    template <typename TBase>
+    struct pack : TBase
+    {
+        static constexpr bool timer_enable = TEnable;
+        using timer_clock = TClock;
+    };
+    //! \endcond
+};
+
 // ----=====================================================================----
 //     Callbacks
 // ----=====================================================================----
@@ -0,0 +1,236 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_REPLAY_HPP
+#define FSM11_REPLAY_HPP
+
+#include "statemachine_fwd.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/chrono.hpp>
+#include <weos/type_traits.hpp>
+#else
+#include <chrono>
+#include <type_traits>
+#endif // FSM11_USE_WEOS
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace fsm11
+{
+
+//! \brief Writes an event to a binary event log.
+//!
+//! Appends the raw bytes of the \p event to the \p stream. Only trivially
+//! copyable events can be stored in a binary event log.
+template <typename TEvent>
+void writeEvent(std::ostream& stream, const TEvent& event)
+{
+    static_assert(FSM11STD::is_trivially_copyable<TEvent>::value,
+                  "Only trivially copyable events can be logged.");
+    stream.write(reinterpret_cast<const char*>(&event), sizeof(TEvent));
+}
+
+//! \brief Reads a binary event log.
+//!
+//! Reads events of type \p TEvent from the \p stream until the end of the
+//! stream is reached. A trailing partial event is ignored.
+template <typename TEvent>
+std::vector<TEvent> readEventLog(std::istream& stream)
+{
+    static_assert(FSM11STD::is_trivially_copyable<TEvent>::value,
+                  "Only trivially copyable events can be logged.");
+
+    std::vector<TEvent> events;
+    TEvent event;
+    while (stream.read(reinterpret_cast<char*>(&event), sizeof(TEvent)))
+        events.push_back(event);
+    return events;
+}
+
+//! \brief Records dispatched events in a binary event log.
+//!
+//! The EventRecorder is meant to be installed as event dispatch callback.
+//! Every dispatched event is appended to the output stream, which can later
+//! be loaded with readEventLog() and fed into replay().
+//! \code
+//! std::ofstream log("events.bin", std::ios::binary);
+//! sm.setEventDispatchCallback(EventRecorder<int>(log));
+//! \endcode
+template <typename TEvent>
+class EventRecorder
+{
+public:
+    explicit EventRecorder(std::ostream& stream) noexcept
+        : m_stream(&stream)
+    {
+    }
+
+    void operator()(const TEvent& event) const
+    {
+        writeEvent(*m_stream, event);
+    }
+
+private:
+    std::ostream* m_stream;
+};
+
+//! \brief A configuration of a state machine.
+//!
+//! A configuration is stored as the list of the pre-order indices of all
+//! active states. Two machines with the same topology yield comparable
+//! configurations.
+using Configuration = std::vector<std::size_t>;
+
+//! \brief Returns the current configuration of a state machine.
+//!
+//! Returns the pre-order indices of all active states of the state
+//! machine \p sm.
+template <typename TStateMachine>
+Configuration currentConfiguration(const TStateMachine& sm)
+{
+    Configuration configuration;
+    std::size_t index = 0;
+    for (const auto& state : sm.pre_order_subtree())
+    {
+        if (state.isActive())
+            configuration.push_back(index);
+        ++index;
+    }
+    return configuration;
+}
+
+//! \brief The result of replaying an event log.
+struct ReplayResult
+{
+    using clock_type = FSM11STD::chrono::steady_clock;
+
+    //! The number of replayed events.
+    std::size_t numEvents{0};
+    //! The number of configuration changes caused by the replayed events.
+    //! Starting the machine is not counted.
+    unsigned numConfigurationChanges{0};
+    //! The time needed to replay the events. Starting the machine is not
+    //! included.
+    clock_type::duration duration{0};
+    //! The configuration after starting the machine followed by the
+    //! configuration after every replayed event. Empty if the configurations
+    //! have not been recorded.
+    std::vector<Configuration> configurations;
+
+    //! Returns the replay throughput in events per second.
+    double eventsPerSecond() const
+    {
+        double seconds = FSM11STD::chrono::duration_cast<
+                             FSM11STD::chrono::duration<double>>(duration).count();
+        return seconds > 0 ? numEvents / seconds : 0;
+    }
+};
+
+//! \brief Replays an event sequence.
+//!
+//! Feeds the events in the range [\p first, \p last) into the synchronous
+//! state machine \p sm as fast as possible. The machine is started before
+//! the first event, if it is not running yet. If \p recordConfigurations
+//! is set, the configuration is captured after the start and after every
+//! event. Note that capturing the configurations is included in the
+//! measured duration, so it should be turned off for pure throughput
+//! measurements.
+template <typename TStateMachine, typename TIterator>
+ReplayResult replay(TStateMachine& sm, TIterator first, TIterator last,
+                    bool recordConfigurations = true)
+{
+    static_assert(fsm11_detail::get_options<TStateMachine>::type::
+                      synchronous_dispatch,
+                  "Events can only be replayed with synchronous dispatching.");
+
+    using clock_type = ReplayResult::clock_type;
+
+    ReplayResult result;
+    if (!sm.running())
+        sm.start();
+    if (recordConfigurations)
+        result.configurations.push_back(currentConfiguration(sm));
+
+    // Both the change count and the duration cover the events only.
+    unsigned initialChanges = sm.numConfigurationChanges();
+
+    auto startTime = clock_type::now();
+    for (; first != last; ++first)
+    {
+        sm.addEvent(*first);
+        ++result.numEvents;
+        if (recordConfigurations)
+            result.configurations.push_back(currentConfiguration(sm));
+    }
+    result.duration = clock_type::now() - startTime;
+    result.numConfigurationChanges
+            = sm.numConfigurationChanges() - initialChanges;
+    return result;
+}
+
+//! \brief Replays a binary event log.
+//!
+//! Reads the events from the \p stream and replays them in \p sm.
+//!
+//! \sa readEventLog()
+template <typename TStateMachine>
+ReplayResult replay(TStateMachine& sm, std::istream& stream,
+                    bool recordConfigurations = true)
+{
+    using event_type = typename TStateMachine::event_type;
+
+    auto events = readEventLog<event_type>(stream);
+    return replay(sm, events.begin(), events.end(), recordConfigurations);
+}
+
+//! \brief Compares two configuration sequences.
+//!
+//! Returns the index of the first step at which the configuration
+//! sequences \p a and \p b differ. If one sequence is a prefix of the
+//! other, the length of the shorter one is returned. If both sequences
+//! are equal, <tt>std::size_t(-1)</tt> is returned.
+inline
+std::size_t findConfigurationMismatch(const std::vector<Configuration>& a,
+                                      const std::vector<Configuration>& b)
+{
+    std::size_t size = a.size() < b.size() ? a.size() : b.size();
+    for (std::size_t idx = 0; idx < size; ++idx)
+    {
+        if (a[idx] != b[idx])
+            return idx;
+    }
+    return a.size() == b.size() ? std::size_t(-1) : size;
+}
+
+} // namespace fsm11
+
+#endif // FSM11_REPLAY_HPP
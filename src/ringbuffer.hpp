@@ -0,0 +1,270 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_RINGBUFFER_HPP
+#define FSM11_RINGBUFFER_HPP
+
+#include "statemachine_fwd.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/type_traits.hpp>
+#include <weos/utility.hpp>
+#else
+#include <type_traits>
+#include <utility>
+#endif // FSM11_USE_WEOS
+
+#include <new>
+
+namespace fsm11
+{
+
+//! \brief A growable ring buffer.
+//!
+//! The RingBuffer is a FIFO queue, which is meant to be used as the event
+//! list of a state machine (see EventListType). It is the default event
+//! list for \p int events and the recommended event list for other event
+//! types.
+//!
+//! The first \p TInlineCapacity elements are stored inside the buffer
+//! itself, so a short queue never allocates memory. When an element is
+//! added to a full buffer, the capacity is doubled. The buffer never
+//! shrinks on its own. Thus, after the queue has reached its high-water
+//! mark, adding and removing elements does not allocate or free memory.
+//! The memory can be released with shrink_to_fit(). The capacity is
+//! always a power of two.
+template <typename T, std::size_t TInlineCapacity = 16>
+class RingBuffer
+{
+    static_assert(TInlineCapacity > 0
+                  && (TInlineCapacity & (TInlineCapacity - 1)) == 0,
+                  "The inline capacity must be a power of two.");
+
+public:
+    using value_type = T;
+    using reference = T&;
+    using const_reference = const T&;
+    using size_type = std::size_t;
+
+    //! Creates an empty ring buffer.
+    RingBuffer() noexcept
+        : m_data(inlineData())
+    {
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    ~RingBuffer()
+    {
+        clear();
+        if (m_data != inlineData())
+            ::operator delete(m_data);
+    }
+
+    //! Returns \p true, if the buffer is empty.
+    bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+
+    //! Returns the number of elements.
+    size_type size() const noexcept
+    {
+        return m_size;
+    }
+
+    //! Returns the number of elements, which fit into the buffer without
+    //! allocating memory.
+    size_type capacity() const noexcept
+    {
+        return m_capacity;
+    }
+
+    //! Returns the first element.
+    reference front() noexcept
+    {
+        FSM11_ASSERT(!empty());
+        return m_data[m_head];
+    }
+
+    //! Returns the first element.
+    const_reference front() const noexcept
+    {
+        FSM11_ASSERT(!empty());
+        return m_data[m_head];
+    }
+
+    //! Returns the last element.
+    reference back() noexcept
+    {
+        FSM11_ASSERT(!empty());
+        return m_data[wrap(m_head + m_size - 1)];
+    }
+
+    //! Returns the last element.
+    const_reference back() const noexcept
+    {
+        FSM11_ASSERT(!empty());
+        return m_data[wrap(m_head + m_size - 1)];
+    }
+
+    //! Appends the \p value.
+    void push_back(const T& value)
+    {
+        emplace_back(value);
+    }
+
+    //! Appends the \p value.
+    void push_back(T&& value)
+    {
+        emplace_back(FSM11STD::move(value));
+    }
+
+    //! Appends an element, which is constructed from the \p args.
+    template <typename... TArgs>
+    void emplace_back(TArgs&&... args)
+    {
+        if (m_size == m_capacity)
+            reallocate(2 * m_capacity);
+        ::new (m_data + wrap(m_head + m_size))
+                T(FSM11STD::forward<TArgs>(args)...);
+        ++m_size;
+    }
+
+    //! Removes the first element. The buffer must not be empty.
+    void pop_front() noexcept
+    {
+        FSM11_ASSERT(!empty());
+        m_data[m_head].~T();
+        m_head = wrap(m_head + 1);
+        --m_size;
+    }
+
+    //! Removes all elements. The capacity is not changed.
+    void clear() noexcept
+    {
+        while (!empty())
+            pop_front();
+        m_head = 0;
+    }
+
+    //! Increases the capacity to at least \p capacity elements.
+    void reserve(size_type capacity)
+    {
+        if (capacity > m_capacity)
+            reallocate(roundUp(capacity));
+    }
+
+    //! \brief Releases unused memory.
+    //!
+    //! Reduces the capacity to the smallest power of two, which can hold
+    //! the elements, but not below the inline capacity.
+    void shrink_to_fit()
+    {
+        size_type capacity = roundUp(m_size);
+        if (capacity < m_capacity)
+            reallocate(capacity);
+    }
+
+private:
+    using storage_type = typename FSM11STD::aligned_storage<
+                             sizeof(T), alignof(T)>::type;
+
+    storage_type m_inlineData[TInlineCapacity];
+    T* m_data;
+    //! The index of the first element.
+    size_type m_head{0};
+    size_type m_size{0};
+    size_type m_capacity{TInlineCapacity};
+
+    T* inlineData() noexcept
+    {
+        return reinterpret_cast<T*>(&m_inlineData[0]);
+    }
+
+    size_type wrap(size_type index) const noexcept
+    {
+        return index & (m_capacity - 1);
+    }
+
+    //! Rounds the \p capacity up to a power of two, which is not smaller
+    //! than the inline capacity.
+    static size_type roundUp(size_type capacity) noexcept
+    {
+        size_type result = TInlineCapacity;
+        while (result < capacity)
+            result *= 2;
+        return result;
+    }
+
+    //! Moves the elements to a storage for \p capacity elements.
+    void reallocate(size_type capacity)
+    {
+        FSM11_ASSERT(capacity >= m_size);
+
+        T* data = capacity > TInlineCapacity
+                  ? static_cast<T*>(::operator new(capacity * sizeof(T)))
+                  : inlineData();
+        // Moving from the inline storage into itself is not possible. This
+        // can only happen when shrinking to the inline capacity, which is
+        // never done, if the elements are stored inline.
+        FSM11_ASSERT(data != m_data);
+
+        size_type count = 0;
+        try
+        {
+            for (; count < m_size; ++count)
+            {
+                ::new (data + count) T(FSM11STD::move_if_noexcept(
+                                           m_data[wrap(m_head + count)]));
+            }
+        }
+        catch (...)
+        {
+            while (count > 0)
+                data[--count].~T();
+            if (data != inlineData())
+                ::operator delete(data);
+            throw;
+        }
+
+        size_type size = m_size;
+        clear();
+        if (m_data != inlineData())
+            ::operator delete(m_data);
+
+        m_data = data;
+        m_capacity = capacity;
+        m_size = size;
+    }
+};
+
+} // namespace fsm11
+
+#endif // FSM11_RINGBUFFER_HPP
@@ -133,9 +133,22 @@ public:
     //! \brief Checks if the state is active.
     //!
     //! Returns \p true, if the state is active, which means that it belongs
-    //! to the current state machine configuration.
+    //! to the current state machine configuration. The result is taken
+    //! from the configuration, which the state machine has published last.
+    //! In order to check several states consistently, use a
+    //! ConfigurationSnapshot.
     bool isActive() const noexcept;
 
+    //! \brief Returns the id of the state.
+    //!
+    //! The id is the index of the state in a pre-order traversal of its
+    //! state machine. It is assigned when the state machine is started.
+    //! Before, the id is <tt>unsigned(-1)</tt>.
+    unsigned id() const noexcept
+    {
+        return m_id.load(FSM11STD::memory_order_relaxed);
+    }
+
     //! \brief Checks for atomicity.
     //!
     //! Returns \p true, if this state is atomic which means that it does not
@@ -1161,7 +1174,8 @@ private:
     //! \todo This should be of type Flags
     int m_flags;
 
-    FSM11STD::atomic_bool m_visibleActive;
+    //! The index in the published configuration.
+    FSM11STD::atomic_uint m_id;
 
     //! Adds a \p child.
     void addChild(State* child) noexcept;
@@ -1196,7 +1210,7 @@ State<TStateMachine>::State(const char* name, State* parent) noexcept
       m_initialState(nullptr),
       m_transitions(nullptr),
       m_flags(0),
-      m_visibleActive(false)
+      m_id(unsigned(-1))
 {
     if (parent)
         parent->addChild(this);
@@ -1239,7 +1253,8 @@ template <typename TStateMachine>
 inline
 bool State<TStateMachine>::isActive() const noexcept
 {
-    return m_visibleActive;
+    return m_stateMachine
+           && m_stateMachine->m_configurationPublisher.isActive(id());
 }
 
 template <typename TStateMachine>
@@ -34,16 +34,20 @@
 #include "state.hpp"
 #include "transition.hpp"
 
+#include "detail/boundedring.hpp"
 #include "detail/callbacks.hpp"
 #include "detail/capturestorage.hpp"
 #include "detail/eventdispatcher.hpp"
 #include "detail/multithreading.hpp"
 #include "detail/threadpool.hpp"
+#include "detail/timers.hpp"
 
 #ifdef FSM11_USE_WEOS
+#include <weos/memory.hpp>
 #include <weos/mutex.hpp>
 #include <weos/type_traits.hpp>
 #else
+#include <memory>
 #include <mutex>
 #include <type_traits>
 #endif // FSM11_USE_WEOS
@@ -371,6 +375,7 @@ class StateMachineImpl :
         public get_state_exception_callbacks<TOptions>::type,
         public get_storage<TOptions>::type,
         public get_threadpool<TOptions>::type,
+        public get_timers<TOptions>::type,
         public get_transition_conflict_action<TOptions>::type,
         public State<StateMachineImpl<TOptions>>
 {
@@ -379,17 +384,22 @@ public:
     using state_type = State<type>;
     using transition_type = Transition<type>;
     using event_type = typename TOptions::event_type;
-    using event_list_type = typename TOptions::event_list_type;
+    using event_list_type = typename get_event_list<TOptions>::type;
     using transition_allocator_type = typename TOptions::transition_allocator_type;
 
+    static_assert(TOptions::event_list_capacity == 0
+                  || !TOptions::synchronous_dispatch,
+                  "A bounded event list needs asynchronous event dispatching.");
+
 private:
     using dispatcher_type = typename get_dispatcher<TOptions>::type;
     using storage_type = typename get_storage<TOptions>::type;
     using rebound_transition_allocator_t
-        = typename transition_allocator_type::
-          template rebind<transition_type>::other;
+        = typename FSM11STD::allocator_traits<transition_allocator_type>::
+          template rebind_alloc<transition_type>;
+    using threadpool_base_type = typename get_threadpool<TOptions>::type;
     using internal_thread_pool_type
-        = typename get_threadpool<TOptions>::type::internal_thread_pool_type;
+        = typename threadpool_base_type::internal_thread_pool_type;
 
     friend dispatcher_type;
     friend storage_type;
@@ -401,12 +411,46 @@ public:
         state_type::m_stateMachine = this;
     }
 
+    //! \brief Creates a state machine with a thread pool.
+    //!
+    //! Creates a state machine, which takes over the thread \p pool.
     template <typename T = void,
               typename = typename FSM11STD::enable_if<
                              TOptions::threadpool_enable, T>::type>
     explicit StateMachineImpl(internal_thread_pool_type&& pool)
-        : state_type("(StateMachine)"),
-          m_threadPool(FSM11STD::move(pool))
+        : threadpool_base_type(FSM11STD::move(pool)),
+          state_type("(StateMachine)")
+    {
+        state_type::m_stateMachine = this;
+    }
+
+    //! \brief Creates a state machine with an external thread pool.
+    //!
+    //! Creates a state machine, which runs its invoke actions in the
+    //! thread \p pool. The pool can be shared with other state machines
+    //! and must outlive all of them.
+    template <typename T = void,
+              typename = typename FSM11STD::enable_if<
+                             TOptions::threadpool_enable, T>::type>
+    explicit StateMachineImpl(internal_thread_pool_type& pool)
+        : threadpool_base_type(pool),
+          state_type("(StateMachine)")
+    {
+        state_type::m_stateMachine = this;
+    }
+
+    //! \brief Creates a state machine with a shared thread pool.
+    //!
+    //! Creates a state machine, which runs its invoke actions in the
+    //! thread \p pool. The pool is kept alive as long as the state
+    //! machine exists.
+    template <typename T = void,
+              typename = typename FSM11STD::enable_if<
+                             TOptions::threadpool_enable, T>::type>
+    explicit StateMachineImpl(
+            FSM11STD::shared_ptr<internal_thread_pool_type> pool)
+        : threadpool_base_type(FSM11STD::move(pool)),
+          state_type("(StateMachine)")
     {
         state_type::m_stateMachine = this;
     }
@@ -421,6 +465,7 @@ public:
     //! \brief Destroys the state machine.
     virtual ~StateMachineImpl()
     {
+        this->detachTimers();
         this->halt();
 
         for (auto& state : *this)
@@ -459,6 +504,13 @@ public:
     transition_type* add(TypeSourceNoEventGuardActionTarget<
                              TState, TGuard, TAction>&& t);
 
+    //! \brief Adds a timed transition.
+    //!
+    //! Adds a timed transition, which will be created from a transition
+    //! specification \p t. Timers must be enabled.
+    template <typename TState, typename TAction>
+    transition_type* add(TypeSourceAfterActionTarget<TState, TAction>&& t);
+
     //! \brief Adds a transition.
     template <typename TState, typename TEvent, typename TGuard,
               typename TAction>
@@ -477,21 +529,20 @@ public:
         return add(FSM11STD::move(t));
     }
 
+    //! \brief Adds a timed transition.
+    template <typename TState, typename TAction>
+    inline
+    transition_type* operator+=(TypeSourceAfterActionTarget<TState, TAction>&& t)
+    {
+        return add(FSM11STD::move(t));
+    }
+
 private:
     //! A list of events which have to be handled by the event loop.
     event_list_type m_eventList;
     //! The allocator for transitions.
     rebound_transition_allocator_t m_transitionAllocator;
 
-    internal_thread_pool_type m_threadPool; // TODO: merge if empty
-
-
-    internal_thread_pool_type& threadPool()
-    {
-        return m_threadPool;
-    }
-
-
     friend class EventDispatcherBase<StateMachineImpl>;
 
     template <typename T>
@@ -499,6 +550,9 @@ private:
 
     template <typename T>
     friend class WithThreadPool;
+
+    template <typename T>
+    friend class WithTimers;
 };
 
 template <typename TOptions>
@@ -528,6 +582,20 @@ auto StateMachineImpl<TOptions>::add(
     return transition;
 }
 
+template <typename TOptions>
+template <typename TState, typename TAction>
+auto StateMachineImpl<TOptions>::add(
+        TypeSourceAfterActionTarget<TState, TAction>&& t)
+    -> transition_type*
+{
+    static_assert(TOptions::timer_enable,
+                  "Timed transitions require timers to be enabled.");
+
+    void* mem = m_transitionAllocator.allocate(1);
+    transition_type* transition = new (mem) transition_type(FSM11STD::move(t));
+    transition->source()->pushBackTransition(transition);
+    return transition;
+}
 
 
 
@@ -660,6 +728,18 @@ public:
     //! \note This function is only available, if a storage has been specified.
     template <std::size_t TIndex, typename TType>
     void store(TType&& value);
+
+    //! Returns a consistent copy of all elements in the storage.
+    //!
+    //! \note This function is only available, if the lock-free capture
+    //! storage has been enabled.
+    std::tuple<...> loadAll() const;
+
+    //! Requests the capture callback to be invoked before the next event.
+    //!
+    //! \note This function is only available, if the lock-free capture
+    //! storage has been enabled.
+    void markCaptureStorageDirty();
 };
 
 #endif // DOXYGEN
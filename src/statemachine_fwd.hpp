@@ -88,6 +88,8 @@ class ThreadPool;
 template <typename TStateMachine>
 class Transition;
 
+class Executor;
+
 namespace fsm11_detail
 {
 
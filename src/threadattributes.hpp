@@ -0,0 +1,513 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_THREADATTRIBUTES_HPP
+#define FSM11_THREADATTRIBUTES_HPP
+
+#include "statemachine_fwd.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/thread.hpp>
+#include <weos/utility.hpp>
+#else
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif // __linux__
+
+#include <cerrno>
+#endif // FSM11_USE_WEOS
+
+namespace fsm11
+{
+
+#ifdef FSM11_USE_WEOS
+
+//! The attributes of a thread, which is created by fsm11.
+using ThreadAttributes = weos::thread::attributes;
+
+#else
+
+//! \brief The attributes of a thread.
+//!
+//! The ThreadAttributes describe a thread, which is created by fsm11, i.e.
+//! an event loop thread, a worker of a thread pool or an executor or the
+//! thread of a ThreadedState. They can be passed to startAsyncEventLoop(),
+//! to the constructors of the thread pools and the Executor and to the
+//! constructor of a ThreadedState.
+//!
+//! The name, the CPU affinity and the scheduling policy are applied by the
+//! new thread before it runs any other code. The creating thread waits
+//! for this to happen and throws a \p std::system_error if an attribute
+//! cannot be applied. For example, SCHED_FIFO usually requires elevated
+//! privileges. Only the stack size is applied when the thread is created.
+//! A thread with a stack size of its own is created with the POSIX thread
+//! API, so its stack size does not affect other threads of the process.
+//!
+//! The attributes are supported on Linux. On other platforms, creating
+//! a thread with non-default attributes fails.
+class ThreadAttributes
+{
+public:
+    //! Creates default attributes.
+    ThreadAttributes() = default;
+
+    //! Returns \p true, if no attribute has been set.
+    bool isDefault() const noexcept
+    {
+        return m_stackSize == 0 && m_name.empty() && m_affinity.empty()
+               && m_schedulingPolicy < 0;
+    }
+
+    //! Returns the name of the thread.
+    const std::string& name() const noexcept
+    {
+        return m_name;
+    }
+
+    //! \brief Sets the name of the thread.
+    //!
+    //! Sets the name of the thread to \p name. Linux limits thread names
+    //! to 15 characters, so a longer \p name is truncated.
+    ThreadAttributes& setName(const char* name)
+    {
+        m_name = std::string(name).substr(0, 15);
+        return *this;
+    }
+
+    //! Returns the stack size or zero, if the default stack size is used.
+    std::size_t stackSize() const noexcept
+    {
+        return m_stackSize;
+    }
+
+    //! Sets the stack size in bytes to \p size. A \p size of zero selects
+    //! the default stack size.
+    ThreadAttributes& setStackSize(std::size_t size) noexcept
+    {
+        m_stackSize = size;
+        return *this;
+    }
+
+    //! Returns the CPUs on which the thread may run. An empty set means
+    //! that the affinity is inherited from the creating thread.
+    const std::vector<unsigned>& affinity() const noexcept
+    {
+        return m_affinity;
+    }
+
+    //! Restricts the thread to the \p cpus.
+    ThreadAttributes& setAffinity(std::vector<unsigned> cpus)
+    {
+        m_affinity = std::move(cpus);
+        return *this;
+    }
+
+    //! Returns the scheduling policy or -1, if the scheduling policy is
+    //! inherited from the creating thread.
+    int schedulingPolicy() const noexcept
+    {
+        return m_schedulingPolicy;
+    }
+
+    //! Returns the scheduling priority.
+    int priority() const noexcept
+    {
+        return m_priority;
+    }
+
+    //! \brief Sets the scheduling policy.
+    //!
+    //! Sets the scheduling \p policy (e.g. \p SCHED_FIFO or \p SCHED_RR)
+    //! and the static \p priority of the thread.
+    ThreadAttributes& setSchedulingPolicy(int policy, int priority = 0) noexcept
+    {
+        m_schedulingPolicy = policy;
+        m_priority = priority;
+        return *this;
+    }
+
+    //! \brief Applies the attributes to the calling thread.
+    //!
+    //! Applies the name, the affinity and the scheduling policy to the
+    //! calling thread. Returns zero or an error number, if an attribute
+    //! could not be applied.
+    int applyToCurrentThread() const noexcept
+    {
+#if defined(__linux__)
+        pthread_t self = pthread_self();
+
+        if (!m_affinity.empty())
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (unsigned cpu : m_affinity)
+            {
+                if (cpu >= CPU_SETSIZE)
+                    return EINVAL;
+                CPU_SET(cpu, &cpus);
+            }
+            if (int error = pthread_setaffinity_np(self, sizeof(cpus), &cpus))
+                return error;
+        }
+
+        if (m_schedulingPolicy >= 0)
+        {
+            sched_param param;
+            param.sched_priority = m_priority;
+            if (int error = pthread_setschedparam(self, m_schedulingPolicy,
+                                                  &param))
+            {
+                return error;
+            }
+        }
+
+        if (!m_name.empty())
+        {
+            if (int error = pthread_setname_np(self, m_name.c_str()))
+                return error;
+        }
+
+        return 0;
+#else
+        return isDefault() ? 0 : ENOTSUP;
+#endif // __linux__
+    }
+
+private:
+    std::string m_name;
+    std::size_t m_stackSize{0};
+    std::vector<unsigned> m_affinity;
+    int m_schedulingPolicy{-1};
+    int m_priority{0};
+};
+
+#endif // FSM11_USE_WEOS
+
+namespace fsm11_detail
+{
+
+#ifdef FSM11_USE_WEOS
+
+using Thread = FSM11STD::thread;
+
+//! Creates a thread with the attributes \p attrs, which calls \p f with
+//! the arguments \p args.
+template <typename TFunction, typename... TArgs>
+Thread makeThread(const ThreadAttributes& attrs,
+                            TFunction&& f, TArgs&&... args)
+{
+    return FSM11STD::thread(attrs, FSM11STD::forward<TFunction>(f),
+                            FSM11STD::forward<TArgs>(args)...);
+}
+
+#else
+
+//! The hand-shake between a new thread and its creator.
+struct ThreadStartup
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done{false};
+    int error{0};
+    std::thread::id id;
+};
+
+//! \brief The main function of a thread with attributes.
+//!
+//! Applies the attributes \p attrs, reports the result to the creator via
+//! \p startup and calls \p fn, if the attributes have been applied. Both
+//! \p attrs and \p startup live on the creator's stack and must not be
+//! accessed after the hand-shake.
+template <typename TFunction>
+void runThread(const ThreadAttributes* attrs, ThreadStartup* startup,
+               TFunction fn)
+{
+    int error = attrs->applyToCurrentThread();
+    {
+        // Notify while holding the lock, because the creator destroys the
+        // startup as soon as it sees the flag set.
+        std::lock_guard<std::mutex> lock(startup->mutex);
+        startup->id = std::this_thread::get_id();
+        startup->error = error;
+        startup->done = true;
+        startup->cv.notify_one();
+    }
+
+    if (error == 0)
+        fn();
+}
+
+//! The function object, which is run by a thread with attributes.
+template <typename TFunction>
+struct ThreadMain
+{
+    void operator()()
+    {
+        runThread(attrs, startup, std::move(fn));
+    }
+
+    const ThreadAttributes* attrs;
+    ThreadStartup* startup;
+    TFunction fn;
+};
+
+//! \brief A thread of execution.
+//!
+//! The Thread owns either a \p std::thread or a POSIX thread, which has
+//! been created with a stack size of its own. Like a \p std::thread, it
+//! must be joined or detached before it is destroyed.
+class Thread
+{
+public:
+    Thread() noexcept
+        : m_native(false)
+    {
+    }
+
+    Thread(std::thread&& thread) noexcept
+        : m_thread(std::move(thread)),
+          m_native(false)
+    {
+    }
+
+#if defined(__linux__)
+    //! Takes the ownership of the POSIX thread \p handle whose id is
+    //! \p id.
+    Thread(pthread_t handle, std::thread::id id) noexcept
+        : m_handle(handle),
+          m_id(id),
+          m_native(true)
+    {
+    }
+#endif // __linux__
+
+    Thread(Thread&& other) noexcept
+        : m_native(false)
+    {
+        swap(other);
+    }
+
+    Thread& operator=(Thread&& other) noexcept
+    {
+        if (joinable())
+            std::terminate();
+        swap(other);
+        return *this;
+    }
+
+    ~Thread()
+    {
+        if (joinable())
+            std::terminate();
+    }
+
+    bool joinable() const noexcept
+    {
+        return m_native || m_thread.joinable();
+    }
+
+    std::thread::id get_id() const noexcept
+    {
+        return m_native ? m_id : m_thread.get_id();
+    }
+
+    void join()
+    {
+#if defined(__linux__)
+        if (m_native)
+        {
+            if (int error = pthread_join(m_handle, nullptr))
+                throw std::system_error(error, std::system_category());
+            m_native = false;
+            m_id = std::thread::id();
+            return;
+        }
+#endif // __linux__
+        m_thread.join();
+    }
+
+    void detach()
+    {
+#if defined(__linux__)
+        if (m_native)
+        {
+            if (int error = pthread_detach(m_handle))
+                throw std::system_error(error, std::system_category());
+            m_native = false;
+            m_id = std::thread::id();
+            return;
+        }
+#endif // __linux__
+        m_thread.detach();
+    }
+
+private:
+    std::thread m_thread;
+#if defined(__linux__)
+    pthread_t m_handle;
+#endif // __linux__
+    std::thread::id m_id;
+    bool m_native;
+
+    void swap(Thread& other) noexcept
+    {
+        std::swap(m_thread, other.m_thread);
+#if defined(__linux__)
+        std::swap(m_handle, other.m_handle);
+#endif // __linux__
+        std::swap(m_id, other.m_id);
+        std::swap(m_native, other.m_native);
+    }
+};
+
+#if defined(__linux__)
+//! The entry point of a POSIX thread, which runs the function object
+//! \p arg of type \p TFunction.
+template <typename TFunction>
+void* runNativeThread(void* arg) noexcept
+{
+    std::unique_ptr<TFunction> fn(static_cast<TFunction*>(arg));
+    (*fn)();
+    return nullptr;
+}
+
+//! \brief Creates a POSIX thread with a stack size.
+//!
+//! Creates a thread with a stack of \p stackSize bytes, which calls
+//! \p fn. The stack size is set in attributes, which are local to this
+//! call, so other threads of the process are not affected.
+template <typename TFunction>
+pthread_t createNativeThread(std::size_t stackSize, TFunction&& fn)
+{
+    using function_type = typename std::decay<TFunction>::type;
+
+    pthread_attr_t attrs;
+    if (int error = pthread_attr_init(&attrs))
+        throw std::system_error(error, std::system_category());
+    struct AttributesGuard
+    {
+        ~AttributesGuard()
+        {
+            pthread_attr_destroy(attrs);
+        }
+
+        pthread_attr_t* attrs;
+    } attrsGuard{&attrs};
+
+    if (int error = pthread_attr_setstacksize(&attrs, stackSize))
+        throw std::system_error(error, std::system_category());
+
+    std::unique_ptr<function_type> arg(
+                new function_type(std::forward<TFunction>(fn)));
+    pthread_t handle;
+    if (int error = pthread_create(&handle, &attrs,
+                                   &runNativeThread<function_type>,
+                                   arg.get()))
+    {
+        throw std::system_error(error, std::system_category());
+    }
+    arg.release();
+    return handle;
+}
+#endif // __linux__
+
+//! \brief Creates a thread with attributes.
+//!
+//! Creates a thread with the attributes \p attrs, which calls \p f with
+//! the arguments \p args. Throws a \p std::system_error, if the attributes
+//! cannot be applied.
+template <typename TFunction, typename... TArgs>
+Thread makeThread(const ThreadAttributes& attrs,
+                  TFunction&& f, TArgs&&... args)
+{
+    if (attrs.isDefault())
+    {
+        return std::thread(std::forward<TFunction>(f),
+                           std::forward<TArgs>(args)...);
+    }
+
+    using function_type = decltype(std::bind(std::forward<TFunction>(f),
+                                             std::forward<TArgs>(args)...));
+
+    ThreadStartup startup;
+    ThreadMain<function_type> run{&attrs, &startup,
+                                  std::bind(std::forward<TFunction>(f),
+                                            std::forward<TArgs>(args)...)};
+
+    Thread thread;
+#if defined(__linux__)
+    pthread_t handle = pthread_t();
+#endif // __linux__
+    if (attrs.stackSize() == 0)
+    {
+        thread = std::thread(std::move(run));
+    }
+    else
+    {
+#if defined(__linux__)
+        handle = createNativeThread(attrs.stackSize(), std::move(run));
+#else
+        throw std::system_error(ENOTSUP, std::system_category());
+#endif // __linux__
+    }
+
+    std::unique_lock<std::mutex> lock(startup.mutex);
+    startup.cv.wait(lock, [&] { return startup.done; });
+#if defined(__linux__)
+    // The id of a POSIX thread is only known after the hand-shake.
+    if (attrs.stackSize() != 0)
+        thread = Thread(handle, startup.id);
+#endif // __linux__
+    if (startup.error)
+    {
+        lock.unlock();
+        thread.join();
+        throw std::system_error(startup.error, std::system_category());
+    }
+    return thread;
+}
+
+#endif // FSM11_USE_WEOS
+
+} // namespace fsm11_detail
+} // namespace fsm11
+
+#endif // FSM11_THREADATTRIBUTES_HPP
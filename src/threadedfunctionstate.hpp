@@ -178,9 +178,7 @@ public:
 
     virtual void enterInvoke() override
     {
-        m_exitRequest.m_mutex.lock();
-        m_exitRequest.m_requested = false;
-        m_exitRequest.m_mutex.unlock();
+        m_exitRequest.reset();
 
         m_exceptionPointer = nullptr;
         m_invokeThread = FSM11STD::thread(
@@ -194,10 +192,7 @@ public:
     {
         FSM11_ASSERT(m_invokeThread.joinable());
 
-        m_exitRequest.m_mutex.lock();
-        m_exitRequest.m_requested = true;
-        m_exitRequest.m_mutex.unlock();
-        m_exitRequest.m_cv.notify_one();
+        m_exitRequest.request();
 
         m_invokeThread.join();
         return m_exceptionPointer;
@@ -32,6 +32,8 @@
 #include "statemachine_fwd.hpp"
 #include "exitrequest.hpp"
 #include "state.hpp"
+#include "threadattributes.hpp"
+#include "detail/threadcache.hpp"
 #include "detail/threadedstatebase.hpp"
 
 #ifdef FSM11_USE_WEOS
@@ -54,9 +56,16 @@ class ThreadedState : public State<TStateMachine>,
 
     static constexpr bool has_thread_pool
         = fsm11_detail::get_options<TStateMachine>::type::threadpool_enable;
+    static constexpr bool asynchronous_exit
+        = fsm11_detail::get_options<TStateMachine>::type
+              ::asynchronous_invoke_exit_enable;
+    static constexpr bool synchronous_dispatch
+        = fsm11_detail::get_options<TStateMachine>::type::synchronous_dispatch;
 
 public:
     using type = ThreadedState<TStateMachine>;
+    using event_type
+        = typename fsm11_detail::get_options<TStateMachine>::type::event_type;
 
 #ifdef FSM11_USE_WEOS
     //! \brief Creates a state with a threaded invoke action.
@@ -67,89 +76,305 @@ public:
         : base_type(name, parent)
     {
     }
+#else
+    //! \brief Creates a state with a threaded invoke action.
+    explicit ThreadedState(const char* name, base_type* parent = nullptr)
+        : base_type(name, parent)
+    {
+    }
+#endif // FSM11_USE_WEOS
 
     //! \brief Creates a state with a threaded invoke action.
+    //!
+    //! Creates a state, whose invoke action runs in a thread of its own,
+    //! which is created with the attributes \p attrs. This constructor is
+    //! not available, if the state machine has a thread pool.
     template <typename T = void,
               typename = typename FSM11STD::enable_if<
                              !has_thread_pool, T>::type>
     explicit ThreadedState(const char* name,
-                           const FSM11STD::thread::attributes& attrs,
+                           const ThreadAttributes& attrs,
                            base_type* parent = nullptr)
         : base_type(name, parent)
     {
         FSM11STD::get<1>(m_data) = attrs;
     }
-#else
-    //! \brief Creates a state with a threaded invoke action.
-    explicit ThreadedState(const char* name, base_type* parent = nullptr)
-        : base_type(name, parent)
-    {
-    }
-#endif // FSM11_USE_WEOS
 
     //! \brief The actual invoke action.
     //!
-    //! This method is called in a new thread. Derived classes have to
-    //! provide an implementation.
+    //! This method is called in a separate thread, which is taken from the
+    //! state machine's thread pool or, if there is no pool, from a
+    //! process-wide cache of threads. Derived classes have to provide an
+    //! implementation.
     virtual void invoke(ExitRequest& exitRequest) = 0;
 
     //! Enters the invoked thread.
+    //!
+    //! If invoke actions are left asynchronously and the previous invocation
+    //! of this state is still running, the new invocation is deferred until
+    //! the previous one has finished.
     virtual void enterInvoke() override final
     {
-        m_exitRequest.m_mutex.lock();
-        m_exitRequest.m_requested = false;
-        m_exitRequest.m_mutex.unlock();
-
-        doEnterInvoke(FSM11STD::integral_constant<bool, has_thread_pool>());
+        enterInvoke(FSM11STD::integral_constant<bool, asynchronous_exit>());
     }
 
     //! Leaves the invoked thread.
     //!
-    //! Joins with the thread in which the invoked action is running.
+    //! Joins with the thread in which the invoked action is running. If the
+    //! invoke action is still queued in a thread pool whose workers are all
+    //! busy, it is cancelled. If invoke actions are left asynchronously,
+    //! the exit is only requested and the state machine waits for the
+    //! invoke action when it is stopped.
     virtual void exitInvoke() override final
     {
-        m_exitRequest.m_mutex.lock();
-        m_exitRequest.m_requested = true;
-        m_exitRequest.m_mutex.unlock();
-        m_exitRequest.m_cv.notify_one();
+        exitInvoke(FSM11STD::integral_constant<bool, asynchronous_exit>());
+    }
 
-        FSM11STD::get<0>(m_data).get();
+    //! \brief Sets the done event.
+    //!
+    //! Sets the \p event, which is added to the state machine's event list
+    //! when the invoke action returns before its exit has been requested.
+    //! The event is added by the thread which has run the invoke action.
+    //! The overflow policy of a bounded event list is not applied. If the
+    //! list is full, the event is kept aside until there is room, so it is
+    //! never lost. This is only possible for state machines with
+    //! asynchronous event dispatching. The done event must not be changed
+    //! while the state is active.
+    template <typename T = void>
+    void setDoneEvent(event_type event)
+    {
+        static_assert(!synchronous_dispatch || !FSM11STD::is_same<T, T>::value,
+                      "Completion events need asynchronous event dispatching.");
+        m_doneEvent = FSM11STD::move(event);
+        m_hasDoneEvent = true;
+    }
+
+    //! \brief Sets the error event.
+    //!
+    //! Sets the \p event, which is added to the state machine's event list
+    //! when the invoke action throws an exception before its exit has been
+    //! requested. The exception is dropped in this case. This is only
+    //! possible for state machines with asynchronous event dispatching.
+    //! The error event must not be changed while the state is active.
+    template <typename T = void>
+    void setErrorEvent(event_type event)
+    {
+        static_assert(!synchronous_dispatch || !FSM11STD::is_same<T, T>::value,
+                      "Completion events need asynchronous event dispatching.");
+        m_errorEvent = FSM11STD::move(event);
+        m_hasErrorEvent = true;
+    }
+
+    //! Removes the done and the error event.
+    void clearCompletionEvents() noexcept
+    {
+        m_hasDoneEvent = false;
+        m_hasErrorEvent = false;
     }
 
 private:
-#ifdef FSM11_USE_WEOS
     struct None {};
 
     using maybe_thread_attributes_t
         = typename FSM11STD::conditional<!has_thread_pool,
-                                         FSM11STD::thread::attributes,
+                                         ThreadAttributes,
                                          None>::type;
 
     using data_type = FSM11STD::tuple<FSM11STD::future<void>,
                                       maybe_thread_attributes_t>;
-#else
-    using data_type = FSM11STD::tuple<FSM11STD::future<void>>;
-#endif // FSM11_USE_WEOS
 
     data_type m_data;
+    //! Set while an invocation is running, which has been started with
+    //! asynchronous exits. Guarded by the invocation tracker's mutex.
+    bool m_running{false};
+    //! Set if the state has been re-entered while the previous invocation
+    //! has still been running. Guarded by the invocation tracker's mutex.
+    bool m_startPending{false};
+
+    event_type m_doneEvent{};
+    event_type m_errorEvent{};
+    bool m_hasDoneEvent{false};
+    bool m_hasErrorEvent{false};
+
+
+    void enterInvoke(FSM11STD::false_type)
+    {
+        m_exitRequest.reset();
+        doEnterInvoke(FSM11STD::integral_constant<bool, has_thread_pool>());
+    }
+
+    void exitInvoke(FSM11STD::false_type)
+    {
+        requestExit();
+        doExitInvoke(FSM11STD::integral_constant<bool, has_thread_pool>());
+        FSM11STD::get<0>(m_data).get();
+    }
+
+    void enterInvoke(FSM11STD::true_type)
+    {
+        auto& tracker = this->stateMachine()->m_invocationTracker;
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(tracker.m_mutex);
+        if (m_running)
+            m_startPending = true;
+        else
+            startInvocation(tracker);
+    }
+
+    void exitInvoke(FSM11STD::true_type)
+    {
+        auto& tracker = this->stateMachine()->m_invocationTracker;
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(tracker.m_mutex);
+        // A deferred invocation is simply dropped. Otherwise, the running
+        // invocation is asked to exit but nobody waits for it.
+        if (m_startPending)
+            m_startPending = false;
+        else
+            requestExit();
+    }
+
+    //! Requests the invoke action to exit. The request is serialized with
+    //! the completion events, so the invoke action does not add a done or
+    //! error event once the state has been left.
+    void requestExit()
+    {
+        auto lock = this->stateMachine()->lockCompletionEvents();
+        m_exitRequest.request();
+    }
+
+    //! Starts an invocation. The tracker's mutex must be locked.
+    void startInvocation(fsm11_detail::InvocationTracker& tracker)
+    {
+        m_exitRequest.reset();
+        doEnterInvoke(FSM11STD::integral_constant<bool, has_thread_pool>());
+        m_running = true;
+        ++tracker.m_numInvocations;
+    }
+
+    virtual void invokeFinished(FSM11STD::exception_ptr& exception) noexcept
+        override
+    {
+        if (m_hasDoneEvent || m_hasErrorEvent)
+        {
+            addCompletionEvent(
+                    exception,
+                    FSM11STD::integral_constant<bool, synchronous_dispatch>());
+        }
+        invokeFinished(exception,
+                       FSM11STD::integral_constant<bool, asynchronous_exit>());
+    }
+
+    void addCompletionEvent(FSM11STD::exception_ptr&, FSM11STD::true_type)
+    {
+    }
+
+    //! Adds the done or the error event to the state machine. The event is
+    //! appended to the event list directly and is dropped, if the exit of
+    //! the invoke action has been requested. The function never blocks, so
+    //! it cannot deadlock with a dispatcher, which waits for the invoke
+    //! action.
+    void addCompletionEvent(FSM11STD::exception_ptr& exception,
+                            FSM11STD::false_type) noexcept
+    {
+        try
+        {
+            if (!exception)
+            {
+                if (m_hasDoneEvent)
+                {
+                    this->stateMachine()->addCompletionEvent(
+                                m_doneEvent, m_exitRequest);
+                }
+            }
+            else if (m_hasErrorEvent)
+            {
+                this->stateMachine()->addCompletionEvent(
+                            m_errorEvent, m_exitRequest);
+                exception = nullptr;
+            }
+        }
+        catch (...)
+        {
+            // The event could not be stored, so the failure is passed on
+            // to the state machine as the exception of the invoke action.
+            if (!exception)
+                exception = FSM11STD::current_exception();
+        }
+    }
+
+    void invokeFinished(FSM11STD::exception_ptr&, FSM11STD::false_type)
+    {
+    }
+
+    void invokeFinished(FSM11STD::exception_ptr& exception,
+                        FSM11STD::true_type)
+    {
+        auto& tracker = this->stateMachine()->m_invocationTracker;
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(tracker.m_mutex);
+        // The exception is reported when the state machine is stopped.
+        if (exception)
+        {
+            if (!tracker.m_exception)
+                tracker.m_exception = exception;
+            exception = nullptr;
+        }
+
+        m_running = false;
+        --tracker.m_numInvocations;
+        if (m_startPending)
+        {
+            m_startPending = false;
+            try
+            {
+                startInvocation(tracker);
+            }
+            catch (...)
+            {
+                if (!tracker.m_exception)
+                    tracker.m_exception = FSM11STD::current_exception();
+            }
+        }
+
+        // The state machine may be destroyed as soon as the mutex has been
+        // unlocked, so the waiters must be notified before.
+        if (tracker.m_numInvocations == 0)
+            tracker.m_cv.notify_all();
+    }
 
 
     void doEnterInvoke(FSM11STD::false_type)
     {
         using namespace FSM11STD;
 
-        get<0>(m_data) = async(launch::async,
 #ifdef FSM11_USE_WEOS
+        // The thread attributes are specific to this state, so a cached
+        // thread cannot be used.
+        get<0>(m_data) = async(launch::async,
                                get<1>(m_data),
-#endif // FSM11_USE_WEOS
                                &ThreadedStateBase::invoke,
                                this, ref(this->m_exitRequest));
+#else
+        // A state with thread attributes needs a thread of its own.
+        if (get<1>(m_data).isDefault())
+            get<0>(m_data) = fsm11_detail::ThreadCache::instance().enqueue(*this);
+        else
+            get<0>(m_data) = fsm11_detail::ThreadCache::spawn(*this, get<1>(m_data));
+#endif // FSM11_USE_WEOS
     }
 
     void doEnterInvoke(FSM11STD::true_type)
     {
         FSM11STD::get<0>(m_data)
-                = this->stateMachine()->threadPool().enqueue(*this);
+                = this->stateMachine()->threadPool().enqueue(
+                      *this, &this->stateMachine()->threadPoolClient());
+    }
+
+    void doExitInvoke(FSM11STD::false_type)
+    {
+    }
+
+    void doExitInvoke(FSM11STD::true_type)
+    {
+        this->stateMachine()->threadPool().release(*this);
     }
 };
 
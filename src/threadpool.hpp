@@ -30,24 +30,24 @@
 #define FSM11_THREADPOOL_HPP
 
 #include "statemachine_fwd.hpp"
-#include "error.hpp"
+#include "threadattributes.hpp"
 #include "detail/threadedstatebase.hpp"
+#include "detail/threadpoolcore.hpp"
 
 #ifdef FSM11_USE_WEOS
-#include <boost/container/static_vector.hpp>
-#include <weos/condition_variable.hpp>
+#include <weos/chrono.hpp>
 #include <weos/future.hpp>
-#include <weos/mutex.hpp>
+#include <weos/memory.hpp>
 #include <weos/thread.hpp>
 #include <weos/tuple.hpp>
 #include <weos/utility.hpp>
 #else
-#include <condition_variable>
+#include <algorithm>
+#include <chrono>
 #include <future>
-#include <mutex>
+#include <memory>
 #include <thread>
 #include <utility>
-#include <vector>
 #endif // FSM11_USE_WEOS
 
 
@@ -68,58 +68,168 @@ struct all<THead, TTail...> : FSM11STD::conditional<THead,
 {
 };
 
-} // namespace fsm11_detail
+//! \brief The common base of the thread pools.
+//!
+//! The ThreadPoolBase owns the core of a thread pool and forwards to it.
+class ThreadPoolBase
+{
+public:
+    using duration = ThreadPoolCore::duration;
 
+    ThreadPoolBase(const ThreadPoolBase&) = delete;
+    ThreadPoolBase& operator=(const ThreadPoolBase&) = delete;
 
-template <std::size_t TSize>
-class ThreadPool
-{
-    static_assert(TSize > 0, "The thread pool must be non-empty.");
+    //! Returns the current number of workers.
+    std::size_t size() const noexcept
+    {
+        return m_core->numWorkers();
+    }
 
-    struct Task
+    //! Returns the number of invoke actions, which wait for a worker.
+    std::size_t queueSize() const noexcept
     {
-        Task(fsm11_detail::ThreadedStateBase& s)
-            : state(s)
-        {
-        }
+        return m_core->numQueuedTasks();
+    }
 
-        Task(Task&& other)
-            : promise(FSM11STD::move(other.promise)),
-              state(other.state)
-        {
-        }
+    //! Returns the number of invoke actions, which are running.
+    std::size_t numRunningTasks() const noexcept
+    {
+        return m_core->numRunningTasks();
+    }
 
-        Task(const Task&) = delete;
-        Task& operator=(const Task&) = delete;
+    //! \brief Returns the maximum number of queued tasks.
+    //!
+    //! Returns the maximum number of tasks, which are queued when all
+    //! workers are busy. By default, the queue is unbounded.
+    std::size_t maxQueueSize() const noexcept
+    {
+        return m_core->maxQueueSize();
+    }
 
-        FSM11STD::promise<void> promise;
-        fsm11_detail::ThreadedStateBase& state;
-    };
+    //! \brief Sets the maximum number of queued tasks.
+    //!
+    //! Sets the maximum number of tasks, which are queued when all workers
+    //! are busy, to \p size. A size of zero disables queuing, i.e. a task is
+    //! only accepted if an idle worker is available.
+    void setMaxQueueSize(std::size_t size) noexcept
+    {
+        m_core->setMaxQueueSize(size);
+    }
 
-    struct Handle
+    //! \brief Enqueues the invoke action of a state.
+    //!
+    //! Enqueues the invoke action of the \p state on behalf of the
+    //! \p client and returns a future, which is satisfied when the invoke
+    //! action is completed. The \p client may be a null-pointer.
+    FSM11STD::future<void> enqueue(ThreadedStateBase& state,
+                                   ThreadPoolClient* client = nullptr)
     {
-        explicit Handle(ThreadPool* pool, std::size_t id);
+        return m_core->enqueue(state, client);
+    }
 
-        Handle(const Handle&) = delete;
-        Handle& operator=(const Handle&) = delete;
+    //! \brief Releases the invoke action of a state.
+    //!
+    //! This function has to be called after an exit has been requested
+    //! from the \p state. If the invoke action is still queued, the function
+    //! blocks until either a worker has started it or all workers are busy.
+    //! In the latter case, the invoke action is cancelled. An invoke action,
+    //! which is pending in its client, is cancelled immediately.
+    void release(ThreadedStateBase& state)
+    {
+        m_core->release(state);
+    }
+
+    //! \brief Detaches a client.
+    //!
+    //! Removes the \p client from the pool and cancels its invoke actions,
+    //! which wait for a worker. This function has to be called before the
+    //! client is destroyed.
+    void detach(ThreadPoolClient& client) noexcept
+    {
+        if (m_core)
+            m_core->detach(client);
+    }
 
-        bool hasChanged(ThreadPool* current) const
+protected:
+    using core_type = ThreadPoolCore;
+
+    ThreadPoolBase(std::size_t minWorkers, std::size_t maxWorkers)
+        : m_core(new core_type(minWorkers, maxWorkers))
+    {
+    }
+
+    ThreadPoolBase(ThreadPoolBase&& other) noexcept
+        : m_core(FSM11STD::move(other.m_core))
+    {
+    }
+
+    ~ThreadPoolBase()
+    {
+        if (m_core)
+            m_core->shutdown();
+    }
+
+    ThreadPoolBase& operator=(ThreadPoolBase&& other)
+    {
+        if (this != &other)
         {
-            return m_pool != current;
+            if (m_core)
+                m_core->shutdown();
+            m_core = FSM11STD::move(other.m_core);
         }
+        return *this;
+    }
 
-        ThreadPool* change(ThreadPool* current, std::size_t id);
+    FSM11STD::unique_ptr<core_type> m_core;
+};
 
-        ThreadPool* m_pool;
-        Handle* m_next{nullptr};
-    };
+} // namespace fsm11_detail
+
+
+//! \brief A pool of threads for invoke actions.
+//!
+//! The ThreadPool runs the invoke actions of ThreadedState%s in a fixed
+//! set of \p TSize worker threads. Every worker owns a queue of tasks.
+//! A new task is appended to one of the queues and an idle worker is woken
+//! up only if one is sleeping. Idle workers steal the oldest tasks from
+//! the queues of busy workers.
+//!
+//! If all workers are busy, a new task is queued until a worker becomes
+//! available. The number of queued tasks can be limited with
+//! setMaxQueueSize(). When the limit is reached, enqueuing another task
+//! throws an Error with the code ErrorCode::ThreadPoolUnderflow.
+//! When a state is left while its task is queued and all workers are
+//! busy, the task is cancelled. Otherwise, the invoke action might never
+//! be started because the workers are blocked by the invoke actions of
+//! other states, which are left later.
+//!
+//! A pool can be shared by many state machines. Every machine enqueues its
+//! tasks through a ThreadPoolClient. The clients are served round-robin,
+//! so a machine with many queued tasks does not delay the tasks of the
+//! other machines (see fsm11_detail::ThreadPoolClient).
+//!
+//! The workers and the queues live in a heap-allocated core. Moving a pool
+//! only transfers the core and does not involve the workers. A pool, which
+//! has been moved from, must not be used other than being destroyed or
+//! assigned to.
+template <std::size_t TSize>
+class ThreadPool : public fsm11_detail::ThreadPoolBase
+{
+    static_assert(TSize > 0, "The thread pool must be non-empty.");
+
+    using base_type = fsm11_detail::ThreadPoolBase;
 
 public:
-#ifdef FSM11_USE_WEOS
+    //! \brief Constructs a thread pool.
+    //!
+    //! Constructs a thread pool, whose workers are created with the given
+    //! thread attributes. One set of attributes has to be passed for
+    //! every worker, e.g. to pin every worker to a CPU of its own.
     template <typename... TAttributes>
-    explicit ThreadPool(const FSM11STD::thread::attributes& attr,
+    explicit ThreadPool(const ThreadAttributes& attr,
                         const TAttributes&... attributes);
-#else
+
+#ifndef FSM11_USE_WEOS
     //! Constructs a thread pool.
     ThreadPool();
 #endif // FSM11_USE_WEOS
@@ -127,277 +237,191 @@ public:
     ThreadPool(const ThreadPool&) = delete;
 
     //! Move-constructs a thread pool from the \p other pool.
-    ThreadPool(ThreadPool&& other);
-
-    //! Destroys the thread pool.
-    ~ThreadPool();
+    ThreadPool(ThreadPool&& other) noexcept = default;
 
     ThreadPool& operator=(const ThreadPool&) = delete;
 
     //! Move-assigns the \p other pool to this one.
-    ThreadPool& operator=(ThreadPool&& other);
-
-    FSM11STD::future<void> enqueue(fsm11_detail::ThreadedStateBase& state);
-
-private:
-    FSM11STD::mutex m_poolMutex;
-
-    FSM11STD::mutex m_workerMutex; // TODO: rethink the locking policy
-    FSM11STD::condition_variable m_workerCv;
-    FSM11STD::condition_variable m_assignmentCv;
-    unsigned m_assignedWorkers{0};
-    std::size_t m_idleWorkers{TSize};
-    Handle* m_handles{nullptr};
-#ifdef FSM11_USE_WEOS
-    boost::container::static_vector<Task, TSize> m_tasks;
-#else
-    FSM11STD::vector<Task> m_tasks;
-#endif
-
-
-    void moveTo(FSM11STD::unique_lock<FSM11STD::mutex>&& lock,
-                ThreadPool* newPool);
-
-    static void work(ThreadPool* pool, std::size_t id);
-
-#ifdef FSM11_USE_WEOS
-    template <typename TAttributes, std::size_t... TIndices>
-    void construct(TAttributes&& attributes,
-                   FSM11STD::integer_sequence<std::size_t, TIndices...>)
-    {
-        using namespace FSM11STD;
-
-        unsigned workers = 0;
-        try
-        {
-            call(constructOne(get<TIndices>(attributes), TIndices, workers)...);
-            unique_lock<mutex> lock(m_workerMutex);
-            m_assignmentCv.wait(lock,
-                                [&]{ return m_assignedWorkers == workers; });
-        }
-        catch (...)
-        {
-            unique_lock<mutex> lock(m_workerMutex);
-            m_assignmentCv.wait(lock,
-                                [&]{ return m_assignedWorkers == workers; });
-            moveTo(move(lock), nullptr);
-            throw;
-        }
-    }
-
-    int constructOne(const FSM11STD::thread::attributes& attr,
-                     std::size_t idx, unsigned& workers)
-    {
-        FSM11STD::thread(attr, &ThreadPool::work, this, idx).detach();
-        workers |= 1 << idx;
-        return 0;
-    }
-
-    template <typename... T>
-    void call(T...)
-    {
-    }
-#endif
+    ThreadPool& operator=(ThreadPool&& other) = default;
 };
 
-#ifdef FSM11_USE_WEOS
 template <std::size_t TSize>
 template <typename... TAttributes>
-ThreadPool<TSize>::ThreadPool(const FSM11STD::thread::attributes& attr,
+ThreadPool<TSize>::ThreadPool(const ThreadAttributes& attr,
                               const TAttributes&... attributes)
+    : base_type(TSize, TSize)
 {
     using namespace FSM11STD;
 
     static_assert(fsm11_detail::all<
-                      is_same<TAttributes, thread::attributes>::value...
+                      is_same<TAttributes, ThreadAttributes>::value...
                   >::value,
                   "All arguments have to be thread attributes");
     static_assert(1 + sizeof...(TAttributes) == TSize,
                   "The number of thread attributes must equal the pool size.");
 
-    construct(forward_as_tuple(attr, attributes...),
-              make_index_sequence<1 + sizeof...(attributes)>());
+    const ThreadAttributes* attrs[] = { &attr, &attributes... };
+    try
+    {
+        for (std::size_t idx = 0; idx < TSize; ++idx)
+        {
+            m_core->setThread(idx, fsm11_detail::makeThread(
+                                       *attrs[idx], &core_type::work,
+                                       m_core.get(), idx));
+        }
+    }
+    catch (...)
+    {
+        m_core->shutdown();
+        throw;
+    }
 }
-#else
+
+#ifndef FSM11_USE_WEOS
 template <std::size_t TSize>
 ThreadPool<TSize>::ThreadPool()
+    : base_type(TSize, TSize)
 {
     using namespace FSM11STD;
 
-    unsigned workers = 0;
     try
     {
         for (std::size_t idx = 0; idx < TSize; ++idx)
-        {
-            thread(&ThreadPool::work, this, idx).detach();
-            workers |= 1 << idx;
-        }
-
-        unique_lock<mutex> lock(m_workerMutex);
-        m_assignmentCv.wait(lock, [&]{ return m_assignedWorkers == workers; });
+            m_core->setThread(idx, thread(&core_type::work, m_core.get(), idx));
     }
     catch (...)
     {
-        unique_lock<mutex> lock(m_workerMutex);
-        m_assignmentCv.wait(lock, [&]{ return m_assignedWorkers == workers; });
-        moveTo(move(lock), nullptr);
+        m_core->shutdown();
         throw;
     }
 }
 #endif // FSM11_USE_WEOS
 
-template <std::size_t TSize>
-ThreadPool<TSize>::ThreadPool(ThreadPool&& other)
+//! \brief A thread pool with a variable number of workers.
+//!
+//! The DynamicThreadPool runs between a minimum and a maximum number of
+//! workers, which are configured at runtime. When no queued invoke action
+//! has been started for longer than growThreshold(), another worker is
+//! spawned. A worker, which has been idle for longer than idleTimeout(),
+//! retires unless the pool has reached its minimum size. Apart from that,
+//! the pool behaves like a ThreadPool. The current number of workers and
+//! the number of queued invoke actions can be queried with size() and
+//! queueSize().
+class DynamicThreadPool : public fsm11_detail::ThreadPoolBase
 {
-    using namespace FSM11STD;
-
-    lock_guard<mutex> otherPoolLock(m_poolMutex);
+    using base_type = fsm11_detail::ThreadPoolBase;
 
-    unique_lock<mutex> otherWorkerLock(other.m_workerMutex);
-    unsigned workers = other.m_assignedWorkers;
-    m_handles = other.m_handles;
-    other.moveTo(move(otherWorkerLock), this);
+public:
+    //! \brief Constructs a dynamic thread pool.
+    //!
+    //! Constructs a pool with at least \p minWorkers and at most
+    //! \p maxWorkers workers. All workers are created with the thread
+    //! attributes \p attrs.
+    DynamicThreadPool(std::size_t minWorkers, std::size_t maxWorkers,
+                      const ThreadAttributes& attrs = ThreadAttributes());
+
+    //! \brief Constructs a dynamic thread pool.
+    //!
+    //! Constructs a pool with one to defaultMaxWorkers() workers.
+    DynamicThreadPool()
+        : DynamicThreadPool(1, defaultMaxWorkers())
+    {
+    }
 
-    unique_lock<mutex> thisWorkerLock(m_workerMutex);
-    m_assignmentCv.wait(thisWorkerLock,
-                        [&]{ return m_assignedWorkers == workers; });
-}
+    //! Move-constructs a thread pool from the \p other pool.
+    DynamicThreadPool(DynamicThreadPool&& other) noexcept = default;
 
-template <std::size_t TSize>
-ThreadPool<TSize>::~ThreadPool()
-{
-    moveTo(FSM11STD::unique_lock<FSM11STD::mutex>(m_workerMutex), nullptr);
-}
+    //! Move-assigns the \p other pool to this one.
+    DynamicThreadPool& operator=(DynamicThreadPool&& other) = default;
 
-template <std::size_t TSize>
-auto ThreadPool<TSize>::operator=(ThreadPool&& other) -> ThreadPool&
-{
-    using namespace FSM11STD;
+    //! Returns the minimum number of workers.
+    std::size_t minSize() const noexcept
+    {
+        return m_core->minWorkers();
+    }
 
-    if (this == &other)
-        return *this;
+    //! Returns the maximum number of workers.
+    std::size_t maxSize() const noexcept
+    {
+        return m_core->maxWorkers();
+    }
 
-    // It is important to use a dead-lock avoiding algorithm for the
-    // two pool mutexes here or we dead-lock the application.
-    lock(m_poolMutex, other.m_poolMutex);
-    lock_guard<mutex> thisPoolLock(m_poolMutex, adopt_lock);
-    lock_guard<mutex> otherPoolLock(other.m_poolMutex, adopt_lock);
+    //! \brief Returns the grow threshold.
+    //!
+    //! Returns the time after which a new worker is spawned if no queued
+    //! invoke action has been started. The default is 10 ms.
+    duration growThreshold() const noexcept
+    {
+        return m_core->growThreshold();
+    }
 
-    moveTo(unique_lock<mutex>(m_workerMutex), nullptr);
+    //! Sets the grow threshold to \p threshold.
+    template <typename TRep, typename TPeriod>
+    void setGrowThreshold(
+            const FSM11STD::chrono::duration<TRep, TPeriod>& threshold)
+    {
+        m_core->setGrowThreshold(
+                    FSM11STD::chrono::duration_cast<duration>(threshold));
+    }
 
-    unique_lock<mutex> otherWorkerLock(other.m_workerMutex);
-    unsigned workers = other.m_assignedWorkers;
-    m_handles = other.m_handles;
-    other.moveTo(move(otherWorkerLock), this);
+    //! \brief Returns the idle timeout.
+    //!
+    //! Returns the time after which an idle worker retires. The default
+    //! is 10 s.
+    duration idleTimeout() const noexcept
+    {
+        return m_core->idleTimeout();
+    }
 
-    unique_lock<mutex> thisWorkerLock(m_workerMutex);
-    m_assignmentCv.wait(thisWorkerLock,
-                        [&]{ return m_assignedWorkers == workers; });
+    //! Sets the idle timeout to \p timeout.
+    template <typename TRep, typename TPeriod>
+    void setIdleTimeout(
+            const FSM11STD::chrono::duration<TRep, TPeriod>& timeout)
+    {
+        m_core->setIdleTimeout(
+                    FSM11STD::chrono::duration_cast<duration>(timeout));
+    }
 
-    return *this;
-}
+    //! Returns the default maximum number of workers, which is the number
+    //! of hardware threads.
+    static std::size_t defaultMaxWorkers() noexcept
+    {
+#ifdef FSM11_USE_WEOS
+        return 1;
+#else
+        return std::max(1u, FSM11STD::thread::hardware_concurrency());
+#endif // FSM11_USE_WEOS
+    }
+};
 
-template <std::size_t TSize>
-FSM11STD::future<void>
-ThreadPool<TSize>::enqueue(fsm11_detail::ThreadedStateBase& state)
+inline
+DynamicThreadPool::DynamicThreadPool(std::size_t minWorkers,
+                                     std::size_t maxWorkers,
+                                     const ThreadAttributes& attrs)
+    : base_type(minWorkers, maxWorkers)
 {
     using namespace FSM11STD;
 
-    lock_guard<mutex> lock(m_workerMutex);
-    if (m_idleWorkers == 0)
-        throw FSM11_EXCEPTION(Error(ErrorCode::ThreadPoolUnderflow));
-    --m_idleWorkers;
+    FSM11_ASSERT(maxWorkers > 0 && minWorkers <= maxWorkers);
 
-    m_tasks.emplace_back(state);
-    m_workerCv.notify_one();
-    return m_tasks.back().promise.get_future();
-}
-
-template <std::size_t TSize>
-void ThreadPool<TSize>::moveTo(FSM11STD::unique_lock<FSM11STD::mutex>&& lock,
-                               ThreadPool* newPool)
-{
-    for (Handle* iter = m_handles; iter != nullptr; iter = iter->m_next)
-        iter->m_pool = newPool;
-    m_workerCv.notify_all();
-    m_assignmentCv.wait(lock, [this]{ return m_assignedWorkers == 0; });
-    m_handles = nullptr;
-}
-
-template <std::size_t TSize>
-void ThreadPool<TSize>::work(ThreadPool* pool, std::size_t id)
-{
-    using namespace FSM11STD;
+    m_core->setThreadAttributes(attrs);
 
-    Handle handle(pool, id);
-    while (pool)
+    try
     {
-        unique_lock<mutex> lock(pool->m_workerMutex);
-        pool->m_workerCv.wait(
-                    lock,
-                    [&](){ return handle.hasChanged(pool)
-                                  || !pool->m_tasks.empty(); });
-        if (!pool->m_tasks.empty())
-        {
-            Task task = move(pool->m_tasks.back());
-            pool->m_tasks.pop_back();
-            lock.unlock();
-            try
-            {
-                task.state.invoke(task.state.m_exitRequest);
-                task.promise.set_value();
-            }
-            catch (...)
-            {
-                task.promise.set_exception(current_exception());
-            }
-            lock.lock();
-            ++pool->m_idleWorkers;
-        }
-        else if (handle.hasChanged(pool))
+        for (std::size_t idx = 0; idx < minWorkers; ++idx)
         {
-            pool = handle.change(pool, id);
+            m_core->setThread(idx, fsm11_detail::makeThread(
+                                       attrs, &core_type::work,
+                                       m_core.get(), idx));
         }
+        if (minWorkers < maxWorkers)
+            m_core->startSupervisor();
     }
-}
-
-template <std::size_t TSize>
-ThreadPool<TSize>::Handle::Handle(ThreadPool* pool, std::size_t id)
-    : m_pool(pool)
-{
-    pool->m_workerMutex.lock();
-    if (!pool->m_handles)
-    {
-        pool->m_handles = this;
-    }
-    else
-    {
-        Handle* iter = pool->m_handles;
-        while (iter->m_next)
-            iter = iter->m_next;
-        iter->m_next = this;
-    }
-    pool->m_assignedWorkers |= 1 << id;
-    pool->m_workerMutex.unlock();
-    pool->m_assignmentCv.notify_one();
-}
-
-template <std::size_t TSize>
-auto ThreadPool<TSize>::Handle::change(ThreadPool* current, std::size_t id)
-    -> ThreadPool*
-{
-    current->m_assignedWorkers &= ~(1 << id);
-    current->m_assignmentCv.notify_one();
-
-    if (m_pool)
+    catch (...)
     {
-        m_pool->m_workerMutex.lock();
-        m_pool->m_assignedWorkers |= 1 << id;
-        m_pool->m_workerMutex.unlock();
-        m_pool->m_assignmentCv.notify_one();
+        m_core->shutdown();
+        throw;
     }
-
-    return m_pool;
 }
 
 } // namespace fsm11
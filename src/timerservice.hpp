@@ -0,0 +1,369 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef FSM11_TIMERSERVICE_HPP
+#define FSM11_TIMERSERVICE_HPP
+
+#include "statemachine_fwd.hpp"
+#include "detail/timingwheel.hpp"
+
+#ifdef FSM11_USE_WEOS
+#include <weos/chrono.hpp>
+#include <weos/condition_variable.hpp>
+#include <weos/functional.hpp>
+#include <weos/memory.hpp>
+#include <weos/mutex.hpp>
+#include <weos/thread.hpp>
+#include <weos/utility.hpp>
+#else
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#endif // FSM11_USE_WEOS
+
+#include <cstdint>
+
+namespace fsm11
+{
+
+//! \brief A handle to a timer.
+//!
+//! A handle refers to a timer, which has been scheduled in a TimerService.
+//! It can be used to cancel the timer. A default-constructed handle refers
+//! to no timer.
+class TimerHandle
+{
+public:
+    TimerHandle() noexcept = default;
+
+    //! \brief Cancels the timer.
+    //!
+    //! Cancels the timer, if it is still pending. Returns \p true, if the
+    //! timer has been cancelled. If the timer's callback is running or
+    //! has been called already, \p false is returned.
+    inline
+    bool cancel() noexcept;
+
+    //! Returns \p true, if the timer is still pending.
+    inline
+    bool pending() const noexcept;
+
+    //! Returns \p true, if the handle refers to a timer.
+    explicit operator bool() const noexcept
+    {
+        return m_node != nullptr;
+    }
+
+private:
+    FSM11STD::shared_ptr<fsm11_detail::TimerNode> m_node;
+
+    explicit TimerHandle(FSM11STD::shared_ptr<fsm11_detail::TimerNode> node)
+        : m_node(FSM11STD::move(node))
+    {
+    }
+
+    friend class fsm11_detail::TimerServiceBase;
+};
+
+namespace fsm11_detail
+{
+
+//! \brief The clock-independent part of a timer service.
+class TimerServiceBase
+{
+public:
+    TimerServiceBase(const TimerServiceBase&) = delete;
+    TimerServiceBase& operator=(const TimerServiceBase&) = delete;
+
+    //! Returns the number of pending timers.
+    std::size_t size() const
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        return m_wheel.size();
+    }
+
+protected:
+    mutable FSM11STD::mutex m_mutex;
+    FSM11STD::condition_variable m_cv;
+    TimingWheel m_wheel;
+    //! The tick for which the service thread is sleeping.
+    std::uint64_t m_wakeUpTick{~std::uint64_t(0)};
+    bool m_stopped{false};
+
+    TimerServiceBase() = default;
+
+    ~TimerServiceBase()
+    {
+        // Drop the timers which have not expired.
+        TimerNode* node = m_wheel.clear();
+        while (node)
+        {
+            TimerNode* next = node->next;
+            node->status = TimerNode::Idle;
+            node->self.reset();
+            node = next;
+        }
+    }
+
+    //! Schedules the \p callback for the given \p tick.
+    TimerHandle schedule(std::uint64_t tick,
+                         FSM11STD::function<void()> callback)
+    {
+        FSM11STD::shared_ptr<TimerNode> node
+                = FSM11STD::make_shared<TimerNode>();
+        node->callback = FSM11STD::move(callback);
+        node->tick = tick;
+        node->service = this;
+
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        node->status = TimerNode::Pending;
+        node->self = node;
+        m_wheel.insert(node.get());
+        // Wake up the service thread if the new timer expires before the
+        // tick for which it is sleeping.
+        if (tick < m_wakeUpTick)
+            m_cv.notify_one();
+        return TimerHandle(FSM11STD::move(node));
+    }
+
+    //! \brief Fires the expired timers.
+    //!
+    //! Advances the wheel to the \p tick and calls the callbacks of the
+    //! expired timers. The callbacks are called without holding the mutex,
+    //! which must be locked by \p lock.
+    void fire(std::uint64_t tick, FSM11STD::unique_lock<FSM11STD::mutex>& lock)
+    {
+        TimerNode* node = m_wheel.advance(tick);
+        for (TimerNode* iter = node; iter; iter = iter->next)
+            iter->status = TimerNode::Firing;
+
+        while (node)
+        {
+            TimerNode* next = node->next;
+            lock.unlock();
+            try
+            {
+                node->callback();
+            }
+            catch (...)
+            {
+                // There is nobody to report the exception to.
+            }
+            lock.lock();
+            node->status = TimerNode::Idle;
+            node->self.reset();
+            node = next;
+        }
+    }
+
+    bool cancel(TimerNode* node) noexcept
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        if (node->status != TimerNode::Pending)
+            return false;
+        m_wheel.remove(node);
+        node->status = TimerNode::Idle;
+        node->self.reset();
+        return true;
+    }
+
+    bool pending(const TimerNode* node) const noexcept
+    {
+        FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+        return node->status == TimerNode::Pending;
+    }
+
+    friend class fsm11::TimerHandle;
+};
+
+} // namespace fsm11_detail
+
+bool TimerHandle::cancel() noexcept
+{
+    return m_node && m_node->service->cancel(m_node.get());
+}
+
+bool TimerHandle::pending() const noexcept
+{
+    return m_node && m_node->service->pending(m_node.get());
+}
+
+//! \brief A service for timers.
+//!
+//! A TimerService calls functions at given points in time. The timers are
+//! kept in a hierarchical timing wheel, whose tick length is the service's
+//! resolution. A timer is never fired before its point in time but may be
+//! up to one tick late.
+//!
+//! By default, the service runs a thread, which sleeps until the next timer
+//! expires and calls the timer's callback. As all timers share this thread,
+//! the callbacks must be short. A service without thread has to be driven
+//! by calling processExpired(). This is useful for clocks, which do not
+//! follow the real time, for example, in tests and replays.
+//!
+//! \p TClock is the clock type. It has to provide a static now() function.
+template <typename TClock = FSM11STD::chrono::steady_clock>
+class TimerService : public fsm11_detail::TimerServiceBase
+{
+public:
+    using clock = TClock;
+    using duration = typename TClock::duration;
+    using time_point = typename TClock::time_point;
+
+    //! \brief Creates a timer service.
+    //!
+    //! Creates a timer service whose tick has the length \p resolution. If
+    //! \p serviceThread is set, a thread is started which fires the timers.
+    explicit TimerService(duration resolution
+                              = FSM11STD::chrono::duration_cast<duration>(
+                                    FSM11STD::chrono::milliseconds(1)),
+                          bool serviceThread = true)
+        : m_origin(TClock::now()),
+          m_resolution(resolution > duration::zero() ? resolution
+                                                     : duration(1))
+    {
+        if (serviceThread)
+        {
+            m_thread = FSM11STD::thread(&TimerService::run, this);
+        }
+    }
+
+    //! Stops the service thread. Pending timers are dropped.
+    ~TimerService()
+    {
+        {
+            FSM11STD::lock_guard<FSM11STD::mutex> lock(m_mutex);
+            m_stopped = true;
+            m_cv.notify_one();
+        }
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    //! Returns the process-wide timer service for this clock.
+    static TimerService& instance()
+    {
+        static TimerService service;
+        return service;
+    }
+
+    //! Returns the length of a tick.
+    duration resolution() const noexcept
+    {
+        return m_resolution;
+    }
+
+    //! \brief Schedules a timer.
+    //!
+    //! Schedules the \p callback to be called at \p timePoint. Returns a
+    //! handle with which the timer can be cancelled.
+    template <typename TCallback>
+    TimerHandle scheduleAt(const time_point& timePoint, TCallback&& callback)
+    {
+        return schedule(tickAt(timePoint),
+                        FSM11STD::forward<TCallback>(callback));
+    }
+
+    //! \brief Schedules a timer.
+    //!
+    //! Schedules the \p callback to be called after the given \p delay.
+    //! Returns a handle with which the timer can be cancelled.
+    template <typename TRep, typename TPeriod, typename TCallback>
+    TimerHandle scheduleAfter(
+            const FSM11STD::chrono::duration<TRep, TPeriod>& delay,
+            TCallback&& callback)
+    {
+        return scheduleAt(
+                    TClock::now()
+                    + FSM11STD::chrono::duration_cast<duration>(delay),
+                    FSM11STD::forward<TCallback>(callback));
+    }
+
+    //! \brief Fires the expired timers.
+    //!
+    //! Calls the callbacks of all timers, which have expired, in the
+    //! calling thread.
+    void processExpired()
+    {
+        FSM11STD::unique_lock<FSM11STD::mutex> lock(m_mutex);
+        fire(currentTick(), lock);
+    }
+
+private:
+    time_point m_origin;
+    duration m_resolution;
+    FSM11STD::thread m_thread;
+
+    //! Returns the first tick, which starts at or after the \p timePoint.
+    std::uint64_t tickAt(const time_point& timePoint) const
+    {
+        if (timePoint <= m_origin)
+            return 0;
+        return (timePoint - m_origin + m_resolution - duration(1))
+               / m_resolution;
+    }
+
+    //! Returns the tick in which the clock is now.
+    std::uint64_t currentTick() const
+    {
+        time_point now = TClock::now();
+        if (now <= m_origin)
+            return 0;
+        return (now - m_origin) / m_resolution;
+    }
+
+    void run()
+    {
+        FSM11STD::unique_lock<FSM11STD::mutex> lock(m_mutex);
+        while (!m_stopped)
+        {
+            fire(currentTick(), lock);
+            if (m_stopped)
+                break;
+
+            if (m_wheel.empty())
+            {
+                m_wakeUpTick = ~std::uint64_t(0);
+                m_cv.wait(lock);
+            }
+            else
+            {
+                m_wakeUpTick = m_wheel.nextTick();
+                m_cv.wait_until(lock, m_origin + m_resolution * m_wakeUpTick);
+            }
+        }
+    }
+};
+
+} // namespace fsm11
+
+#endif // FSM11_TIMERSERVICE_HPP
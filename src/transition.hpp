@@ -32,11 +32,15 @@
 #include "statemachine_fwd.hpp"
 
 #ifdef FSM11_USE_WEOS
+#include <weos/chrono.hpp>
 #include <weos/functional.hpp>
+#include <weos/memory.hpp>
 #include <weos/type_traits.hpp>
 #include <weos/utility.hpp>
 #else
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <type_traits>
 #include <utility>
 #endif // FSM11_USE_WEOS
@@ -700,6 +704,209 @@ auto operator>(external_t, SourceNoEventGuardAction<State<TSm>, TGuard, TAction>
                 true);
 }
 
+// ----=====================================================================----
+//     Intermediate types for timed transitions
+// ----=====================================================================----
+
+template <typename TState, typename TAction>
+class TypeSourceAfterActionTarget
+{
+    static_assert(FSM11STD::is_reference<TAction>::value, "TAction must be a reference");
+
+public:
+    constexpr
+    TypeSourceAfterActionTarget(TState* source, TState* target,
+                                FSM11STD::chrono::nanoseconds delay,
+                                TAction action) noexcept
+        : m_source(source),
+          m_target(target),
+          m_delay(delay),
+          m_action(FSM11STD::forward<TAction>(action))
+    {
+    }
+
+    constexpr
+    TypeSourceAfterActionTarget(TypeSourceAfterActionTarget&& other) noexcept
+        : m_source(other.m_source),
+          m_target(other.m_target),
+          m_delay(other.m_delay),
+          m_action(FSM11STD::forward<TAction>(other.m_action))
+    {
+    }
+
+    TypeSourceAfterActionTarget(const TypeSourceAfterActionTarget&) = delete;
+    TypeSourceAfterActionTarget& operator=(const TypeSourceAfterActionTarget&) = delete;
+
+private:
+    TState* m_source;
+    TState* m_target;
+    FSM11STD::chrono::nanoseconds m_delay;
+    TAction m_action;
+
+    template <typename TStateMachine>
+    friend class fsm11::Transition;
+};
+
+template <typename TState, typename TAction>
+class SourceAfterAction
+{
+    static_assert(FSM11STD::is_reference<TAction>::value, "TAction must be a reference");
+
+public:
+    constexpr
+    SourceAfterAction(TState* source, FSM11STD::chrono::nanoseconds delay,
+                      TAction action) noexcept
+        : m_source(source),
+          m_delay(delay),
+          m_action(FSM11STD::forward<TAction>(action))
+    {
+    }
+
+    constexpr
+    SourceAfterAction(SourceAfterAction&& other) noexcept
+        : m_source(other.m_source),
+          m_delay(other.m_delay),
+          m_action(FSM11STD::forward<TAction>(other.m_action))
+    {
+    }
+
+    SourceAfterAction(const SourceAfterAction&) = delete;
+    SourceAfterAction& operator=(const SourceAfterAction&) = delete;
+
+    constexpr
+    TypeSourceAfterActionTarget<TState, TAction> operator>(
+            TState& target) const noexcept
+    {
+        return TypeSourceAfterActionTarget<TState, TAction>(
+                    m_source, &target, m_delay,
+                    FSM11STD::forward<TAction>(m_action));
+    }
+
+    constexpr
+    TypeSourceAfterActionTarget<TState, TAction> operator>(
+            noTarget_t) const noexcept
+    {
+        return TypeSourceAfterActionTarget<TState, TAction>(
+                    m_source, nullptr, m_delay,
+                    FSM11STD::forward<TAction>(m_action));
+    }
+
+    TState* m_source;
+    FSM11STD::chrono::nanoseconds m_delay;
+    TAction m_action;
+};
+
+template <typename TAction>
+struct AfterAction
+{
+    static_assert(FSM11STD::is_reference<TAction>::value, "TAction must be a reference");
+
+    constexpr
+    AfterAction(FSM11STD::chrono::nanoseconds delay, TAction action) noexcept
+        : m_delay(delay),
+          m_action(FSM11STD::forward<TAction>(action))
+    {
+    }
+
+    constexpr
+    AfterAction(AfterAction&& other) noexcept
+        : m_delay(other.m_delay),
+          m_action(FSM11STD::forward<TAction>(other.m_action))
+    {
+    }
+
+    AfterAction(const AfterAction&) = delete;
+    AfterAction& operator=(const AfterAction&) = delete;
+
+    FSM11STD::chrono::nanoseconds m_delay;
+    TAction m_action;
+};
+
+struct After
+{
+    constexpr
+    explicit After(FSM11STD::chrono::nanoseconds delay) noexcept
+        : m_delay(delay)
+    {
+    }
+
+    template <typename TAction>
+    constexpr
+    AfterAction<TAction&&> operator/(TAction&& action) const noexcept
+    {
+        return AfterAction<TAction&&>(m_delay,
+                                      FSM11STD::forward<TAction>(action));
+    }
+
+    FSM11STD::chrono::nanoseconds m_delay;
+};
+
+template <typename TSm>
+constexpr
+auto operator+(State<TSm>& source, After rhs) noexcept
+    -> SourceAfterAction<State<TSm>, FSM11STD::nullptr_t&&>
+{
+    return SourceAfterAction<State<TSm>, FSM11STD::nullptr_t&&>(
+                &source, rhs.m_delay, nullptr);
+}
+
+template <typename TSm, typename TAction>
+constexpr
+auto operator+(State<TSm>& source, AfterAction<TAction>&& rhs) noexcept
+    -> SourceAfterAction<State<TSm>, TAction>
+{
+    return SourceAfterAction<State<TSm>, TAction>(
+                &source, rhs.m_delay,
+                FSM11STD::forward<TAction>(rhs.m_action));
+}
+
+// Defined in detail/timers.hpp.
+struct TransitionTimeout;
+
+template <typename TOptions>
+class WithTimers;
+
+//! \brief Stores the timeout of a timed transition.
+//!
+//! A transition holds its timeout only if timers are enabled. Otherwise,
+//! the storage is empty and timeout() always returns a null-pointer.
+template <bool TEnable, typename TTimeout = TransitionTimeout>
+class TransitionTimeoutStorage
+{
+protected:
+    TransitionTimeoutStorage() noexcept = default;
+
+    explicit TransitionTimeoutStorage(FSM11STD::chrono::nanoseconds delay)
+        : m_timeout(new TTimeout(delay))
+    {
+    }
+
+    //! Returns the timeout of a timed transition or a null-pointer.
+    TTimeout* timeout() const noexcept
+    {
+        return m_timeout.get();
+    }
+
+private:
+    FSM11STD::unique_ptr<TTimeout> m_timeout;
+};
+
+template <typename TTimeout>
+class TransitionTimeoutStorage<false, TTimeout>
+{
+protected:
+    TransitionTimeoutStorage() noexcept = default;
+
+    explicit TransitionTimeoutStorage(FSM11STD::chrono::nanoseconds) noexcept
+    {
+    }
+
+    TTimeout* timeout() const noexcept
+    {
+        return nullptr;
+    }
+};
+
 } // namespace fsm11_detail
 
 // ----=====================================================================----
@@ -709,8 +916,12 @@ auto operator>(external_t, SourceNoEventGuardAction<State<TSm>, TGuard, TAction>
 //! \brief A transition.
 template <typename TStateMachine>
 class Transition
+        : private fsm11_detail::TransitionTimeoutStorage<
+              fsm11_detail::get_options<TStateMachine>::type::timer_enable>
 {
     using options = typename fsm11_detail::get_options<TStateMachine>::type;
+    using timeout_storage = fsm11_detail::TransitionTimeoutStorage<
+                                options::timer_enable>;
 
 public:
     using state_type = State<TStateMachine>;
@@ -755,6 +966,27 @@ public:
     {
     }
 
+    //! \brief Creates a transition.
+    //!
+    //! Creates a timed transition from the specification \p rhs. The
+    //! transition is eventless but can only be taken after its source
+    //! state has been active for the given delay.
+    template <typename TState, typename TAction>
+    explicit Transition(fsm11_detail::TypeSourceAfterActionTarget<
+                            TState, TAction>&& rhs)
+        : timeout_storage(rhs.m_delay),
+          m_source(rhs.m_source),
+          m_target(rhs.m_target),
+          m_nextInSourceState{nullptr},
+          m_nextInEnabledSet{nullptr},
+          m_guard(),
+          m_action{FSM11STD::forward<TAction>(rhs.m_action)},
+          m_event(),
+          m_eventless(true),
+          m_isExternal(true)
+    {
+    }
+
     Transition(const Transition&) = delete;
     Transition& operator=(const Transition&) = delete;
 
@@ -840,12 +1072,14 @@ private:
     bool m_eventless;
     bool m_isExternal;
 
-
     friend state_type;
     friend TStateMachine;
 
     template <typename TDerived>
     friend class fsm11_detail::EventDispatcherBase;
+
+    template <typename TOptions>
+    friend class fsm11_detail::WithTimers;
 };
 
 //! \brief Names an event in a transition specification.
@@ -856,6 +1090,21 @@ fsm11_detail::Event<TEvent&&> event(TEvent&& ev) noexcept
     return fsm11_detail::Event<TEvent&&>(FSM11STD::forward<TEvent>(ev));
 }
 
+//! \brief Creates a timed transition.
+//!
+//! A transition <tt>source + after(delay) > target</tt> is taken when the
+//! source state has been active for the given \p delay. The timeout is
+//! cancelled when the source state is left before.
+template <typename TRep, typename TPeriod>
+constexpr
+fsm11_detail::After after(
+        const FSM11STD::chrono::duration<TRep, TPeriod>& delay) noexcept
+{
+    return fsm11_detail::After(
+                FSM11STD::chrono::duration_cast<FSM11STD::chrono::nanoseconds>(
+                    delay));
+}
+
 //! A tag to create eventless transitions.
 constexpr fsm11_detail::NoEvent noEvent = fsm11_detail::NoEvent();
 
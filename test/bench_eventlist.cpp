@@ -0,0 +1,140 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/statemachine.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+
+using namespace fsm11;
+
+// The benchmarks are hidden test cases. Run them with
+//     unittest "[benchmark]"
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+// Pushes bursts of burstSize elements into the list and pops them again.
+// Returns the time per element in nanoseconds.
+template <typename TList>
+double measureList(unsigned burstSize, unsigned numElements)
+{
+    using namespace std::chrono;
+
+    TList list;
+    unsigned long sum = 0;
+    auto start = clock_type::now();
+    for (unsigned count = 0; count < numElements; count += burstSize)
+    {
+        for (unsigned idx = 0; idx < burstSize; ++idx)
+            list.push_back(idx);
+        while (!list.empty())
+        {
+            sum += list.front();
+            list.pop_front();
+        }
+    }
+    auto elapsed = duration_cast<duration<double, std::nano>>(
+                       clock_type::now() - start).count();
+    // Prevent the compiler from optimizing the loop away.
+    if (sum == 42)
+        std::printf(" ");
+    return elapsed / numElements;
+}
+
+// Adds bursts of burstSize events to an asynchronous state machine and
+// dispatches them. Returns the time per event in nanoseconds.
+template <typename TStateMachine>
+double measureStateMachine(unsigned burstSize, unsigned numEvents)
+{
+    using namespace std::chrono;
+
+    TStateMachine sm;
+    sm.start();
+    sm.dispatchPending();
+
+    auto start = clock_type::now();
+    for (unsigned count = 0; count < numEvents; count += burstSize)
+    {
+        for (unsigned idx = 0; idx < burstSize; ++idx)
+            sm.addEvent(idx);
+        sm.dispatchPending();
+    }
+    auto elapsed = duration_cast<duration<double, std::nano>>(
+                       clock_type::now() - start).count();
+
+    sm.stop();
+    sm.dispatchPending();
+    return elapsed / numEvents;
+}
+
+} // anonymous namespace
+
+TEST_CASE("event list throughput", "[.][benchmark]")
+{
+    const unsigned numElements = 1 << 22;
+
+    for (unsigned burstSize = 1; burstSize <= 4096; burstSize *= 8)
+    {
+        double dequeTime = measureList<std::deque<int>>(
+                               burstSize, numElements);
+        double ringTime = measureList<RingBuffer<int>>(
+                              burstSize, numElements);
+
+        std::printf("burst %4u: %6.2f ns/element with std::deque, "
+                    "%6.2f ns/element with RingBuffer\n",
+                    burstSize, dequeTime, ringTime);
+    }
+}
+
+TEST_CASE("event dispatching with different event lists", "[.][benchmark]")
+{
+    using DequeStateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                             EventListType<std::deque<int>>>;
+    using RingStateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                            EventListType<RingBuffer<int>>>;
+
+    const unsigned numEvents = 1 << 20;
+
+    for (unsigned burstSize = 1; burstSize <= 4096; burstSize *= 8)
+    {
+        double dequeTime = measureStateMachine<DequeStateMachine_t>(
+                               burstSize, numEvents);
+        double ringTime = measureStateMachine<RingStateMachine_t>(
+                              burstSize, numEvents);
+
+        std::printf("burst %4u: %6.2f ns/event with std::deque, "
+                    "%6.2f ns/event with RingBuffer\n",
+                    burstSize, dequeTime, ringTime);
+    }
+}
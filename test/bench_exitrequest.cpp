@@ -0,0 +1,156 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/statemachine.hpp"
+#include "../src/threadedstate.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace fsm11;
+
+// The benchmarks are hidden test cases. Run them with
+//     unittest "[benchmark]"
+
+namespace
+{
+
+using StateMachine_t = StateMachine<>;
+using clock_type = std::chrono::steady_clock;
+
+std::atomic<unsigned long> g_numPolls;
+
+class PollingState : public ThreadedState<StateMachine_t>
+{
+public:
+    using ThreadedState<StateMachine_t>::ThreadedState;
+
+    virtual void invoke(fsm11::ExitRequest& exitRequest) override
+    {
+        unsigned long polls = 0;
+        while (!exitRequest)
+            ++polls;
+        g_numPolls += polls;
+    }
+};
+
+// A state which polls a flag guarded by a mutex like ExitRequest did
+// before the flag has been made atomic.
+class LockedPollingState : public State<StateMachine_t>
+{
+public:
+    using State<StateMachine_t>::State;
+
+    virtual void enterInvoke() override
+    {
+        setRequested(false);
+        m_thread = std::thread([this] {
+            unsigned long polls = 0;
+            while (!requested())
+                ++polls;
+            g_numPolls += polls;
+        });
+    }
+
+    virtual void exitInvoke() override
+    {
+        setRequested(true);
+        m_thread.join();
+    }
+
+private:
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    bool m_requested{false};
+
+    bool requested() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_requested;
+    }
+
+    void setRequested(bool requested)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requested = requested;
+    }
+};
+
+// Runs numStates parallel states which poll their exit request for the
+// given time. Returns the number of polls per microsecond.
+template <typename TState>
+double measurePolling(unsigned numStates,
+                      std::chrono::milliseconds pollingTime)
+{
+    using namespace std::chrono;
+
+    // The states must be destructed after sm's destructor has been called.
+    std::vector<std::unique_ptr<TState>> states;
+    StateMachine_t sm;
+    sm.setChildMode(ChildMode::Parallel);
+    for (unsigned count = 0; count < numStates; ++count)
+        states.emplace_back(new TState("s", &sm));
+
+    g_numPolls = 0;
+    auto start = clock_type::now();
+    sm.start();
+    std::this_thread::sleep_for(pollingTime);
+    sm.stop();
+    auto elapsed = duration_cast<duration<double, std::micro>>(
+                       clock_type::now() - start).count();
+    return g_numPolls / elapsed;
+}
+
+} // anonymous namespace
+
+TEST_CASE("exit request polling", "[.][benchmark]")
+{
+    const std::chrono::milliseconds pollingTime(200);
+    unsigned maxStates = std::thread::hardware_concurrency();
+    if (maxStates == 0)
+        maxStates = 1;
+
+    for (unsigned numStates = 1; numStates <= maxStates; numStates *= 2)
+    {
+        double lockedRate = measurePolling<LockedPollingState>(
+                                numStates, pollingTime);
+        double atomicRate = measurePolling<PollingState>(
+                                numStates, pollingTime);
+
+        std::printf("%3u polling states: %10.2f polls/us with a mutex, "
+                    "%10.2f polls/us with an atomic\n",
+                    numStates, lockedRate, atomicRate);
+    }
+}
@@ -0,0 +1,156 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/locks.hpp"
+#include "../src/statemachine.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <mutex>
+#include <vector>
+
+using namespace fsm11;
+
+// The benchmarks are hidden test cases. Run them with
+//     unittest "[benchmark]"
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+// Lets numThreads threads enter a tiny critical section numIterations
+// times each. Returns the time per lock/unlock pair in nanoseconds.
+template <typename TLock>
+double measureLock(unsigned numThreads, unsigned numIterations)
+{
+    using namespace std::chrono;
+
+    TLock lock;
+    unsigned long counter = 0;
+    std::vector<std::future<void>> workers;
+
+    auto start = clock_type::now();
+    for (unsigned idx = 0; idx < numThreads; ++idx)
+    {
+        workers.push_back(std::async(std::launch::async, [&] {
+            for (unsigned count = 0; count < numIterations; ++count)
+            {
+                std::lock_guard<TLock> guard(lock);
+                ++counter;
+            }
+        }));
+    }
+    for (auto& worker : workers)
+        worker.get();
+    auto elapsed = duration_cast<duration<double, std::nano>>(
+                       clock_type::now() - start).count();
+    // Prevent the compiler from optimizing the loop away.
+    if (counter == 42)
+        std::printf(" ");
+    return elapsed / (numThreads * numIterations);
+}
+
+// Lets numThreads threads add events to a synchronous, multithreaded state
+// machine. Returns the time per event in nanoseconds.
+template <typename TLock>
+double measureStateMachine(unsigned numThreads, unsigned numEvents)
+{
+    using namespace std::chrono;
+
+    using StateMachine_t = StateMachine<MultithreadingEnable<true>,
+                                        LockType<TLock>>;
+    using State_t = typename StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(1) > a;
+    sm.start();
+
+    std::vector<std::future<void>> workers;
+    auto start = clock_type::now();
+    for (unsigned idx = 0; idx < numThreads; ++idx)
+    {
+        workers.push_back(std::async(std::launch::async, [&] {
+            for (unsigned count = 0; count < numEvents; ++count)
+                sm.addEvent(1);
+        }));
+    }
+    for (auto& worker : workers)
+        worker.get();
+    auto elapsed = duration_cast<duration<double, std::nano>>(
+                       clock_type::now() - start).count();
+
+    sm.stop();
+    return elapsed / (numThreads * numEvents);
+}
+
+} // anonymous namespace
+
+TEST_CASE("lock contention", "[.][benchmark]")
+{
+    const unsigned numIterations = 1 << 20;
+
+    for (unsigned numThreads = 1; numThreads <= 8; numThreads *= 2)
+    {
+        double mutexTime = measureLock<std::mutex>(numThreads, numIterations);
+        double spinTime = measureLock<SpinLock>(numThreads, numIterations);
+        double adaptiveTime = measureLock<AdaptiveMutex>(numThreads,
+                                                         numIterations);
+
+        std::printf("%u threads: %6.2f ns/lock with std::mutex, "
+                    "%6.2f ns/lock with SpinLock, "
+                    "%6.2f ns/lock with AdaptiveMutex\n",
+                    numThreads, mutexTime, spinTime, adaptiveTime);
+    }
+}
+
+TEST_CASE("event dispatching with different locks", "[.][benchmark]")
+{
+    const unsigned numEvents = 1 << 17;
+
+    for (unsigned numThreads = 1; numThreads <= 8; numThreads *= 2)
+    {
+        double mutexTime = measureStateMachine<std::mutex>(
+                               numThreads, numEvents);
+        double spinTime = measureStateMachine<SpinLock>(
+                              numThreads, numEvents);
+        double adaptiveTime = measureStateMachine<AdaptiveMutex>(
+                                  numThreads, numEvents);
+
+        std::printf("%u threads: %6.2f ns/event with std::mutex, "
+                    "%6.2f ns/event with SpinLock, "
+                    "%6.2f ns/event with AdaptiveMutex\n",
+                    numThreads, mutexTime, spinTime, adaptiveTime);
+    }
+}
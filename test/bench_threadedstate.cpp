@@ -0,0 +1,115 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/statemachine.hpp"
+#include "../src/threadedstate.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+
+using namespace fsm11;
+
+// The benchmarks are hidden test cases. Run them with
+//     unittest "[benchmark]"
+
+namespace
+{
+
+using StateMachine_t = StateMachine<>;
+using clock_type = std::chrono::steady_clock;
+
+class CachedState : public ThreadedState<StateMachine_t>
+{
+public:
+    using ThreadedState<StateMachine_t>::ThreadedState;
+
+    virtual void invoke(fsm11::ExitRequest&) override
+    {
+    }
+};
+
+// A state which starts a new thread on every entry like ThreadedState
+// did before the thread cache has been introduced.
+class AsyncState : public State<StateMachine_t>
+{
+public:
+    using State<StateMachine_t>::State;
+
+    virtual void enterInvoke() override
+    {
+        m_result = std::async(std::launch::async, [] {});
+    }
+
+    virtual void exitInvoke() override
+    {
+        m_result.get();
+    }
+
+private:
+    std::future<void> m_result;
+};
+
+template <typename TState>
+double measureCycles(int numCycles)
+{
+    using namespace std::chrono;
+
+    StateMachine_t sm;
+    TState a("a", &sm);
+    State<StateMachine_t> b("b", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(2) > a;
+
+    sm.start();
+    auto start = clock_type::now();
+    for (int count = 0; count < numCycles; ++count)
+    {
+        sm.addEvent(1);
+        sm.addEvent(2);
+    }
+    auto elapsed = duration_cast<duration<double, std::micro>>(
+                       clock_type::now() - start).count();
+    sm.stop();
+    return elapsed / numCycles;
+}
+
+} // anonymous namespace
+
+TEST_CASE("threaded state entry/exit cycle", "[.][benchmark]")
+{
+    const int numCycles = 10000;
+
+    double asyncTime = measureCycles<AsyncState>(numCycles);
+    double cachedTime = measureCycles<CachedState>(numCycles);
+
+    std::printf("entry/exit cycle with std::async: %8.2f us\n", asyncTime);
+    std::printf("entry/exit cycle with thread cache: %8.2f us\n", cachedTime);
+}
@@ -0,0 +1,135 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/statemachine.hpp"
+#include "../src/threadedstate.hpp"
+#include "../src/threadpool.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace fsm11;
+
+// The benchmarks are hidden test cases. Run them with
+//     unittest "[benchmark]"
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+double elapsedMicroseconds(clock_type::time_point start)
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double, std::micro>>(
+                clock_type::now() - start).count();
+}
+
+template <typename TBaseState>
+class BenchmarkState : public TBaseState
+{
+public:
+    using TBaseState::TBaseState;
+
+    virtual void invoke(fsm11::ExitRequest&) override
+    {
+        // Simulate a short amount of work.
+        volatile unsigned sum = 0;
+        for (unsigned count = 0; count < 1000; ++count)
+            sum += count;
+    }
+};
+
+template <std::size_t TSize>
+void benchmarkThreadPool()
+{
+    using StateMachine_t = StateMachine<ThreadPoolEnable<true, TSize>>;
+    using ThreadPool_t = typename StateMachine_t::thread_pool_type;
+    using State_t = ThreadedState<StateMachine_t>;
+
+    struct Machine
+    {
+        explicit Machine(std::shared_ptr<ThreadPool_t> pool)
+            : sm(std::move(pool)),
+              state("s", &sm)
+        {
+        }
+
+        StateMachine_t sm;
+        BenchmarkState<State_t> state;
+    };
+
+    const int numMachines = 256;
+    const int numRounds = 20;
+
+    auto start = clock_type::now();
+    ThreadPool_t pool;
+    double constructionTime = elapsedMicroseconds(start);
+
+    start = clock_type::now();
+    auto sharedPool = std::make_shared<ThreadPool_t>(std::move(pool));
+    double moveTime = elapsedMicroseconds(start);
+
+    std::vector<std::unique_ptr<Machine>> machines;
+    for (int count = 0; count < numMachines; ++count)
+        machines.emplace_back(new Machine(sharedPool));
+
+    start = clock_type::now();
+    for (int round = 0; round < numRounds; ++round)
+    {
+        for (auto& machine : machines)
+            machine->sm.start();
+        for (auto& machine : machines)
+            machine->sm.stop();
+    }
+    double runTime = elapsedMicroseconds(start);
+
+    std::printf("%4u workers: construct %10.1f us, move %8.1f us, "
+                "%10.0f invocations/s\n",
+                unsigned(TSize), constructionTime, moveTime,
+                numMachines * numRounds / runTime * 1e6);
+}
+
+} // anonymous namespace
+
+TEST_CASE("thread pool scaling", "[.][benchmark]")
+{
+    benchmarkThreadPool<1>();
+    benchmarkThreadPool<2>();
+    benchmarkThreadPool<4>();
+    benchmarkThreadPool<8>();
+    benchmarkThreadPool<16>();
+    benchmarkThreadPool<32>();
+    benchmarkThreadPool<64>();
+    benchmarkThreadPool<128>();
+}
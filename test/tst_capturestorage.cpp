@@ -31,6 +31,9 @@
 #include "../src/statemachine.hpp"
 #include "testutils.hpp"
 
+#include <atomic>
+#include <future>
+
 using namespace fsm11;
 
 TEST_CASE("empty storage", "[storage]")
@@ -157,3 +160,142 @@ TEST_CASE("capture storage callback is executed", "[storage]")
     sm.start();
     REQUIRE(sm.load<0>() == 31);
 }
+
+TEST_CASE("lock-free storage", "[storage]")
+{
+    using StateMachine_t = fsm11::StateMachine<
+                               CaptureStorage<double, int, Color>,
+                               LockFreeCaptureStorageEnable<true>>;
+    StateMachine_t sm;
+
+    REQUIRE(sm.load<1>() == 0);
+
+    sm.store<0>(3.14);
+    sm.store<1>(42);
+    sm.store<2>(Yellow);
+    REQUIRE(sm.load<0>() == 3.14);
+    REQUIRE(sm.load<1>() == 42);
+    REQUIRE(sm.load<2>() == Yellow);
+
+    auto all = sm.loadAll();
+    REQUIRE(std::get<0>(all) == 3.14);
+    REQUIRE(std::get<1>(all) == 42);
+    REQUIRE(std::get<2>(all) == Yellow);
+}
+
+TEST_CASE("lock-free storage callback is executed when dirty", "[storage]")
+{
+    using StateMachine_t = fsm11::StateMachine<
+                               CaptureStorage<int>,
+                               LockFreeCaptureStorageEnable<true>>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+
+    int value = 0;
+    int numCaptures = 0;
+    sm.setCaptureStorageCallback([&] { ++numCaptures; sm.store<0>(value); });
+
+    value = 31;
+    sm.start();
+    REQUIRE(numCaptures == 1);
+    REQUIRE(sm.load<0>() == 31);
+
+    value = 32;
+    sm.addEvent(1);
+    sm.addEvent(2);
+    REQUIRE(numCaptures == 1);
+    REQUIRE(sm.load<0>() == 31);
+
+    sm.markCaptureStorageDirty();
+    sm.addEvent(3);
+    REQUIRE(numCaptures == 2);
+    REQUIRE(sm.load<0>() == 32);
+}
+
+TEST_CASE("guards see the event snapshot of the lock-free storage",
+          "[storage]")
+{
+    using StateMachine_t = fsm11::StateMachine<
+                               CaptureStorage<int>,
+                               LockFreeCaptureStorageEnable<true>>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    State_t c("c", &sm);
+
+    // Stores during the dispatch are not visible in the snapshot of the
+    // current event.
+    auto storeAndCheck = [&](int) {
+        sm.store<0>(2);
+        return std::get<0>(sm.eventSnapshot()) == 2;
+    };
+    auto check = [&](int) { return std::get<0>(sm.eventSnapshot()) == 1; };
+
+    sm += a + event(1) [storeAndCheck] > b;
+    sm += a + event(1) [check] > c;
+
+    // The store during the previous dispatch is visible in the snapshot of
+    // the next event.
+    auto checkStored = [&](int) {
+        return std::get<0>(sm.eventSnapshot()) == 2;
+    };
+    sm += c + event(2) [checkStored] > b;
+
+    sm.store<0>(1);
+    sm.start();
+    sm.addEvent(1);
+    REQUIRE(isActive(sm, {&sm, &c}));
+    REQUIRE(sm.load<0>() == 2);
+
+    sm.addEvent(2);
+    REQUIRE(isActive(sm, {&sm, &b}));
+}
+
+namespace
+{
+
+struct Triple
+{
+    long a;
+    long b;
+    long c;
+};
+
+} // anonymous namespace
+
+TEST_CASE("lock-free storage is consistent under concurrent stores",
+          "[storage]")
+{
+    using StateMachine_t = fsm11::StateMachine<
+                               MultithreadingEnable<true>,
+                               CaptureStorage<Triple, int>,
+                               LockFreeCaptureStorageEnable<true>>;
+    StateMachine_t sm;
+
+    std::atomic_bool stop{false};
+    auto writer = std::async(std::launch::async, [&] {
+        for (long count = 0; !stop; ++count)
+        {
+            sm.store<0>(Triple{count, -count, 2 * count});
+            sm.store<1>(int(count));
+        }
+    });
+
+    bool consistent = true;
+    for (int count = 0; count < 100000; ++count)
+    {
+        Triple triple = sm.load<0>();
+        consistent = consistent && triple.b == -triple.a
+                     && triple.c == 2 * triple.a;
+
+        auto all = sm.loadAll();
+        consistent = consistent && std::get<0>(all).b == -std::get<0>(all).a;
+    }
+    stop = true;
+    writer.get();
+    REQUIRE(consistent);
+}
@@ -0,0 +1,175 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/statemachine.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace fsm11;
+
+TEST_CASE("a configuration snapshot reflects the active states",
+          "[configurationsnapshot]")
+{
+    using StateMachine_t = StateMachine<>;
+    using State_t = State<StateMachine_t>;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t a1("a1", &a);
+    State_t a2("a2", &a);
+    State_t b("b", &sm);
+    sm += a1 + event(1) > b;
+
+    ConfigurationSnapshot snapshot = sm.configurationSnapshot();
+    REQUIRE(!snapshot.running());
+    REQUIRE(snapshot.numStates() == 0);
+    REQUIRE(!snapshot.isActive(a));
+    REQUIRE(a.id() == unsigned(-1));
+
+    sm.start();
+    REQUIRE(sm.id() == 0);
+    REQUIRE(a.id() == 1);
+    REQUIRE(a1.id() == 2);
+    REQUIRE(a2.id() == 3);
+    REQUIRE(b.id() == 4);
+
+    sm.configurationSnapshot(snapshot);
+    REQUIRE(snapshot.running());
+    REQUIRE(snapshot.numStates() == 5);
+    REQUIRE(snapshot.numConfigurationChanges() == sm.numConfigurationChanges());
+    REQUIRE(snapshot.isActive(a));
+    REQUIRE(snapshot.isActive(a1));
+    REQUIRE(!snapshot.isActive(a2));
+    REQUIRE(!snapshot.isActive(b));
+    REQUIRE(!snapshot.isActive(std::size_t(5)));
+
+    sm.addEvent(1);
+    REQUIRE(!snapshot.isActive(b));
+    sm.configurationSnapshot(snapshot);
+    REQUIRE(snapshot.numConfigurationChanges() == 2);
+    REQUIRE(!snapshot.isActive(a));
+    REQUIRE(snapshot.isActive(b));
+    REQUIRE(b.isActive());
+
+    sm.stop();
+    snapshot = sm.configurationSnapshot();
+    REQUIRE(!snapshot.running());
+    REQUIRE(snapshot.numConfigurationChanges() == 3);
+    REQUIRE(!snapshot.isActive(b));
+    REQUIRE(!b.isActive());
+}
+
+TEST_CASE("a configuration snapshot is consistent", "[configurationsnapshot]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching>;
+    using State_t = State<StateMachine_t>;
+
+    StateMachine_t sm;
+    State_t p("p", &sm);
+    p.setChildMode(ChildMode::Parallel);
+    State_t x("x", &p);
+    State_t x1("x1", &x);
+    State_t x2("x2", &x);
+    State_t y("y", &p);
+    State_t y1("y1", &y);
+    State_t y2("y2", &y);
+
+    // The transitions are taken in the same microstep, so x2 is active if
+    // and only if y2 is active.
+    sm += x1 + event(1) > x2;
+    sm += y1 + event(1) > y2;
+    sm += x2 + event(2) > x1;
+    sm += y2 + event(2) > y1;
+
+    auto result = sm.startAsyncEventLoop();
+    sm.start();
+
+    std::atomic_bool done(false);
+    bool consistent = true;
+    std::thread reader([&] {
+        ConfigurationSnapshot snapshot;
+        while (!done)
+        {
+            sm.configurationSnapshot(snapshot);
+            if (snapshot.running()
+                && (snapshot.isActive(x1) == snapshot.isActive(x2)
+                    || snapshot.isActive(x2) != snapshot.isActive(y2)))
+            {
+                consistent = false;
+            }
+        }
+    });
+
+    for (int round = 0; round < 1000; ++round)
+    {
+        sm.addEvent(1);
+        sm.addEvent(2);
+    }
+    sm.stop();
+    result.get();
+    done = true;
+    reader.join();
+    REQUIRE(consistent);
+}
+
+TEST_CASE("a configuration snapshot grows with the state machine",
+          "[configurationsnapshot]")
+{
+    using StateMachine_t = StateMachine<>;
+    using State_t = State<StateMachine_t>;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+
+    sm.start();
+    REQUIRE(a.isActive());
+    sm.stop();
+
+    // Adding more states than fit into a single word of the bitset makes
+    // the publisher allocate a larger buffer on the next start.
+    std::vector<std::unique_ptr<State_t>> children;
+    for (int idx = 0; idx < 100; ++idx)
+        children.emplace_back(new State_t("child", &a));
+
+    sm.start();
+    REQUIRE(a.isActive());
+    REQUIRE(children.front()->isActive());
+    REQUIRE(!children.back()->isActive());
+
+    ConfigurationSnapshot snapshot = sm.configurationSnapshot();
+    REQUIRE(snapshot.numStates() == 102);
+    REQUIRE(snapshot.isActive(a));
+    REQUIRE(snapshot.isActive(*children.front()));
+    REQUIRE(!snapshot.isActive(*children.back()));
+    sm.stop();
+}
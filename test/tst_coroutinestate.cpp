@@ -0,0 +1,194 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+// The CoroutineState needs C++20. The tests are skipped for older
+// standards.
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include "../src/coroutinestate.hpp"
+#include "../src/statemachine.hpp"
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace fsm11;
+
+namespace
+{
+
+using StateMachine_t = StateMachine<>;
+using State_t = CoroutineState<StateMachine_t>;
+
+class QueueExecutor
+{
+public:
+    template <typename TFunction>
+    void post(TFunction&& fn)
+    {
+        m_queue.emplace_back(std::forward<TFunction>(fn));
+    }
+
+    void run()
+    {
+        auto queue = std::move(m_queue);
+        m_queue.clear();
+        for (auto& fn : queue)
+            fn();
+    }
+
+private:
+    std::vector<std::function<void()>> m_queue;
+};
+
+class WaitingState : public State_t
+{
+public:
+    using State_t::State_t;
+
+    virtual InvokeCoroutine invoke(CoroutineExitRequest& exitRequest) override
+    {
+        threadId = std::this_thread::get_id();
+        step = 1;
+        co_await exitRequest;
+        step = 2;
+    }
+
+    std::thread::id threadId;
+    int step{0};
+};
+
+class PollingState : public State_t
+{
+public:
+    PollingState(const char* name, QueueExecutor& executor,
+                 StateMachine_t::state_type* parent)
+        : State_t(name, parent),
+          m_executor(executor)
+    {
+    }
+
+    virtual InvokeCoroutine invoke(CoroutineExitRequest& exitRequest) override
+    {
+        while (!exitRequest)
+        {
+            ++numResumptions;
+            co_await exitRequest.resumeOn(m_executor);
+        }
+    }
+
+    int numResumptions{0};
+
+private:
+    QueueExecutor& m_executor;
+};
+
+class ThrowingState : public State_t
+{
+public:
+    using State_t::State_t;
+
+    virtual InvokeCoroutine invoke(CoroutineExitRequest& exitRequest) override
+    {
+        co_await exitRequest;
+        throw 42;
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE("a coroutine awaits its exit request", "[coroutinestate]")
+{
+    StateMachine_t sm;
+    WaitingState a("a", &sm);
+    REQUIRE(a.step == 0);
+
+    sm.start();
+    REQUIRE(a.step == 1);
+    REQUIRE(a.threadId == std::this_thread::get_id());
+
+    sm.stop();
+    REQUIRE(a.step == 2);
+
+    // The coroutine is restarted when the state is re-entered.
+    sm.start();
+    REQUIRE(a.step == 1);
+    sm.stop();
+    REQUIRE(a.step == 2);
+}
+
+TEST_CASE("a coroutine is resumed by an executor", "[coroutinestate]")
+{
+    QueueExecutor executor;
+    StateMachine_t sm;
+    PollingState a("a", executor, &sm);
+
+    sm.start();
+    REQUIRE(a.numResumptions == 1);
+    executor.run();
+    REQUIRE(a.numResumptions == 2);
+    executor.run();
+    REQUIRE(a.numResumptions == 3);
+
+    // A resumption, which is scheduled when the state is left, is dropped.
+    sm.stop();
+    executor.run();
+    REQUIRE(a.numResumptions == 3);
+}
+
+TEST_CASE("thousands of coroutine states do not need threads",
+          "[coroutinestate]")
+{
+    // The states must be destructed after sm's destructor has been called.
+    std::vector<std::unique_ptr<WaitingState>> states;
+    StateMachine_t sm;
+    for (int count = 0; count < 2000; ++count)
+        states.emplace_back(new WaitingState("s", &sm));
+    sm.setChildMode(ChildMode::Parallel);
+
+    sm.start();
+    for (auto& state : states)
+        REQUIRE(state->step == 1);
+    sm.stop();
+    for (auto& state : states)
+        REQUIRE(state->step == 2);
+}
+
+TEST_CASE("an exception in a coroutine is rethrown on exit",
+          "[coroutinestate]")
+{
+    StateMachine_t sm;
+    ThrowingState a("a", &sm);
+
+    sm.start();
+    REQUIRE_THROWS_AS(sm.stop(), int);
+}
+
+#endif // __cplusplus >= 202002L
@@ -0,0 +1,215 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/statemachine.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+using namespace fsm11;
+
+namespace
+{
+
+using StateMachine_t = StateMachine<AsynchronousEventDispatching>;
+using State_t = State<StateMachine_t>;
+
+template <EventListOverflowPolicyEnum TPolicy>
+using BoundedStateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                           EventListCapacity<2, TPolicy>>;
+
+} // anonymous namespace
+
+TEST_CASE("an event future reports the outcome of the event", "[eventfuture]")
+{
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+
+    EventFuture taken = sm.addEventWithCompletion(1);
+    EventFuture discarded = sm.addEventWithCompletion(1);
+    REQUIRE(taken.valid());
+    REQUIRE(!taken.ready());
+    REQUIRE(taken.status() == EventStatus::Pending);
+    REQUIRE(!taken.waitFor(std::chrono::milliseconds(1)));
+
+    sm.start();
+    REQUIRE(sm.dispatchPending(1) == 1);
+    REQUIRE(taken.ready());
+    REQUIRE(taken.get() == EventStatus::Taken);
+    REQUIRE(taken.numConfigurationChanges() == 2);
+    REQUIRE(!discarded.ready());
+
+    sm.dispatchPending();
+    REQUIRE(discarded.get() == EventStatus::Discarded);
+    REQUIRE(discarded.numConfigurationChanges() == 2);
+
+    sm.stop();
+    sm.dispatchPending();
+}
+
+TEST_CASE("events with and without completions can be mixed", "[eventfuture]")
+{
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(2) > a;
+
+    sm.addEvent(1);
+    EventFuture second = sm.addEventWithCompletion(2);
+    sm.addEvent(1);
+    EventFuture fourth = sm.addEventWithCompletion(1);
+
+    sm.start();
+    sm.dispatchPending(2);
+    REQUIRE(second.ready());
+    REQUIRE(second.numConfigurationChanges() == 3);
+    REQUIRE(!fourth.ready());
+    sm.dispatchPending();
+    REQUIRE(fourth.get() == EventStatus::Discarded);
+
+    sm.stop();
+    sm.dispatchPending();
+}
+
+TEST_CASE("dropped events complete their futures", "[eventfuture]")
+{
+    SECTION("drop the oldest event")
+    {
+        BoundedStateMachine_t<DropOldest> sm;
+        EventFuture first = sm.addEventWithCompletion(1);
+        sm.addEvent(2);
+        EventFuture third = sm.addEventWithCompletion(3);
+        REQUIRE(first.get() == EventStatus::Dropped);
+        REQUIRE(!third.ready());
+    }
+
+    SECTION("drop the newest event")
+    {
+        BoundedStateMachine_t<DropNewest> sm;
+        sm.addEvent(1);
+        sm.addEvent(2);
+        EventFuture third = sm.addEventWithCompletion(3);
+        REQUIRE(third.get() == EventStatus::Dropped);
+    }
+
+    SECTION("destroy the state machine")
+    {
+        EventFuture future;
+        {
+            StateMachine_t sm;
+            future = sm.addEventWithCompletion(1);
+        }
+        REQUIRE(future.get() == EventStatus::Dropped);
+    }
+}
+
+TEST_CASE("an expired event completes its future", "[eventfuture]")
+{
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+
+    auto now = std::chrono::steady_clock::now();
+    EventFuture expired
+            = sm.addEventWithCompletion(1, now - std::chrono::seconds(1));
+    EventFuture taken
+            = sm.addEventWithCompletion(1, now + std::chrono::hours(1));
+
+    sm.start();
+    sm.dispatchPending();
+    REQUIRE(expired.get() == EventStatus::Expired);
+    REQUIRE(expired.numConfigurationChanges() == 1);
+    REQUIRE(taken.get() == EventStatus::Taken);
+    REQUIRE(sm.numExpiredEvents() == 1);
+
+    sm.stop();
+    sm.dispatchPending();
+}
+
+TEST_CASE("a failed dispatch completes the future with an error",
+          "[eventfuture]")
+{
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1)
+            / [](int) { throw std::runtime_error("action"); } > b;
+
+    EventFuture future = sm.addEventWithCompletion(1);
+    sm.start();
+    REQUIRE_THROWS_AS(sm.dispatchPending(), std::runtime_error&);
+    REQUIRE(future.get() == EventStatus::Error);
+    REQUIRE(!sm.running());
+}
+
+TEST_CASE("completions are recycled", "[eventfuture]")
+{
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    sm.start();
+    sm.dispatchPending();
+
+    for (int round = 0; round < 3; ++round)
+    {
+        EventFuture futures[4];
+        for (auto& future : futures)
+            future = sm.addEventWithCompletion(round);
+        sm.dispatchPending();
+        for (auto& future : futures)
+            REQUIRE(future.get() == EventStatus::Discarded);
+    }
+
+    sm.stop();
+    sm.dispatchPending();
+}
+
+TEST_CASE("an event loop completes event futures", "[eventfuture]")
+{
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(2) > a;
+
+    auto result = sm.startAsyncEventLoop();
+    sm.start();
+    for (int round = 0; round < 100; ++round)
+    {
+        REQUIRE(sm.addEventWithCompletion(1).get() == EventStatus::Taken);
+        REQUIRE(sm.addEventWithCompletion(1).get() == EventStatus::Discarded);
+        REQUIRE(sm.addEventWithCompletion(2).get() == EventStatus::Taken);
+    }
+    sm.stop();
+    result.get();
+}
@@ -31,7 +31,10 @@
 #include "../src/statemachine.hpp"
 #include "testutils.hpp"
 
+#include <chrono>
 #include <queue>
+#include <thread>
+#include <vector>
 
 using namespace fsm11;
 
@@ -189,3 +192,189 @@ SCENARIO("a priority queue can be used as event list", "[eventlist]")
         }
     }
 }
+
+namespace
+{
+
+template <EventListOverflowPolicyEnum TPolicy>
+using BoundedStateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                           EventCallbacksEnable<true>,
+                                           EventListCapacity<2, TPolicy>>;
+
+template <typename TStateMachine>
+std::vector<int> dispatchedEvents(TStateMachine& sm)
+{
+    std::vector<int> events;
+    sm.setEventDispatchCallback([&](int event) { events.push_back(event); });
+    sm.start();
+    sm.dispatchPending();
+    sm.stop();
+    sm.dispatchPending();
+    sm.setEventDispatchCallback(nullptr);
+    return events;
+}
+
+} // anonymous namespace
+
+TEST_CASE("a bounded event list applies its overflow policy", "[eventlist]")
+{
+    SECTION("reject")
+    {
+        BoundedStateMachine_t<Reject> sm;
+        sm.addEvent(1);
+        sm.addEvent(2);
+        try
+        {
+            sm.addEvent(3);
+            REQUIRE(false);
+        }
+        catch (Error& error)
+        {
+            REQUIRE(error.code() == ErrorCode::EventListOverflow);
+        }
+        REQUIRE(!sm.tryAddEvent(4));
+        REQUIRE(dispatchedEvents(sm) == (std::vector<int>{1, 2}));
+        REQUIRE(sm.numDroppedEvents() == 0);
+    }
+
+    SECTION("drop the oldest event")
+    {
+        BoundedStateMachine_t<DropOldest> sm;
+        for (int event = 1; event <= 4; ++event)
+            sm.addEvent(event);
+        REQUIRE(!sm.tryAddEvent(5));
+        REQUIRE(dispatchedEvents(sm) == (std::vector<int>{3, 4}));
+        REQUIRE(sm.numDroppedEvents() == 2);
+    }
+
+    SECTION("drop the newest event")
+    {
+        BoundedStateMachine_t<DropNewest> sm;
+        for (int event = 1; event <= 4; ++event)
+            sm.addEvent(event);
+        REQUIRE(dispatchedEvents(sm) == (std::vector<int>{1, 2}));
+        REQUIRE(sm.numDroppedEvents() == 2);
+    }
+
+    SECTION("block with a timeout")
+    {
+        BoundedStateMachine_t<Block> sm;
+        sm.setEventListTimeout(std::chrono::milliseconds(1));
+        sm.addEvent(1);
+        sm.addEvent(2);
+        REQUIRE_THROWS_AS(sm.addEvent(3), Error&);
+        REQUIRE(!sm.tryAddEvent(3, std::chrono::milliseconds(1)));
+        REQUIRE(dispatchedEvents(sm) == (std::vector<int>{1, 2}));
+    }
+}
+
+TEST_CASE("a blocked producer resumes when an event is taken", "[eventlist]")
+{
+    BoundedStateMachine_t<Block> sm;
+    std::vector<int> events;
+    sm.setEventDispatchCallback([&](int event) { events.push_back(event); });
+
+    sm.addEvent(1);
+    sm.addEvent(2);
+    std::thread producer([&] { sm.addEvent(3); });
+
+    sm.start();
+    while (events.size() < 3)
+    {
+        sm.dispatchPending();
+        std::this_thread::yield();
+    }
+    producer.join();
+    REQUIRE(events == (std::vector<int>{1, 2, 3}));
+
+    sm.stop();
+    sm.dispatchPending();
+}
+
+TEST_CASE("the watermark callbacks of a bounded event list are invoked",
+          "[eventlist]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        EventListCapacity<8>>;
+
+    StateMachine_t sm;
+    int numHigh = 0;
+    int numLow = 0;
+    sm.setEventListWatermarks(4, 1);
+    sm.setHighWatermarkCallback([&] { ++numHigh; });
+    sm.setLowWatermarkCallback([&] { ++numLow; });
+
+    for (int event = 0; event < 3; ++event)
+        sm.addEvent(event);
+    REQUIRE(numHigh == 0);
+    sm.addEvent(3);
+    sm.addEvent(4);
+    REQUIRE(numHigh == 1);
+
+    sm.start();
+    sm.dispatchPending(3);
+    REQUIRE(numLow == 0);
+    sm.dispatchPending(1);
+    REQUIRE(numLow == 1);
+
+    for (int event = 0; event < 4; ++event)
+        sm.addEvent(event);
+    REQUIRE(numHigh == 2);
+
+    sm.stop();
+    sm.dispatchPending();
+}
+
+TEST_CASE("expired events are discarded", "[eventlist]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        EventCallbacksEnable<true>>;
+    using State_t = State<StateMachine_t>;
+
+    StateMachine_t sm;
+    TrackingState<State_t> a("a", &sm);
+    TrackingState<State_t> b("b", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(2) > a;
+
+    std::vector<int> dispatched;
+    std::vector<std::pair<int, DiscardReason>> discarded;
+    sm.setEventDispatchCallback([&](int event) { dispatched.push_back(event); });
+    sm.setEventDiscardedCallback([&](int event, DiscardReason reason) {
+        discarded.emplace_back(event, reason);
+    });
+
+    auto now = std::chrono::steady_clock::now();
+    sm.addEvent(1, now - std::chrono::seconds(1));
+    sm.addEvent(2, now + std::chrono::hours(1));
+    sm.addEvent(3);
+    sm.addEvent(1, now + std::chrono::hours(1));
+
+    sm.start();
+    sm.dispatchPending();
+    REQUIRE(dispatched == (std::vector<int>{2, 3, 1}));
+    REQUIRE(discarded.size() == 3);
+    REQUIRE(discarded[0] == std::make_pair(1, DiscardReason::Expired));
+    REQUIRE(discarded[1] == std::make_pair(2, DiscardReason::NoTransition));
+    REQUIRE(discarded[2] == std::make_pair(3, DiscardReason::NoTransition));
+    REQUIRE(sm.numExpiredEvents() == 1);
+    REQUIRE(isActive(sm, {&sm, &b}));
+    REQUIRE(b.entered == 1);
+
+    sm.stop();
+    sm.dispatchPending();
+}
+
+TEST_CASE("a deadline is dropped together with its event", "[eventlist]")
+{
+    BoundedStateMachine_t<DropOldest> sm;
+    auto past = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+    sm.addEvent(1, past);
+    sm.addEvent(2);
+    sm.addEvent(3);
+    sm.addEvent(4, past);
+    sm.addEvent(5);
+    REQUIRE(dispatchedEvents(sm) == (std::vector<int>{5}));
+    REQUIRE(sm.numDroppedEvents() == 3);
+    REQUIRE(sm.numExpiredEvents() == 1);
+}
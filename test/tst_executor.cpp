@@ -0,0 +1,494 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/eventfdexecutor.hpp"
+#include "../src/executor.hpp"
+#include "../src/statemachine.hpp"
+#include "testutils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+using namespace fsm11;
+
+namespace asyncSM
+{
+using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                    MultithreadingEnable<true>,
+                                    EventCallbacksEnable<true>>;
+using State_t = StateMachine_t::state_type;
+} // namespace asyncSM
+
+namespace
+{
+
+//! Waits until the \p predicate is true or a timeout expires.
+template <typename TPredicate>
+bool waitUntil(TPredicate predicate)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!predicate())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+TEST_CASE("run many state machines in an executor", "[executor]")
+{
+    using namespace asyncSM;
+
+    const unsigned numMachines = 200;
+    const int numEvents = 50;
+
+    struct Machine
+    {
+        Machine()
+            : a("a", &sm),
+              b("b", &sm)
+        {
+            sm.setEventDispatchCallback([this](int event) {
+                if (event <= lastEvent)
+                    ordered = false;
+                lastEvent = event;
+            });
+            sm += a + event(0) > b;
+        }
+
+        StateMachine_t sm;
+        State_t a;
+        State_t b;
+        int lastEvent{-1};
+        bool ordered{true};
+    };
+
+    Executor executor(3);
+    REQUIRE(executor.size() == 3);
+
+    std::vector<std::unique_ptr<Machine>> machines;
+    for (unsigned idx = 0; idx < numMachines; ++idx)
+    {
+        machines.emplace_back(new Machine);
+        machines.back()->sm.setExecutor(executor);
+        machines.back()->sm.start();
+    }
+
+    for (int event = 0; event < numEvents; ++event)
+        for (auto& machine : machines)
+            machine->sm.addEvent(event);
+
+    for (auto& machine : machines)
+    {
+        REQUIRE(waitUntil([&] {
+            std::lock_guard<StateMachine_t> lock(machine->sm);
+            return machine->lastEvent == numEvents - 1;
+        }));
+        REQUIRE(machine->ordered);
+        REQUIRE(machine->b.isActive());
+    }
+
+    for (auto& machine : machines)
+        machine->sm.stop();
+    for (auto& machine : machines)
+        REQUIRE(waitUntil([&] { return !machine->sm.running(); }));
+}
+
+TEST_CASE("an executor drains a bounded batch", "[executor]")
+{
+    using namespace asyncSM;
+
+    Executor executor(1);
+
+    std::mutex mutex;
+    std::vector<int> dispatched;
+    auto record = [&](int event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        dispatched.push_back(event);
+    };
+
+    StateMachine_t sm1;
+    State_t a1("a", &sm1);
+    sm1.setEventDispatchCallback(record);
+    sm1.setExecutor(executor);
+    sm1.setMaxEventsPerBatch(1);
+    REQUIRE(sm1.maxEventsPerBatch() == 1);
+
+    StateMachine_t sm2;
+    State_t a2("a", &sm2);
+    sm2.setEventDispatchCallback(record);
+    sm2.setExecutor(executor);
+    sm2.setMaxEventsPerBatch(1);
+
+    // Block the worker until both machines have been set up.
+    std::promise<void> blocker;
+    std::shared_future<void> blocked = blocker.get_future().share();
+    executor.post([blocked] { blocked.wait(); });
+
+    for (int event = 0; event < 3; ++event)
+    {
+        sm1.addEvent(10 + event);
+        sm2.addEvent(20 + event);
+    }
+    sm1.start();
+    sm2.start();
+    blocker.set_value();
+
+    REQUIRE(waitUntil([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dispatched.size() == 6;
+    }));
+    REQUIRE(dispatched == std::vector<int>({10, 20, 11, 21, 12, 22}));
+}
+
+TEST_CASE("a state machine in an executor can be restarted", "[executor]")
+{
+    using namespace asyncSM;
+
+    Executor executor(2);
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+    sm.setExecutor(executor);
+
+    for (int round = 0; round < 10; ++round)
+    {
+        sm.start();
+        sm.addEvent(1);
+        REQUIRE(waitUntil([&] { return b.isActive(); }));
+        sm.stop();
+        REQUIRE(waitUntil([&] { return !sm.running(); }));
+        REQUIRE(isActive(sm, {}));
+    }
+}
+
+namespace
+{
+
+//! An executor which collects the posted tasks.
+class ManualExecutor
+{
+public:
+    void post(std::function<void()> task)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        ++m_numPosted;
+    }
+
+    //! Runs the tasks, which have been posted so far.
+    void runAll()
+    {
+        std::vector<std::function<void()>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            tasks.swap(m_tasks);
+        }
+        for (auto& task : tasks)
+            task();
+    }
+
+    unsigned numPosted()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_numPosted;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::function<void()>> m_tasks;
+    unsigned m_numPosted{0};
+};
+
+} // anonymous namespace
+
+TEST_CASE("an idle state machine posts a single drain task", "[executor]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        ExecutorType<ManualExecutor>>;
+    using State_t = StateMachine_t::state_type;
+
+    ManualExecutor executor;
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    State_t c("c", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(2) > c;
+    sm.setExecutor(executor);
+
+    sm.start();
+    sm.addEvent(1);
+    sm.addEvent(2);
+    REQUIRE(executor.numPosted() == 1);
+    REQUIRE(isActive(sm, {}));
+
+    executor.runAll();
+    REQUIRE(isActive(sm, {&sm, &c}));
+    REQUIRE(executor.numPosted() == 1);
+
+    sm.stop();
+    REQUIRE(executor.numPosted() == 2);
+    executor.runAll();
+    REQUIRE(isActive(sm, {}));
+}
+
+TEST_CASE("the exception of a drain task is rethrown", "[executor]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        ExecutorType<ManualExecutor>>;
+    using State_t = StateMachine_t::state_type;
+
+    ManualExecutor executor;
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) / [](int) { throw 42; } > b;
+    sm.setExecutor(executor);
+
+    sm.start();
+    sm.addEvent(1);
+    executor.runAll();
+    REQUIRE(!sm.running());
+
+    REQUIRE_THROWS_AS(sm.waitUntilIdle(std::chrono::seconds(1)), int);
+
+    // The exception is reported only once.
+    sm.start();
+    executor.runAll();
+    REQUIRE(isActive(sm, {&sm, &a}));
+    sm.stop();
+    executor.runAll();
+}
+
+TEST_CASE("dispatch on an inline executor", "[executor]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        ExecutorType<InlineExecutor>>;
+    using State_t = StateMachine_t::state_type;
+
+    InlineExecutor executor;
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    State_t c("c", &sm);
+    sm += a + event(1) / [&](int) { sm.addEvent(2); } > b;
+    sm += b + event(2) > c;
+    sm.setExecutor(executor);
+    sm.setMaxEventsPerBatch(1);
+
+    sm.start();
+    REQUIRE(isActive(sm, {&sm, &a}));
+
+    // The event, which is added by the action, is dispatched before
+    // addEvent() returns.
+    sm.addEvent(1);
+    REQUIRE(isActive(sm, {&sm, &c}));
+
+    sm.stop();
+    REQUIRE(isActive(sm, {}));
+}
+
+TEST_CASE("dispatch in a thread pool", "[executor]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        ExecutorType<ThreadPoolExecutor<ThreadPool<2>>>>;
+    using State_t = StateMachine_t::state_type;
+
+    ThreadPool<2> pool;
+    ThreadPoolExecutor<ThreadPool<2>> executor(pool);
+
+    StateMachine_t sm1;
+    State_t a1("a", &sm1);
+    State_t b1("b", &sm1);
+    sm1 += a1 + event(1) > b1;
+    sm1.setExecutor(executor);
+
+    StateMachine_t sm2;
+    State_t a2("a", &sm2);
+    State_t b2("b", &sm2);
+    sm2 += a2 + event(1) > b2;
+    sm2.setExecutor(executor);
+
+    sm1.start();
+    sm2.start();
+    sm1.addEvent(1);
+    sm2.addEvent(1);
+    REQUIRE(waitUntil([&] { return b1.isActive() && b2.isActive(); }));
+}
+
+namespace
+{
+
+//! A task, which records if it has been run or cancelled.
+struct CancellableTask
+{
+    std::shared_ptr<std::atomic_int> result;
+
+    void operator()() const
+    {
+        *result = 1;
+    }
+
+    void cancel() const noexcept
+    {
+        *result = 2;
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE("a thread pool executor cancels the queued tasks on shutdown",
+          "[executor]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        ExecutorType<ThreadPoolExecutor<ThreadPool<1>>>>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    auto result = std::make_shared<std::atomic_int>(0);
+
+    std::unique_ptr<ThreadPool<1>> pool(new ThreadPool<1>);
+    ThreadPoolExecutor<ThreadPool<1>> executor(*pool);
+    sm.setExecutor(executor);
+
+    // Block the only worker, so that the drain task stays in the queue.
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::atomic_bool blocked{false};
+    executor.post([&] { blocked = true; opened.wait(); });
+    REQUIRE(waitUntil([&] { return blocked.load(); }));
+    sm.start();
+    executor.post(CancellableTask{result});
+
+    auto shutdown = std::async(std::launch::async, [&] { pool.reset(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    gate.set_value();
+    shutdown.get();
+
+    REQUIRE(*result == 2);
+    REQUIRE(result.use_count() == 1);
+    REQUIRE(isActive(sm, {}));
+    // The state machine must not wait for the cancelled drain task when
+    // it is destroyed.
+}
+
+TEST_CASE("dispatch the pending events", "[executor]")
+{
+    using namespace asyncSM;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(2) > a;
+
+    REQUIRE(sm.dispatchPending() == 0);
+    sm.start();
+    REQUIRE(isActive(sm, {}));
+
+    sm.addEvent(1);
+    sm.addEvent(2);
+    sm.addEvent(1);
+    REQUIRE(sm.dispatchPending(2) == 2);
+    REQUIRE(isActive(sm, {&sm, &a}));
+    REQUIRE(sm.dispatchPending() == 1);
+    REQUIRE(isActive(sm, {&sm, &b}));
+    REQUIRE(sm.dispatchPending() == 0);
+
+    sm.stop();
+    REQUIRE(sm.dispatchPending() == 0);
+    REQUIRE(isActive(sm, {}));
+}
+
+TEST_CASE("dispatch on an eventfd executor", "[executor]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        ExecutorType<EventFdExecutor>>;
+    using State_t = StateMachine_t::state_type;
+
+    auto readable = [](int fd) {
+        pollfd pfd{fd, POLLIN, 0};
+        return ::poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+    };
+
+    EventFdExecutor executor;
+    REQUIRE(executor.fd() >= 0);
+    REQUIRE(!readable(executor.fd()));
+
+    StateMachine_t sm1;
+    State_t a1("a", &sm1);
+    State_t b1("b", &sm1);
+    sm1 += a1 + event(1) > b1;
+    sm1.setExecutor(executor);
+
+    StateMachine_t sm2;
+    State_t a2("a", &sm2);
+    State_t b2("b", &sm2);
+    sm2 += a2 + event(1) > b2;
+    sm2.setExecutor(executor);
+
+    sm1.start();
+    sm2.start();
+    REQUIRE(readable(executor.fd()));
+    REQUIRE(executor.runPending() == 2);
+    REQUIRE(!readable(executor.fd()));
+    REQUIRE(isActive(sm1, {&sm1, &a1}));
+    REQUIRE(isActive(sm2, {&sm2, &a2}));
+
+    std::thread producer([&] { sm1.addEvent(1); sm2.addEvent(1); });
+    producer.join();
+    REQUIRE(readable(executor.fd()));
+    REQUIRE(executor.runPending() == 2);
+    REQUIRE(isActive(sm1, {&sm1, &b1}));
+    REQUIRE(isActive(sm2, {&sm2, &b2}));
+
+    sm1.stop();
+    sm2.stop();
+    REQUIRE(executor.runPending() == 2);
+    REQUIRE(!readable(executor.fd()));
+}
@@ -0,0 +1,161 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/locks.hpp"
+#include "../src/statemachine.hpp"
+
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace fsm11;
+
+namespace
+{
+
+// Lets numThreads threads increment a counter under the lock. Returns
+// the final value of the counter.
+template <typename TLock>
+unsigned incrementConcurrently(TLock& lock, unsigned numThreads,
+                               unsigned numIncrements)
+{
+    unsigned counter = 0;
+    std::vector<std::future<void>> workers;
+    for (unsigned idx = 0; idx < numThreads; ++idx)
+    {
+        workers.push_back(std::async(std::launch::async, [&] {
+            for (unsigned count = 0; count < numIncrements; ++count)
+            {
+                std::lock_guard<TLock> guard(lock);
+                ++counter;
+            }
+        }));
+    }
+    for (auto& worker : workers)
+        worker.get();
+    return counter;
+}
+
+} // anonymous namespace
+
+TEST_CASE("a spin lock is a C++11 lockable", "[locks]")
+{
+    SpinLock lock;
+
+    std::unique_lock<SpinLock> guard(lock, std::try_to_lock);
+    REQUIRE(guard.owns_lock());
+    REQUIRE(!lock.try_lock());
+    guard.unlock();
+    REQUIRE(lock.try_lock());
+    lock.unlock();
+    guard.lock();
+    REQUIRE(guard.owns_lock());
+}
+
+TEST_CASE("an adaptive mutex is a C++11 lockable", "[locks]")
+{
+    AdaptiveMutex lock;
+
+    std::unique_lock<AdaptiveMutex> guard(lock, std::try_to_lock);
+    REQUIRE(guard.owns_lock());
+    REQUIRE(!lock.try_lock());
+    guard.unlock();
+    REQUIRE(lock.try_lock());
+    lock.unlock();
+    guard.lock();
+    REQUIRE(guard.owns_lock());
+}
+
+TEST_CASE("the locks provide mutual exclusion", "[locks]")
+{
+    SECTION("spin lock")
+    {
+        SpinLock lock;
+        REQUIRE(incrementConcurrently(lock, 4, 20000) == 80000);
+    }
+
+    SECTION("adaptive mutex")
+    {
+        AdaptiveMutex lock;
+        REQUIRE(incrementConcurrently(lock, 4, 20000) == 80000);
+    }
+
+    SECTION("adaptive mutex without spinning")
+    {
+        AdaptiveMutex lock(0);
+        REQUIRE(incrementConcurrently(lock, 4, 20000) == 80000);
+    }
+}
+
+TEST_CASE("a state machine uses the configured lock", "[locks]")
+{
+    using StateMachine_t = StateMachine<MultithreadingEnable<true>,
+                                        LockType<SpinLock>,
+                                        CaptureStorage<int>>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(2) > a;
+
+    std::unique_lock<StateMachine_t> lock(sm, std::try_to_lock);
+    REQUIRE(lock.owns_lock());
+    REQUIRE(!sm.try_lock());
+    lock.unlock();
+
+    sm.start();
+    auto worker = std::async(std::launch::async, [&] {
+        for (int count = 0; count < 1000; ++count)
+        {
+            sm.addEvent(1);
+            sm.addEvent(2);
+        }
+    });
+    for (int count = 0; count < 1000; ++count)
+    {
+        sm.store<0>(count);
+        REQUIRE(sm.load<0>() == count);
+    }
+    worker.get();
+
+    REQUIRE(a.isActive());
+}
+
+TEST_CASE("the lock type option has no effect without multithreading",
+          "[locks]")
+{
+    using sm_t = StateMachine<MultithreadingEnable<false>>;
+    using sm_spin_t = StateMachine<MultithreadingEnable<false>,
+                                   LockType<SpinLock>>;
+    REQUIRE(sizeof(sm_t) == sizeof(sm_spin_t));
+}
@@ -30,6 +30,8 @@
 
 #include "../src/statemachine.hpp"
 
+#include <future>
+#include <vector>
 
 using namespace fsm11;
 
@@ -104,3 +106,178 @@ TEST_CASE("mutual exclusion during configuration change", "[multithreading]")
     terminate = true;
     REQUIRE(observer.get());
 }
+
+TEST_CASE("event combining does not block the producers", "[multithreading]")
+{
+    using namespace std;
+
+    using StateMachine_t = StateMachine<SynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        EventCombiningEnable<true>>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+
+    promise<void> actionEntered;
+    promise<void> continueAction;
+    auto gate = continueAction.get_future().share();
+    int numReturns = 0;
+
+    sm += a + event(1) / [&](int) { actionEntered.set_value(); gate.wait(); } > b;
+    sm += b + event(2) / [&](int) { ++numReturns; } > a;
+    sm.start();
+
+    auto producer = async(launch::async, [&] { sm.addEvent(1); });
+    actionEntered.get_future().wait();
+
+    // The producer holds the dispatch role. Adding the second event must
+    // not wait for the action.
+    sm.addEvent(2);
+    REQUIRE(producer.wait_for(chrono::milliseconds(0)) != future_status::ready);
+
+    continueAction.set_value();
+    producer.get();
+    REQUIRE(numReturns == 1);
+    REQUIRE(a.isActive());
+}
+
+TEST_CASE("event combining dispatches all events in order",
+          "[multithreading]")
+{
+    using namespace std;
+
+    using StateMachine_t = StateMachine<SynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        EventCombiningEnable<true>,
+                                        EventCallbacksEnable<true>>;
+
+    const int numThreads = 4;
+    const int numEvents = 5000;
+
+    StateMachine_t sm;
+    vector<int> lastEvent(numThreads, -1);
+    bool inOrder = true;
+    int numDispatched = 0;
+    sm.setEventDispatchCallback([&](int event) {
+        int thread = event / numEvents;
+        inOrder = inOrder && event % numEvents == lastEvent[thread] + 1;
+        lastEvent[thread] = event % numEvents;
+        ++numDispatched;
+    });
+    sm.start();
+
+    vector<future<void>> producers;
+    for (int thread = 0; thread < numThreads; ++thread)
+    {
+        producers.push_back(async(launch::async, [&sm, thread, numEvents] {
+            for (int count = 0; count < numEvents; ++count)
+                sm.addEvent(thread * numEvents + count);
+        }));
+    }
+    for (auto& producer : producers)
+        producer.get();
+
+    REQUIRE(sm.waitUntilIdle(chrono::seconds(10)));
+    REQUIRE(numDispatched == numThreads * numEvents);
+    REQUIRE(inOrder);
+}
+
+TEST_CASE("event combining keeps the events of other producers on failure",
+          "[multithreading]")
+{
+    using namespace std;
+
+    using StateMachine_t = StateMachine<SynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        EventCombiningEnable<true>>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    State_t c("c", &sm);
+
+    promise<void> actionEntered;
+    promise<void> continueAction;
+    auto gate = continueAction.get_future().share();
+
+    sm += a + event(1) / [&](int) {
+                              actionEntered.set_value();
+                              gate.wait();
+                              throw runtime_error("action failed");
+                          } > b;
+    sm += a + event(2) > c;
+    sm.start();
+
+    auto producer = async(launch::async, [&] { sm.addEvent(1); });
+    actionEntered.get_future().wait();
+    sm.addEvent(2);
+    continueAction.set_value();
+
+    // The exception arrives at the thread, which holds the dispatch role.
+    REQUIRE_THROWS_AS(producer.get(), const runtime_error&);
+    REQUIRE(!sm.running());
+
+    // The other event is not stuck in the queue of pending events.
+    REQUIRE(sm.waitUntilIdle(chrono::seconds(1)));
+    sm.start();
+    REQUIRE(c.isActive());
+}
+
+TEST_CASE("waiting for a synchronous FSM honors the timeout",
+          "[multithreading]")
+{
+    using namespace std;
+
+    using StateMachine_t = StateMachine<SynchronousEventDispatching,
+                                        MultithreadingEnable<true>>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+
+    REQUIRE(sm.waitUntilIdle(chrono::milliseconds(0)));
+
+    SECTION("wait in an action")
+    {
+        // The calling thread is dispatching, so it must not wait for
+        // itself.
+        bool idle = true;
+        sm += a + event(1) / [&](int) {
+                                  idle = sm.waitUntilIdle(
+                                             chrono::milliseconds(1));
+                              } > b;
+        sm.start();
+        sm.addEvent(1);
+        REQUIRE(!idle);
+        REQUIRE(b.isActive());
+        REQUIRE(sm.waitUntilIdle(chrono::milliseconds(0)));
+    }
+
+    SECTION("wait in another thread")
+    {
+        promise<void> actionEntered;
+        promise<void> continueAction;
+        auto gate = continueAction.get_future().share();
+        sm += a + event(1) / [&](int) {
+                                  actionEntered.set_value();
+                                  gate.wait();
+                              } > b;
+        sm.start();
+
+        auto producer = async(launch::async, [&] { sm.addEvent(1); });
+        actionEntered.get_future().wait();
+        auto start = chrono::steady_clock::now();
+        REQUIRE(!sm.waitUntilIdle(chrono::milliseconds(10)));
+        REQUIRE(chrono::steady_clock::now() - start
+                < chrono::seconds(5));
+
+        continueAction.set_value();
+        REQUIRE(sm.waitUntilIdle(chrono::seconds(10)));
+        producer.get();
+        REQUIRE(b.isActive());
+    }
+}
@@ -0,0 +1,160 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/replay.hpp"
+#include "../src/statemachine.hpp"
+
+#include <sstream>
+#include <vector>
+
+using namespace fsm11;
+
+namespace
+{
+
+template <typename TStateMachine>
+struct ReplayTopology
+{
+    using State_t = typename TStateMachine::state_type;
+
+    ReplayTopology()
+        : a("a", &sm),
+          a1("a1", &a),
+          a2("a2", &a),
+          b("b", &sm)
+    {
+        sm += a1 + event(1) > a2;
+        sm += a2 + event(1) > a1;
+        sm += a + event(2) > b;
+        sm += b + event(3) > a;
+    }
+
+    TStateMachine sm;
+    State_t a;
+    State_t a1;
+    State_t a2;
+    State_t b;
+};
+
+} // anonymous namespace
+
+SCENARIO("recorded events can be replayed", "[replay]")
+{
+    using RecordingStateMachine_t = StateMachine<EventCallbacksEnable<true>>;
+    using ReplayStateMachine_t = StateMachine<SynchronousEventDispatching>;
+
+    GIVEN ("a recorded event log")
+    {
+        std::stringstream log;
+        std::vector<Configuration> recordedConfigurations;
+
+        {
+            ReplayTopology<RecordingStateMachine_t> production;
+            production.sm.setEventDispatchCallback(
+                        EventRecorder<int>(log));
+            production.sm.start();
+            recordedConfigurations.push_back(
+                        currentConfiguration(production.sm));
+            for (int event : {1, 1, 2, 5, 3, 1})
+            {
+                production.sm.addEvent(event);
+                recordedConfigurations.push_back(
+                            currentConfiguration(production.sm));
+            }
+        }
+
+        WHEN ("the log is replayed in a clone of the machine")
+        {
+            ReplayTopology<ReplayStateMachine_t> clone;
+            auto result = replay(clone.sm, log);
+
+            THEN ("the configuration sequences match")
+            {
+                REQUIRE(result.numEvents == 6);
+                REQUIRE(result.configurations.size() == 7);
+                REQUIRE(findConfigurationMismatch(
+                            result.configurations, recordedConfigurations)
+                        == std::size_t(-1));
+                REQUIRE(clone.a2.isActive());
+                REQUIRE(result.eventsPerSecond() >= 0);
+            }
+        }
+
+        WHEN ("the log is replayed in a machine with a different topology")
+        {
+            ReplayTopology<ReplayStateMachine_t> clone;
+            clone.sm += clone.b + event(5) > clone.a;
+            auto result = replay(clone.sm, log);
+
+            THEN ("the first mismatch is reported")
+            {
+                REQUIRE(findConfigurationMismatch(
+                            result.configurations, recordedConfigurations)
+                        == 4);
+            }
+        }
+    }
+}
+
+TEST_CASE("replay without recording configurations", "[replay]")
+{
+    using StateMachine_t = StateMachine<>;
+
+    ReplayTopology<StateMachine_t> clone;
+    std::vector<int> events{1, 2, 3, 1, 1};
+    auto result = replay(clone.sm, events.begin(), events.end(), false);
+
+    REQUIRE(result.numEvents == 5);
+    REQUIRE(result.configurations.empty());
+    // Starting the machine is not counted.
+    REQUIRE(result.numConfigurationChanges == 5);
+    REQUIRE(clone.a1.isActive());
+}
+
+TEST_CASE("a binary event log with a partial event", "[replay]")
+{
+    std::stringstream log;
+    writeEvent(log, 1);
+    writeEvent(log, 2);
+    log.write("x", 1);
+
+    auto events = readEventLog<int>(log);
+    REQUIRE(events == std::vector<int>({1, 2}));
+}
+
+TEST_CASE("configuration sequences of different length", "[replay]")
+{
+    std::vector<Configuration> a{{0, 1}, {0, 2}};
+    std::vector<Configuration> b{{0, 1}};
+
+    REQUIRE(findConfigurationMismatch(a, a) == std::size_t(-1));
+    REQUIRE(findConfigurationMismatch(a, b) == 1);
+    REQUIRE(findConfigurationMismatch(b, a) == 1);
+}
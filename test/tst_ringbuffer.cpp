@@ -0,0 +1,167 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/ringbuffer.hpp"
+
+#include <memory>
+#include <string>
+
+using namespace fsm11;
+
+namespace
+{
+
+// A type which counts its living instances.
+struct Counted
+{
+    explicit Counted(int value)
+        : value(value)
+    {
+        ++numInstances;
+    }
+
+    Counted(const Counted& other)
+        : value(other.value)
+    {
+        ++numInstances;
+    }
+
+    ~Counted()
+    {
+        --numInstances;
+    }
+
+    int value;
+    static int numInstances;
+};
+
+int Counted::numInstances = 0;
+
+} // anonymous namespace
+
+TEST_CASE("construct a ring buffer", "[ringbuffer]")
+{
+    RingBuffer<int, 4> buffer;
+    REQUIRE(buffer.empty());
+    REQUIRE(buffer.size() == 0);
+    REQUIRE(buffer.capacity() == 4);
+}
+
+TEST_CASE("a ring buffer has FIFO semantic", "[ringbuffer]")
+{
+    RingBuffer<int, 4> buffer;
+
+    SECTION("within the inline capacity")
+    {
+        // Move the head around the storage a few times.
+        for (int round = 0; round < 10; ++round)
+        {
+            buffer.push_back(round);
+            buffer.push_back(round + 100);
+            REQUIRE(buffer.front() == round);
+            REQUIRE(buffer.back() == round + 100);
+            buffer.pop_front();
+            REQUIRE(buffer.front() == round + 100);
+            buffer.pop_front();
+        }
+        REQUIRE(buffer.empty());
+        REQUIRE(buffer.capacity() == 4);
+    }
+
+    SECTION("beyond the inline capacity")
+    {
+        buffer.push_back(-1);
+        buffer.push_back(-2);
+        buffer.pop_front();
+        buffer.pop_front();
+
+        for (int value = 0; value < 100; ++value)
+            buffer.push_back(value);
+        REQUIRE(buffer.size() == 100);
+        REQUIRE(buffer.capacity() == 128);
+
+        for (int value = 0; value < 100; ++value)
+        {
+            REQUIRE(buffer.front() == value);
+            buffer.pop_front();
+        }
+        REQUIRE(buffer.empty());
+        REQUIRE(buffer.capacity() == 128);
+    }
+}
+
+TEST_CASE("the capacity of a ring buffer can be changed", "[ringbuffer]")
+{
+    RingBuffer<std::string, 2> buffer;
+    buffer.reserve(10);
+    REQUIRE(buffer.capacity() == 16);
+
+    for (int value = 0; value < 5; ++value)
+        buffer.push_back(std::to_string(value));
+    buffer.pop_front();
+    buffer.shrink_to_fit();
+    REQUIRE(buffer.capacity() == 4);
+    REQUIRE(buffer.front() == "1");
+    REQUIRE(buffer.back() == "4");
+
+    buffer.pop_front();
+    buffer.pop_front();
+    buffer.shrink_to_fit();
+    REQUIRE(buffer.capacity() == 2);
+    REQUIRE(buffer.front() == "3");
+    REQUIRE(buffer.back() == "4");
+}
+
+TEST_CASE("a ring buffer destroys its elements", "[ringbuffer]")
+{
+    Counted::numInstances = 0;
+    {
+        RingBuffer<Counted, 2> buffer;
+        for (int value = 0; value < 10; ++value)
+            buffer.push_back(Counted(value));
+        REQUIRE(Counted::numInstances == 10);
+        buffer.pop_front();
+        REQUIRE(Counted::numInstances == 9);
+        REQUIRE(buffer.front().value == 1);
+    }
+    REQUIRE(Counted::numInstances == 0);
+}
+
+TEST_CASE("a ring buffer holds move-only elements", "[ringbuffer]")
+{
+    RingBuffer<std::unique_ptr<int>, 1> buffer;
+    for (int value = 0; value < 3; ++value)
+        buffer.push_back(std::unique_ptr<int>(new int(value)));
+    REQUIRE(*buffer.front() == 0);
+    std::unique_ptr<int> first = std::move(buffer.front());
+    buffer.pop_front();
+    REQUIRE(*first == 0);
+    REQUIRE(*buffer.front() == 1);
+}
@@ -215,6 +215,143 @@ TEST_CASE("an asynchronous statemachine is stopped upon destruction",
     }
 }
 
+TEST_CASE("a persistent event loop survives stop requests", "[statemachine]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        ConfigurationChangeCallbacksEnable<true>,
+                                        PersistentEventLoopEnable<true>>;
+
+    std::mutex mutex;
+    bool configurationChanged = false;
+    std::condition_variable cv;
+
+    auto waitForConfigurationChange = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return configurationChanged; });
+        configurationChanged = false;
+    };
+
+    StateMachine_t sm;
+    sm.setConfigurationChangeCallback([&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        configurationChanged = true;
+        cv.notify_all();
+    });
+
+    auto result = sm.startAsyncEventLoop();
+
+    SECTION("restart without a new event loop")
+    {
+        for (int cnt = 0; cnt < 3; ++cnt)
+        {
+            sm.start();
+            waitForConfigurationChange();
+            REQUIRE(sm.running());
+            REQUIRE(sm.numConfigurationChanges() == 2 * cnt + 1);
+            sm.stop();
+            waitForConfigurationChange();
+            REQUIRE(!sm.running());
+            REQUIRE(sm.numConfigurationChanges() == 2 * cnt + 2);
+            REQUIRE(result.wait_for(std::chrono::milliseconds(0))
+                    == std::future_status::timeout);
+        }
+
+        sm.shutdownEventLoop();
+        result.get();
+    }
+
+    SECTION("shut down a running state machine")
+    {
+        sm.start();
+        waitForConfigurationChange();
+        sm.shutdownEventLoop();
+        result.get();
+        REQUIRE(!sm.running());
+        REQUIRE(sm.numConfigurationChanges() == 2);
+    }
+}
+
+TEST_CASE("wait for configuration changes", "[statemachine]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+
+    REQUIRE(!sm.waitForConfigurationChange(0, std::chrono::milliseconds(1)));
+    REQUIRE(!sm.waitUntilActive(a, std::chrono::milliseconds(1)));
+
+    auto result = sm.startAsyncEventLoop();
+    sm.start();
+    REQUIRE(sm.waitForConfigurationChange(0, std::chrono::seconds(10)));
+    REQUIRE(sm.waitUntilActive(a, std::chrono::seconds(10)));
+    unsigned count = sm.numConfigurationChanges();
+    REQUIRE(count == 1);
+
+    sm.addEvent(1);
+    REQUIRE(sm.waitUntilActive(b, std::chrono::seconds(10)));
+    REQUIRE(sm.waitForConfigurationChange(count, std::chrono::seconds(10)));
+    REQUIRE(!sm.waitUntilActive(a, std::chrono::milliseconds(1)));
+
+    sm.stop();
+    result.get();
+    REQUIRE(!sm.waitUntilActive(b, std::chrono::milliseconds(1)));
+    REQUIRE(sm.numConfigurationChanges() == 3);
+}
+
+TEST_CASE("wait until a state machine is idle", "[statemachine]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        EventCallbacksEnable<true>>;
+    using State_t = StateMachine_t::state_type;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    int numEvents = 0;
+    sm.setEventDispatchCallback([&](int) { ++numEvents; });
+
+    REQUIRE(sm.waitUntilIdle(std::chrono::milliseconds(0)));
+
+    SECTION("dispatch in the caller")
+    {
+        sm.start();
+        REQUIRE(!sm.waitUntilIdle(std::chrono::milliseconds(1)));
+        sm.addEvent(1);
+        sm.dispatchPending(0);
+        REQUIRE(!sm.waitUntilIdle(std::chrono::milliseconds(1)));
+        sm.dispatchPending();
+        REQUIRE(sm.waitUntilIdle(std::chrono::milliseconds(0)));
+        REQUIRE(numEvents == 1);
+
+        sm.stop();
+        REQUIRE(!sm.waitUntilIdle(std::chrono::milliseconds(1)));
+        sm.dispatchPending();
+        REQUIRE(sm.waitUntilIdle(std::chrono::milliseconds(0)));
+
+        // Events, which are added to a stopped machine, are deferred.
+        sm.addEvent(2);
+        REQUIRE(sm.waitUntilIdle(std::chrono::milliseconds(0)));
+    }
+
+    SECTION("dispatch in an event loop")
+    {
+        auto result = sm.startAsyncEventLoop();
+        sm.start();
+        for (int cnt = 0; cnt < 1000; ++cnt)
+            sm.addEvent(cnt);
+        REQUIRE(sm.waitUntilIdle(std::chrono::seconds(10)));
+        REQUIRE(numEvents == 1000);
+
+        sm.stop();
+        REQUIRE(sm.waitUntilIdle(std::chrono::seconds(10)));
+        REQUIRE(!sm.running());
+        result.get();
+    }
+}
+
 SCENARIO("state machine actions are executed", "[statemachine]")
 {
     GIVEN ("a synchronous FSM")
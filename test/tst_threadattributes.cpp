@@ -0,0 +1,240 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/executor.hpp"
+#include "../src/statemachine.hpp"
+#include "../src/threadattributes.hpp"
+#include "../src/threadedstate.hpp"
+#include "../src/threadpool.hpp"
+
+#include "testutils.hpp"
+
+#include <future>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif // __linux__
+
+using namespace fsm11;
+
+#if defined(__linux__)
+
+namespace
+{
+
+struct ThreadInfo
+{
+    std::string name;
+    std::vector<unsigned> affinity;
+    std::size_t stackSize{0};
+};
+
+ThreadInfo currentThreadInfo()
+{
+    ThreadInfo info;
+
+    char name[16];
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    info.name = name;
+
+    cpu_set_t cpus;
+    pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &cpus))
+            info.affinity.push_back(cpu);
+
+    pthread_attr_t attrs;
+    pthread_getattr_np(pthread_self(), &attrs);
+    pthread_attr_getstacksize(&attrs, &info.stackSize);
+    pthread_attr_destroy(&attrs);
+
+    return info;
+}
+
+// Returns the stack size of the process' default thread attributes.
+std::size_t defaultThreadStackSize()
+{
+    std::size_t size = 0;
+    pthread_attr_t attrs;
+    pthread_getattr_default_np(&attrs);
+    pthread_attr_getstacksize(&attrs, &size);
+    pthread_attr_destroy(&attrs);
+    return size;
+}
+
+// Returns the last CPU on which the process may run.
+unsigned lastAllowedCpu()
+{
+    cpu_set_t cpus;
+    sched_getaffinity(0, sizeof(cpus), &cpus);
+    unsigned last = 0;
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &cpus))
+            last = cpu;
+    return last;
+}
+
+template <typename TStateMachine>
+class InfoState : public ThreadedState<TStateMachine>
+{
+public:
+    using ThreadedState<TStateMachine>::ThreadedState;
+
+    virtual void invoke(ExitRequest&) override
+    {
+        m_info.set_value(currentThreadInfo());
+    }
+
+    std::promise<ThreadInfo> m_info;
+};
+
+} // anonymous namespace
+
+TEST_CASE("create a thread with attributes", "[threadattributes]")
+{
+    unsigned cpu = lastAllowedCpu();
+
+    ThreadAttributes attrs;
+    REQUIRE(attrs.isDefault());
+    attrs.setName("fsm11-attrs-thread")
+         .setAffinity({cpu})
+         .setStackSize(4 * 1024 * 1024);
+    REQUIRE(!attrs.isDefault());
+    REQUIRE(attrs.name() == "fsm11-attrs-thr");
+
+    std::size_t defaultStackSize = defaultThreadStackSize();
+
+    ThreadInfo info;
+    fsm11_detail::Thread thread = fsm11_detail::makeThread(
+                             attrs, [&] { info = currentThreadInfo(); });
+    thread.join();
+
+    REQUIRE(info.name == "fsm11-attrs-thr");
+    REQUIRE(info.affinity == std::vector<unsigned>{cpu});
+    // The C library may re-use a larger stack of a terminated thread.
+    REQUIRE(info.stackSize >= 4 * 1024 * 1024);
+    // The process-wide default is not changed.
+    REQUIRE(defaultThreadStackSize() == defaultStackSize);
+}
+
+TEST_CASE("invalid thread attributes are reported", "[threadattributes]")
+{
+    ThreadAttributes attrs;
+    attrs.setAffinity({CPU_SETSIZE});
+
+    bool called = false;
+    REQUIRE_THROWS_AS(fsm11_detail::makeThread(attrs, [&] { called = true; }),
+                      std::system_error&);
+    REQUIRE(!called);
+}
+
+TEST_CASE("start an event loop with thread attributes", "[threadattributes]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        ConfigurationChangeCallbacksEnable<true>>;
+
+    StateMachine_t sm;
+    std::promise<ThreadInfo> info;
+    sm.setConfigurationChangeCallback([&] {
+        if (sm.running())
+            info.set_value(currentThreadInfo());
+    });
+
+    ThreadAttributes attrs;
+    attrs.setName("fsm11-loop").setAffinity({lastAllowedCpu()});
+    auto result = sm.startAsyncEventLoop(attrs);
+    sm.start();
+
+    ThreadInfo loopInfo = info.get_future().get();
+    REQUIRE(loopInfo.name == "fsm11-loop");
+    REQUIRE(loopInfo.affinity == attrs.affinity());
+
+    sm.stop();
+    result.get();
+}
+
+TEST_CASE("invoke a threaded state with thread attributes",
+          "[threadattributes]")
+{
+    using StateMachine_t = StateMachine<>;
+
+    ThreadAttributes attrs;
+    attrs.setName("fsm11-invoke").setStackSize(1024 * 1024);
+
+    StateMachine_t sm;
+    InfoState<StateMachine_t> state("state", attrs, &sm);
+    sm.start();
+
+    ThreadInfo info = state.m_info.get_future().get();
+    REQUIRE(info.name == "fsm11-invoke");
+    REQUIRE(info.stackSize >= 1024 * 1024);
+
+    sm.stop();
+}
+
+TEST_CASE("create thread pools with thread attributes", "[threadattributes]")
+{
+    using StateMachine_t = StateMachine<ThreadPoolEnable<true, 2>>;
+
+    ThreadAttributes attrs1;
+    attrs1.setName("fsm11-worker-1");
+    ThreadAttributes attrs2;
+    attrs2.setName("fsm11-worker-2");
+
+    StateMachine_t sm(ThreadPool<2>(attrs1, attrs2));
+    InfoState<StateMachine_t> state("state", &sm);
+    sm.start();
+
+    ThreadInfo info = state.m_info.get_future().get();
+    REQUIRE((info.name == "fsm11-worker-1" || info.name == "fsm11-worker-2"));
+
+    sm.stop();
+
+    SECTION("dynamic thread pool")
+    {
+        DynamicThreadPool pool(1, 2, attrs1);
+        REQUIRE(pool.size() == 1);
+    }
+
+    SECTION("executor")
+    {
+        Executor executor(2, attrs2);
+        std::promise<ThreadInfo> executorInfo;
+        executor.post([&] { executorInfo.set_value(currentThreadInfo()); });
+        REQUIRE(executorInfo.get_future().get().name == "fsm11-worker-2");
+    }
+}
+
+#endif // __linux__
@@ -31,7 +31,9 @@
 #include "../src/threadedstate.hpp"
 #include "../src/statemachine.hpp"
 
+#include <algorithm>
 #include <condition_variable>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -229,6 +231,191 @@ TEST_CASE("invoked action is left when state machine is destructed",
     lock.unlock();
 }
 
+#ifndef FSM11_USE_WEOS
+TEST_CASE("threads are reused when a threaded state is re-entered",
+          "[threadedstate]")
+{
+    using namespace syncSM;
+
+    auto& cache = fsm11_detail::ThreadCache::instance();
+
+    StateMachine_t sm;
+    TestState<State_t> s1("s1", &sm);
+
+    sm.start();
+    sm.stop();
+    g_mutex.lock();
+    std::thread::id firstId = g_id;
+    g_mutex.unlock();
+
+    // Wait until the thread has been parked. Threads of other tests may be
+    // parked already, so wait for all of them.
+    while (cache.numIdleThreads() != cache.numThreads())
+        std::this_thread::yield();
+    std::size_t numThreads = cache.numThreads();
+
+    sm.start();
+    sm.stop();
+    g_mutex.lock();
+    REQUIRE(g_id == firstId);
+    g_mutex.unlock();
+    REQUIRE(cache.numThreads() == numThreads);
+}
+#endif // FSM11_USE_WEOS
+
+// An invoke action, which runs until its gate is opened.
+class GatedInvoke : public fsm11_detail::ThreadedStateBase
+{
+public:
+    explicit GatedInvoke(std::shared_future<void> gate)
+        : m_gate(gate)
+    {
+    }
+
+    virtual void invoke(fsm11::ExitRequest&) override
+    {
+        m_gate.wait();
+    }
+
+private:
+    std::shared_future<void> m_gate;
+};
+
+TEST_CASE("a thread cache does not wait for running invoke actions",
+          "[threadedstate]")
+{
+    std::promise<void> openGate;
+    std::promise<void> openGateLater;
+    GatedInvoke parked(openGate.get_future().share());
+    GatedInvoke running(openGateLater.get_future().share());
+    std::future<void> result;
+
+    {
+        fsm11_detail::ThreadCache cache;
+        result = cache.enqueue(running);
+        openGate.set_value();
+        cache.enqueue(parked).get();
+        while (cache.numIdleThreads() != 1)
+            std::this_thread::yield();
+        REQUIRE(cache.numThreads() == 2);
+
+        // The parked thread exits, whereas the running one is left alone.
+    }
+
+    openGateLater.set_value();
+    result.get();
+}
+
+namespace asyncExitSM
+{
+using StateMachine_t = StateMachine<AsynchronousInvokeExitEnable<true>>;
+using State_t = ThreadedState<StateMachine_t>;
+} // namespace asyncExitSM
+
+// A state whose invoke action ignores the exit request until it is
+// released.
+template <typename TBaseState>
+class LingeringState : public TBaseState
+{
+public:
+    using TBaseState::TBaseState;
+
+    virtual void invoke(fsm11::ExitRequest& request) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++numInvocations;
+        ++numRunning;
+        maxRunning = std::max(maxRunning, numRunning);
+        m_cv.notify_all();
+        m_cv.wait(lock, [&] { return released; });
+        lock.unlock();
+
+        request.wait();
+
+        lock.lock();
+        --numRunning;
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        released = true;
+        m_cv.notify_all();
+    }
+
+    void waitForInvocations(int count)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return numInvocations >= count; });
+    }
+
+    int invocations()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return numInvocations;
+    }
+
+    bool released{false};
+    int numInvocations{0};
+    int numRunning{0};
+    int maxRunning{0};
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+TEST_CASE("an invoke action can be left asynchronously", "[threadedstate]")
+{
+    using namespace asyncExitSM;
+
+    StateMachine_t sm;
+    LingeringState<State_t> a("a", &sm);
+    State<StateMachine_t> b("b", &sm);
+    sm += a + event(1) > b;
+    sm += b + event(2) > a;
+
+    sm.start();
+    a.waitForInvocations(1);
+
+    // Leaving the state must not wait for the invoke action.
+    sm.addEvent(1);
+    REQUIRE(b.isActive());
+
+    SECTION("the re-entry is deferred")
+    {
+        sm.addEvent(2);
+        REQUIRE(a.isActive());
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        REQUIRE(a.invocations() == 1);
+
+        a.release();
+        a.waitForInvocations(2);
+        sm.stop();
+        REQUIRE(a.maxRunning == 1);
+    }
+
+    SECTION("stopping the state machine waits for the invoke action")
+    {
+        std::thread releaser([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            a.release();
+        });
+        sm.stop();
+        REQUIRE(a.numRunning == 0);
+        releaser.join();
+    }
+
+    SECTION("a deferred invocation is dropped when the state is left")
+    {
+        sm.addEvent(2);
+        sm.addEvent(1);
+        a.release();
+        sm.stop();
+        REQUIRE(a.numInvocations == 1);
+    }
+}
+
 struct ThreadedInvokeException
 {
 };
@@ -287,4 +474,159 @@ SCENARIO("throwing an exception in a threaded state", "[threadedstate]")
             }
         }
     }
+
+    GIVEN ("an FSM which leaves invoke actions asynchronously")
+    {
+        using namespace asyncExitSM;
+        std::unique_ptr<ThrowingState<State_t>> s;
+        StateMachine_t sm;
+        s.reset(new ThrowingState<State_t>("s", &sm));
+
+        WHEN ("an exception is thrown in the invoked action")
+        {
+            sm.start();
+            THEN ("it arrives at the caller when the FSM is stopped")
+            {
+                REQUIRE_THROWS_AS(sm.stop(), ThreadedInvokeException);
+            }
+        }
+    }
+}
+
+// A state which signals its entry.
+class SignallingState : public State<asyncSM::StateMachine_t>
+{
+public:
+    using State<asyncSM::StateMachine_t>::State;
+
+    virtual void onEntry(int) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entered = true;
+        m_cv.notify_all();
+    }
+
+    void waitForEntry()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_entered; });
+    }
+
+    bool entered()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entered;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_entered{false};
+};
+
+template <typename TState>
+void testCompletionEvents(bool throws)
+{
+    using namespace asyncSM;
+
+    StateMachine_t sm;
+    TState a("a", &sm);
+    SignallingState done("done", &sm);
+    SignallingState error("error", &sm);
+    sm += a + event(10) > done;
+    sm += a + event(11) > error;
+    a.setDoneEvent(10);
+    a.setErrorEvent(11);
+
+    auto result = sm.startAsyncEventLoop();
+    sm.start();
+    if (throws)
+        error.waitForEntry();
+    else
+        done.waitForEntry();
+    REQUIRE(done.entered() != throws);
+    REQUIRE(error.entered() == throws);
+    sm.stop();
+    result.get();
+}
+
+TEST_CASE("a threaded state adds completion events", "[threadedstate]")
+{
+    SECTION("the done event is added when the invoke action returns")
+    {
+        testCompletionEvents<TestState<asyncSM::State_t>>(false);
+    }
+
+    SECTION("the error event is added when the invoke action throws")
+    {
+        // The exception is replaced by the error event, so stopping the
+        // state machine does not throw.
+        testCompletionEvents<ThrowingState<asyncSM::State_t>>(true);
+    }
+}
+
+// A state whose invoke action returns when the gate is opened.
+template <typename TBaseState>
+class GatedState : public TBaseState
+{
+public:
+    GatedState(const char* name,
+               State<typename TBaseState::state_machine_type>* parent,
+               std::shared_future<void> gate)
+        : TBaseState(name, parent),
+          m_gate(gate)
+    {
+    }
+
+    virtual void invoke(fsm11::ExitRequest&) override
+    {
+        m_gate.wait();
+    }
+
+private:
+    std::shared_future<void> m_gate;
+};
+
+TEST_CASE("a completion event does not block on a full event list",
+          "[threadedstate]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        EventListCapacity<1, Block>>;
+    using State_t = ThreadedState<StateMachine_t>;
+
+    std::promise<void> openGate;
+    StateMachine_t sm;
+    GatedState<State_t> a("a", &sm, openGate.get_future().share());
+    StateMachine_t::state_type b("b", &sm);
+    StateMachine_t::state_type c("c", &sm);
+    sm += a + event(10) > b;
+    sm += b + event(1) > c;
+    a.setDoneEvent(10);
+
+    sm.start();
+    sm.dispatchPending();
+    REQUIRE(a.isActive());
+
+    // Fill the event list and let the invoke action finish. The done event
+    // does not fit into the list but must not be lost.
+    sm.addEvent(1);
+    openGate.set_value();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // The event 1 is discarded in a. Then the done event leads to b.
+    // Leaving the state waits for the invoke action. This must not deadlock
+    // with the invoke action, which has tried to add its done event.
+    for (int tries = 0; tries < 100 && !b.isActive(); ++tries)
+    {
+        sm.dispatchPending();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(!a.isActive());
+    REQUIRE(b.isActive());
+    REQUIRE(sm.numDroppedEvents() == 0);
+
+    // The list takes new events again.
+    sm.addEvent(1);
+    sm.dispatchPending();
+    REQUIRE(c.isActive());
 }
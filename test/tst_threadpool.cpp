@@ -34,7 +34,15 @@
 
 #include "testutils.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 using namespace fsm11;
 
@@ -51,6 +59,7 @@ public:
         lock_guard<mutex> lock(m_mutex);
         m_id = this_thread::get_id();
         m_idSet.insert(m_id);
+        ++m_numInvocations;
         this_thread::sleep_for(chrono::milliseconds(10));
     }
 
@@ -60,6 +69,12 @@ public:
         return m_id;
     }
 
+    int numInvocations() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_numInvocations;
+    }
+
     static void resetNumThreads()
     {
         std::lock_guard<std::mutex> lock(m_mutex);
@@ -75,6 +90,7 @@ public:
 private:
     static std::mutex m_mutex;
     std::thread::id m_id;
+    int m_numInvocations{0};
     static std::set<std::thread::id> m_idSet;
 };
 
@@ -104,6 +120,14 @@ TEST_CASE("thread pool construction and moving", "[threadpool]")
         ThreadPool<32> pool2;
         pool2 = std::move(pool1);
     }
+
+    SECTION("more than 32 workers")
+    {
+        ThreadPool<128> pool1;
+        ThreadPool<128> pool2(std::move(pool1));
+        ThreadPool<128> pool3;
+        pool3 = std::move(pool2);
+    }
 }
 
 TEST_CASE("invoked actions are executed in a thread pool", "[threadpool]")
@@ -201,6 +225,7 @@ TEST_CASE("the thread pool throws an exception on underflow", "[threadpool]")
         using State_t = ThreadedState<StateMachine_t>;
 
         ThreadPool_t pool;
+        pool.setMaxQueueSize(0);
         StateMachine_t sm(std::move(pool));
         TestState<State_t> a("a", &sm);
         TestState<State_t> b("b", &a);
@@ -246,6 +271,7 @@ TEST_CASE("the thread pool throws an exception on underflow", "[threadpool]")
         using State_t = ThreadedState<StateMachine_t>;
 
         ThreadPool_t pool;
+        pool.setMaxQueueSize(0);
         StateMachine_t sm(std::move(pool));
         TestState<State_t> a("a", &sm);
         TestState<State_t> b("b", &a);
@@ -283,3 +309,396 @@ TEST_CASE("the thread pool throws an exception on underflow", "[threadpool]")
         }
     }
 }
+
+template <typename TState>
+void waitForInvocations(std::initializer_list<TState*> states, int count)
+{
+    for (auto state : states)
+        while (state->numInvocations() < count)
+            std::this_thread::yield();
+}
+
+template <typename TBaseState>
+class BlockingState : public TBaseState
+{
+public:
+    using TBaseState::TBaseState;
+
+    virtual void invoke(fsm11::ExitRequest& exitRequest) override
+    {
+        ++numInvocations;
+        exitRequest.wait();
+    }
+
+    std::atomic_int numInvocations{0};
+};
+
+TEST_CASE("the thread pool queues tasks when all workers are busy",
+          "[threadpool]")
+{
+    using StateMachine_t = StateMachine<ThreadPoolEnable<true, 2>>;
+    using ThreadPool_t = StateMachine_t::thread_pool_type;
+    using State_t = ThreadedState<StateMachine_t>;
+
+    ThreadPool_t pool;
+    REQUIRE(pool.maxQueueSize() == std::size_t(-1));
+
+    SECTION ("queued tasks are started when a worker becomes idle")
+    {
+        StateMachine_t sm(std::move(pool));
+        TestState<State_t> a("a", &sm);
+        TestState<State_t> b("b", &a);
+        TestState<State_t> c("c", &b);
+        TestState<State_t> d("d", &c);
+
+        a.resetNumThreads();
+        sm.start();
+        waitForInvocations({&a, &b, &c, &d}, 1);
+        sm.stop();
+
+        for (auto state : {&a, &b, &c, &d})
+            REQUIRE(state->threadId() != std::thread::id());
+        REQUIRE(a.numThreads() <= 2);
+    }
+
+    SECTION ("a queued task is cancelled when all workers are busy")
+    {
+        pool.setMaxQueueSize(1);
+        StateMachine_t sm(std::move(pool));
+        BlockingState<State_t> a("a", &sm);
+        BlockingState<State_t> b("b", &a);
+        BlockingState<State_t> c("c", &b);
+
+        // Two of the invoke actions block both workers until their states
+        // are left. The third one has to be cancelled, if its state is
+        // left first, or the FSM could never be stopped.
+        sm.start();
+        while (a.numInvocations + b.numInvocations + c.numInvocations < 2)
+            std::this_thread::yield();
+        sm.stop();
+
+        for (auto state : {&a, &b, &c})
+            REQUIRE(state->numInvocations <= 1);
+    }
+
+    SECTION ("the queue size can be limited")
+    {
+        pool.setMaxQueueSize(1);
+        StateMachine_t sm(std::move(pool));
+        BlockingState<State_t> a("a", &sm);
+        BlockingState<State_t> b("b", &a);
+        BlockingState<State_t> c("c", &b);
+        BlockingState<State_t> d("d", &c);
+
+        try
+        {
+            sm.start();
+            REQUIRE(false);
+        }
+        catch (Error& error)
+        {
+            REQUIRE(error.code() == ErrorCode::ThreadPoolUnderflow);
+        }
+        REQUIRE(!sm.running());
+    }
+}
+
+TEST_CASE("idle workers steal queued tasks", "[threadpool]")
+{
+    using StateMachine_t = StateMachine<ThreadPoolEnable<true, 4>,
+                                        MultithreadingEnable<true>>;
+    using ThreadPool_t = StateMachine_t::thread_pool_type;
+    using State_t = ThreadedState<StateMachine_t>;
+
+    // The states must be destructed after sm's destructor has been called.
+    std::vector<std::unique_ptr<TestState<State_t>>> states;
+
+    ThreadPool_t pool;
+    StateMachine_t sm(std::move(pool));
+    StateMachine_t::state_type* parent = &sm;
+    for (int count = 0; count < 16; ++count)
+    {
+        states.emplace_back(new TestState<State_t>("s", parent));
+        parent = states.back().get();
+    }
+
+    for (int round = 1; round <= 10; ++round)
+    {
+        sm.start();
+        for (auto& state : states)
+            while (state->numInvocations() < round)
+                std::this_thread::yield();
+        sm.stop();
+    }
+
+    for (auto& state : states)
+    {
+        REQUIRE(state->threadId() != std::thread::id());
+        REQUIRE(state->numInvocations() == 10);
+    }
+}
+
+class OrderedTask : public fsm11_detail::ThreadedStateBase
+{
+public:
+    OrderedTask(int id, std::vector<int>& order)
+        : m_id(id),
+          m_order(order)
+    {
+    }
+
+    virtual void invoke(fsm11::ExitRequest&) override
+    {
+        m_order.push_back(m_id);
+    }
+
+private:
+    int m_id;
+    std::vector<int>& m_order;
+};
+
+TEST_CASE("a worker starts its tasks in FIFO order", "[threadpool]")
+{
+    // A single worker runs the tasks one after the other, so the order is
+    // not guarded.
+    std::vector<int> order;
+    std::vector<std::unique_ptr<OrderedTask>> tasks;
+    std::vector<std::future<void>> futures;
+
+    ThreadPool<1> pool;
+    for (int id = 0; id < 1000; ++id)
+    {
+        tasks.emplace_back(new OrderedTask(id, order));
+        futures.push_back(pool.enqueue(*tasks.back()));
+    }
+    for (auto& future : futures)
+        future.get();
+
+    REQUIRE(order.size() == 1000);
+    for (int id = 0; id < 1000; ++id)
+        REQUIRE(order[id] == id);
+}
+
+TEST_CASE("a thread pool can be shared by several state machines",
+          "[threadpool]")
+{
+    using StateMachine_t = StateMachine<ThreadPoolEnable<true, 2>>;
+    using ThreadPool_t = StateMachine_t::thread_pool_type;
+    using State_t = ThreadedState<StateMachine_t>;
+
+    auto pool = std::make_shared<ThreadPool_t>();
+
+    SECTION ("the pool is held by reference or by shared pointer")
+    {
+        StateMachine_t sm1(*pool);
+        StateMachine_t sm2(pool);
+        StateMachine_t sm3(pool);
+        TestState<State_t> a("a", &sm1);
+        TestState<State_t> b("b", &sm2);
+        TestState<State_t> c("c", &sm3);
+        TestState<State_t> d("d", &c);
+
+        a.resetNumThreads();
+        for (auto sm : {&sm1, &sm2, &sm3})
+            sm->start();
+        waitForInvocations({&a, &b, &c, &d}, 1);
+        for (auto sm : {&sm1, &sm2, &sm3})
+            sm->stop();
+
+        REQUIRE(a.numThreads() <= 2);
+    }
+
+    SECTION ("a shared pool is kept alive by its state machines")
+    {
+        std::unique_ptr<StateMachine_t> sm(new StateMachine_t(pool));
+        TestState<State_t> a("a", sm.get());
+        pool.reset();
+
+        sm->start();
+        waitForInvocations({&a}, 1);
+        sm->stop();
+    }
+
+    SECTION ("the number of invocations in flight can be limited")
+    {
+        StateMachine_t sm1(pool);
+        REQUIRE(sm1.maxInvocationsInFlight() == std::size_t(-1));
+        sm1.setMaxInvocationsInFlight(1);
+        REQUIRE(sm1.maxInvocationsInFlight() == 1);
+
+        TestState<State_t> a("a", &sm1);
+        TestState<State_t> b("b", &a);
+        TestState<State_t> c("c", &b);
+
+        // The invocations of sm1 are run one after the other.
+        sm1.start();
+        waitForInvocations({&a, &b, &c}, 1);
+        sm1.stop();
+
+        // The second machine is not blocked by the first one.
+        StateMachine_t sm2(pool);
+        BlockingState<State_t> d("d", &sm1);
+        BlockingState<State_t> e("e", &d);
+        TestState<State_t> f("f", &sm2);
+
+        sm1 += a + event(1) > d;
+        sm1.start();
+        sm1.addEvent(1);
+        while (d.numInvocations == 0)
+            std::this_thread::yield();
+        sm2.start();
+        waitForInvocations({&f}, 1);
+        sm2.stop();
+
+        // The invocation of e is pending and must be cancelled.
+        sm1.stop();
+        REQUIRE(d.numInvocations == 1);
+        REQUIRE(e.numInvocations == 0);
+    }
+}
+
+template <typename TBaseState>
+class TicketState : public TBaseState
+{
+public:
+    TicketState(const char* name,
+                State<typename TBaseState::state_machine_type>* parent,
+                std::atomic_int& counter, std::shared_future<void> gate)
+        : TBaseState(name, parent),
+          m_counter(counter),
+          m_gate(gate)
+    {
+    }
+
+    virtual void invoke(fsm11::ExitRequest&) override
+    {
+        ticket = ++m_counter;
+        m_gate.wait();
+    }
+
+    //! The position in which the invoke action has been started.
+    std::atomic_int ticket{0};
+
+private:
+    std::atomic_int& m_counter;
+    std::shared_future<void> m_gate;
+};
+
+TEST_CASE("a shared thread pool serves the state machines round-robin",
+          "[threadpool]")
+{
+    using StateMachine_t = StateMachine<ThreadPoolEnable<true, 1>>;
+    using ThreadPool_t = StateMachine_t::thread_pool_type;
+    using State_t = ThreadedState<StateMachine_t>;
+
+    auto pool = std::make_shared<ThreadPool_t>();
+    std::atomic_int counter{0};
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::shared_future<void> ready;
+    {
+        std::promise<void> promise;
+        promise.set_value();
+        ready = promise.get_future().share();
+    }
+
+    // The default settings do not limit the invocations in flight.
+    StateMachine_t sm1(pool);
+    StateMachine_t sm2(pool);
+    REQUIRE(sm1.maxInvocationsInFlight() == std::size_t(-1));
+
+    TicketState<State_t> a("a", &sm1, counter, opened);
+    TicketState<State_t> b("b", &a, counter, ready);
+    TicketState<State_t> c("c", &b, counter, ready);
+    TicketState<State_t> d("d", &c, counter, ready);
+    TicketState<State_t> e("e", &sm2, counter, ready);
+
+    // The worker is blocked by a, while the other invocations of sm1 are
+    // queued before the one of sm2.
+    sm1.start();
+    while (a.ticket == 0)
+        std::this_thread::yield();
+    sm2.start();
+    gate.set_value();
+
+    while (d.ticket == 0 || e.ticket == 0)
+        std::this_thread::yield();
+    sm1.stop();
+    sm2.stop();
+
+    // The machines take turns, so sm2 does not have to wait for all
+    // invocations of sm1.
+    REQUIRE(a.ticket == 1);
+    REQUIRE(b.ticket == 2);
+    REQUIRE(e.ticket == 3);
+    REQUIRE(c.ticket == 4);
+    REQUIRE(d.ticket == 5);
+}
+
+TEST_CASE("a dynamic thread pool grows and shrinks", "[threadpool]")
+{
+    using StateMachine_t = StateMachine<ThreadPoolEnable<true>>;
+    using ThreadPool_t = StateMachine_t::thread_pool_type;
+    using State_t = ThreadedState<StateMachine_t>;
+
+    static_assert(std::is_same<ThreadPool_t, DynamicThreadPool>::value,
+                  "The pool size must be determined at runtime.");
+
+    ThreadPool_t pool(1, 4);
+    pool.setGrowThreshold(std::chrono::milliseconds(1));
+    pool.setIdleTimeout(std::chrono::milliseconds(50));
+    REQUIRE(pool.minSize() == 1);
+    REQUIRE(pool.maxSize() == 4);
+    REQUIRE(pool.size() == 1);
+    REQUIRE(pool.queueSize() == 0);
+
+    StateMachine_t sm(pool);
+    BlockingState<State_t> a("a", &sm);
+    BlockingState<State_t> b("b", &a);
+    BlockingState<State_t> c("c", &b);
+
+    // The blocking invoke actions can only run if the pool grows.
+    sm.start();
+    while (a.numInvocations + b.numInvocations + c.numInvocations != 3)
+        std::this_thread::yield();
+    REQUIRE(pool.size() == 3);
+    REQUIRE(pool.numRunningTasks() == 3);
+    REQUIRE(pool.queueSize() == 0);
+    sm.stop();
+
+    // The idle workers retire until the minimum size is reached.
+    for (int tries = 0; tries < 100 && pool.size() != 1; ++tries)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    REQUIRE(pool.size() == 1);
+
+    // The pool grows again when needed.
+    sm.start();
+    while (a.numInvocations + b.numInvocations + c.numInvocations != 6)
+        std::this_thread::yield();
+    sm.stop();
+}
+
+TEST_CASE("leaving a queued task does not wait for a dynamic pool to grow",
+          "[threadpool]")
+{
+    using StateMachine_t = StateMachine<ThreadPoolEnable<true>>;
+    using ThreadPool_t = StateMachine_t::thread_pool_type;
+    using State_t = ThreadedState<StateMachine_t>;
+
+    // The pool never grows during the test.
+    ThreadPool_t pool(1, 4);
+    pool.setGrowThreshold(std::chrono::hours(1));
+
+    StateMachine_t sm(pool);
+    BlockingState<State_t> a("a", &sm);
+    BlockingState<State_t> b("b", &a);
+
+    sm.start();
+    while (a.numInvocations + b.numInvocations != 1)
+        std::this_thread::yield();
+    REQUIRE(pool.size() == 1);
+
+    // The queued task cannot be started, so it is cancelled.
+    sm.stop();
+    REQUIRE(a.numInvocations + b.numInvocations == 1);
+}
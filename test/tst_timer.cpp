@@ -0,0 +1,372 @@
+/*******************************************************************************
+  fsm11 - A C++11-compliant framework for finite state machines
+
+  Copyright (c) 2015, Manuel Freiberger
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+  - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "catch.hpp"
+
+#include "../src/statemachine.hpp"
+#include "../src/timerservice.hpp"
+#include "testutils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace fsm11;
+
+namespace
+{
+
+//! A clock which is advanced manually.
+struct ManualClock
+{
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<ManualClock>;
+    static constexpr bool is_steady = true;
+
+    static duration& current()
+    {
+        static duration value(0);
+        return value;
+    }
+
+    static time_point now()
+    {
+        return time_point(current());
+    }
+};
+
+using TimerService_t = TimerService<ManualClock>;
+
+} // anonymous namespace
+
+namespace timerSM
+{
+using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                    MultithreadingEnable<true>,
+                                    TimerEnable<true, ManualClock>>;
+using State_t = StateMachine_t::state_type;
+} // namespace timerSM
+
+namespace asyncTimerSM
+{
+using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                    MultithreadingEnable<true>,
+                                    TimerEnable<true>>;
+using State_t = StateMachine_t::state_type;
+} // namespace asyncTimerSM
+
+TEST_CASE("transitions without timers have no timeout", "[timer]")
+{
+    using MtStateMachine_t = StateMachine<MultithreadingEnable<true>>;
+    REQUIRE(sizeof(Transition<MtStateMachine_t>)
+            < sizeof(Transition<timerSM::StateMachine_t>));
+}
+
+TEST_CASE("timers expire in order", "[timer]")
+{
+    TimerService_t service(std::chrono::milliseconds(1), false);
+    const auto start = ManualClock::now();
+    std::vector<int> fired;
+
+    // The delays cover all levels of the timing wheel and a timer, which is
+    // beyond its range.
+    const std::int64_t delays[] = {20000000, 300000, 5000, 70, 5, 0};
+    for (std::int64_t delay : delays)
+    {
+        service.scheduleAt(start + std::chrono::milliseconds(delay),
+                           [&fired, delay] { fired.push_back(int(delay / 5)); });
+    }
+    REQUIRE(service.size() == 6);
+
+    service.processExpired();
+    REQUIRE(fired == std::vector<int>({0}));
+
+    const std::int64_t checkpoints[] = {4, 5, 69, 70, 4999, 5000,
+                                        299999, 300000, 19999999, 20000000};
+    std::vector<int> expected{0};
+    for (std::int64_t checkpoint : checkpoints)
+    {
+        ManualClock::current() = std::chrono::milliseconds(checkpoint)
+                                 + start.time_since_epoch();
+        service.processExpired();
+        if (checkpoint % 5 == 0)
+            expected.push_back(int(checkpoint / 5));
+        REQUIRE(fired == expected);
+    }
+    REQUIRE(service.size() == 0);
+}
+
+TEST_CASE("cancel a timer", "[timer]")
+{
+    TimerService_t service(std::chrono::milliseconds(1), false);
+    int numCalls = 0;
+
+    TimerHandle handle = service.scheduleAfter(std::chrono::milliseconds(10),
+                                               [&] { ++numCalls; });
+    REQUIRE(handle.pending());
+
+    REQUIRE(handle.cancel());
+    REQUIRE(!handle.pending());
+    REQUIRE(!handle.cancel());
+    REQUIRE(service.size() == 0);
+
+    ManualClock::current() += std::chrono::milliseconds(10);
+    service.processExpired();
+    REQUIRE(numCalls == 0);
+
+    handle = service.scheduleAfter(std::chrono::milliseconds(10),
+                                   [&] { ++numCalls; });
+    ManualClock::current() += std::chrono::milliseconds(10);
+    service.processExpired();
+    REQUIRE(numCalls == 1);
+    REQUIRE(!handle.pending());
+    REQUIRE(!handle.cancel());
+}
+
+TEST_CASE("add a delayed event", "[timer]")
+{
+    using namespace timerSM;
+
+    TimerService_t service(std::chrono::milliseconds(1), false);
+    StateMachine_t sm;
+    sm.setTimerService(service);
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + event(1) > b;
+    sm.start();
+    sm.dispatchPending();
+
+    TimerHandle handle = sm.addEventAfter(std::chrono::milliseconds(20), 1);
+
+    ManualClock::current() += std::chrono::milliseconds(19);
+    service.processExpired();
+    sm.dispatchPending();
+    REQUIRE(isActive(sm, {&sm, &a}));
+
+    SECTION("the event is added after the delay")
+    {
+        ManualClock::current() += std::chrono::milliseconds(1);
+        service.processExpired();
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &b}));
+    }
+
+    SECTION("a cancelled event is not added")
+    {
+        REQUIRE(handle.cancel());
+        ManualClock::current() += std::chrono::milliseconds(1);
+        service.processExpired();
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &a}));
+    }
+}
+
+TEST_CASE("timed transitions", "[timer]")
+{
+    using namespace timerSM;
+
+    TimerService_t service(std::chrono::milliseconds(1), false);
+    StateMachine_t sm;
+    sm.setTimerService(service);
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    State_t c("c", &sm);
+
+    int numActions = 0;
+    sm += a + after(std::chrono::milliseconds(50)) / [&](int) { ++numActions; } > b;
+    sm += a + event(1) > c;
+    sm += c + event(2) > a;
+
+    sm.start();
+    sm.dispatchPending();
+    REQUIRE(isActive(sm, {&sm, &a}));
+    REQUIRE(service.size() == 1);
+
+    SECTION("the transition is taken after the delay")
+    {
+        ManualClock::current() += std::chrono::milliseconds(49);
+        service.processExpired();
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &a}));
+
+        ManualClock::current() += std::chrono::milliseconds(1);
+        service.processExpired();
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &b}));
+        REQUIRE(numActions == 1);
+    }
+
+    SECTION("the timeout is cancelled when the source state is left")
+    {
+        ManualClock::current() += std::chrono::milliseconds(30);
+        sm.addEvent(1);
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &c}));
+        REQUIRE(service.size() == 0);
+
+        ManualClock::current() += std::chrono::milliseconds(30);
+        service.processExpired();
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &c}));
+
+        // Re-entering the source state restarts the timeout.
+        sm.addEvent(2);
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &a}));
+        ManualClock::current() += std::chrono::milliseconds(40);
+        service.processExpired();
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &a}));
+
+        ManualClock::current() += std::chrono::milliseconds(10);
+        service.processExpired();
+        sm.dispatchPending();
+        REQUIRE(isActive(sm, {&sm, &b}));
+        REQUIRE(numActions == 1);
+    }
+
+    SECTION("the timeout is cancelled when the state machine is stopped")
+    {
+        sm.stop();
+        sm.dispatchPending();
+        REQUIRE(service.size() == 0);
+    }
+}
+
+TEST_CASE("a targetless timed transition is taken once", "[timer]")
+{
+    using namespace timerSM;
+
+    TimerService_t service(std::chrono::milliseconds(1), false);
+    StateMachine_t sm;
+    sm.setTimerService(service);
+    State_t a("a", &sm);
+
+    int numActions = 0;
+    sm += a + after(std::chrono::milliseconds(5)) / [&](int) { ++numActions; }
+          > noTarget;
+
+    sm.start();
+    sm.dispatchPending();
+    ManualClock::current() += std::chrono::milliseconds(5);
+    service.processExpired();
+    sm.dispatchPending();
+    REQUIRE(numActions == 1);
+
+    sm.addEvent(0);
+    sm.dispatchPending();
+    ManualClock::current() += std::chrono::milliseconds(5);
+    service.processExpired();
+    sm.dispatchPending();
+    REQUIRE(numActions == 1);
+}
+
+TEST_CASE("timed transitions in an asynchronous state machine", "[timer]")
+{
+    using namespace asyncTimerSM;
+
+    StateMachine_t sm;
+    State_t a("a", &sm);
+    State_t b("b", &sm);
+    sm += a + after(std::chrono::milliseconds(10)) > b;
+
+    auto result = sm.startAsyncEventLoop();
+    sm.start();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!b.isActive() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(isActive(sm, {&sm, &b}));
+
+    sm.stop();
+    result.get();
+}
+
+TEST_CASE("a slow action does not delay the timers of other machines",
+          "[timer]")
+{
+    using namespace asyncTimerSM;
+
+    // Both machines use the process-wide timer service.
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::atomic_bool slowActionStarted{false};
+
+    StateMachine_t sm1;
+    State_t a("a", &sm1);
+    State_t b("b", &sm1);
+    sm1 += a + after(std::chrono::milliseconds(1))
+           / [&](int) { slowActionStarted = true; opened.wait(); } > b;
+
+    StateMachine_t sm2;
+    State_t c("c", &sm2);
+    State_t d("d", &sm2);
+    sm2 += c + after(std::chrono::milliseconds(10)) > d;
+
+    auto result1 = sm1.startAsyncEventLoop();
+    auto result2 = sm2.startAsyncEventLoop();
+    sm1.start();
+    while (!slowActionStarted)
+        std::this_thread::yield();
+    sm2.start();
+
+    // The timer of sm2 expires while the action of sm1 is still running.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!d.isActive() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(isActive(sm2, {&sm2, &d}));
+
+    gate.set_value();
+    sm1.stop();
+    sm2.stop();
+    result1.get();
+    result2.get();
+}
+
+TEST_CASE("a timer does not block on a full event list", "[timer]")
+{
+    using StateMachine_t = StateMachine<AsynchronousEventDispatching,
+                                        MultithreadingEnable<true>,
+                                        EventListCapacity<1, Block>,
+                                        TimerEnable<true, ManualClock>>;
+
+    TimerService_t service(std::chrono::milliseconds(1), false);
+    StateMachine_t sm;
+    sm.setTimerService(service);
+
+    // The event loop is not running, so the list stays full.
+    sm.addEvent(1);
+    sm.addEventAt(ManualClock::now(), 2);
+    service.processExpired();
+    REQUIRE(sm.numDroppedEvents() == 1);
+}
@@ -39,49 +39,79 @@ INCLUDEPATH += ../src/
 
 SOURCES += \
     ../src/fsm11.cpp \
+    bench_eventlist.cpp \
+    bench_exitrequest.cpp \
+    bench_lock.cpp \
+    bench_threadedstate.cpp \
+    bench_threadpool.cpp \
     main.cpp \
     tst_behavior.cpp \
     tst_capturestorage.cpp \
+    tst_configurationsnapshot.cpp \
     tst_configurationchangecallback.cpp \
+    tst_coroutinestate.cpp \
     tst_error.cpp \
     tst_event.cpp \
     tst_eventcallback.cpp \
+    tst_eventfuture.cpp \
     tst_eventlist.cpp \
     tst_exceptions.cpp \
+    tst_executor.cpp \
     tst_functionstate.cpp \
     tst_hierarchy.cpp \
     tst_iteration.cpp \
+    tst_locks.cpp \
     tst_multithreading.cpp \
+    tst_replay.cpp \
+    tst_ringbuffer.cpp \
     tst_state.cpp \
     tst_statecallbacks.cpp \
     tst_statemachine.cpp \
+    tst_threadattributes.cpp \
     tst_threadedstate.cpp \
     tst_threadpool.cpp \
+    tst_timer.cpp \
     tst_transition.cpp \
     tst_transitionconflict.cpp \
     tst_transitionconflictcallback.cpp
 
 HEADERS += \
+    ../src/configurationsnapshot.hpp \
+    ../src/coroutinestate.hpp \
     ../src/error.hpp \
+    ../src/eventfdexecutor.hpp \
+    ../src/eventfuture.hpp \
+    ../src/executor.hpp \
     ../src/exitrequest.hpp \
     ../src/functionstate.hpp \
     ../src/historystate.hpp \
+    ../src/locks.hpp \
     ../src/options.hpp \
+    ../src/replay.hpp \
+    ../src/ringbuffer.hpp \
     ../src/state.hpp \
     ../src/statemachine_fwd.hpp \
     ../src/statemachine.hpp \
+    ../src/threadattributes.hpp \
     ../src/threadedfunctionstate.hpp \
     ../src/threadedstate.hpp \
     ../src/threadpool.hpp \
+    ../src/timerservice.hpp \
     ../src/transition.hpp \
+    ../src/detail/boundedring.hpp \
     ../src/detail/callbacks.hpp \
     ../src/detail/capturestorage.hpp \
     ../src/detail/eventdispatcher.hpp \
     ../src/detail/multithreading.hpp \
     ../src/detail/options.hpp \
     ../src/detail/scopeguard.hpp \
+    ../src/detail/threadcache.hpp \
     ../src/detail/threadedstatebase.hpp \
-    ../src/detail/threadpool.hpp
+    ../src/detail/threadpool.hpp \
+    ../src/detail/threadpoolcore.hpp \
+    ../src/detail/timers.hpp \
+    ../src/detail/timingwheel.hpp \
+    ../src/detail/workqueue.hpp
 
 HEADERS += catch.hpp \
            fsm11_user_config.hpp \